@@ -80,6 +80,19 @@ AudioIOProcess32 *AudioIOProcess32_new(AudioAnalyser32 *audioAnalyser,
     return self;
 }
 
+void AudioIOProcess32_setFastDTW(AudioIOProcess32 *self,
+                                 Boolean useFastDTW,
+                                 size_t radius,
+                                 Boolean reportAccuracy)
+{
+    self->useFastDTW = useFastDTW;
+    
+    if (useFastDTW == true) {
+        
+        AudioAnalyser32_setFastDTW(self->audioAnalyser, radius, reportAccuracy);
+    }
+}
+
 void AudioIOProcess32_delete(AudioIOProcess32 *self)
 {
     RingBufferFloat32_delete(self->ringBuffer);
@@ -139,6 +152,37 @@ static void AudioIOProcess32_writeAudioToOutput(AudioIOProcess32 *self,
     }
 }
 
+/*
+ Turn the matches of a segment into palette rows and lengths and send them to Csound.
+ */
+static void AudioIOProcess32_writeMatches(AudioIOProcess32 *self)
+{
+    if (self->useBeats) {
+        
+        for (size_t i = 0; i < self->paletteData->triangleMagnitudeBandsCount; ++i) {
+            
+            size_t index = self->bestTriangleBandMatches[i];
+            self->segmentLengths[i] = Matrix_getRow(self->paletteData->beats, 1)[index];
+            self->bestTriangleBandMatches[i] = Matrix_getRow(self->paletteData->beats, 0)[index];
+        }
+    }
+    
+    AudioAnalyser32_findMagnitudeDifferences(self->audioAnalyser,
+                                             self->analysisQueueComparisonData,
+                                             self->audioAnalyser->paletteComparisonData,
+                                             self->segmentLengths,
+                                             self->bestTriangleBandMatches,
+                                             self->segmentMagnitudeDifferences);
+    
+    
+    CsoundObject_writeOpenCLPVSReadPath(self->csoundObject,
+                                        self->paletteData->triangleMagnitudeBandsCount,
+                                        self->bestTriangleBandMatches,
+                                        self->segmentLengths,
+                                        self->segmentMagnitudeDifferences,
+                                        self->audioAnalyser->triangleBandGains);
+}
+
 static OSStatus AudioIOProcess32_RenderProc(void *inRefCon,
                                             AudioUnitRenderActionFlags *ioActionFlags,
                                             const AudioTimeStamp *inTimeStamp,
@@ -169,38 +213,55 @@ static OSStatus AudioIOProcess32_RenderProc(void *inRefCon,
                                                      self->analysisQueue,
                                                      self->paletteData);
             
-            if (self->analysisQueue->currentFrame == 0) {
+            if (self->audioAnalyser->useIncremental == true) {
                 
+                AudioAnalyser32_advanceIncrementalMatch(self->audioAnalyser,
+                                                        self->analysisQueueComparisonData,
+                                                        (self->analysisQueue->currentFrame + self->analysisQueue->frameCount - 1) % self->analysisQueue->frameCount);
+            }
+            
+            if (self->analysisQueue->currentFrame == 0) {
                 
-                AudioAnalyser32_findMatchOpenCL(self->audioAnalyser,
-                                                self->analysisQueueComparisonData,
-                                                self->warpFrameTimesInSeconds->data,
-                                                self->bestTriangleBandMatches);
+                Boolean matchesFound = true;
                 
-                if (self->useBeats) {
+                if (self->audioAnalyser->useIncremental == true) {
+                    
+                    AudioAnalyser32_findMatchIncremental(self->audioAnalyser,
+                                                         self->analysisQueueComparisonData,
+                                                         self->bestTriangleBandMatches,
+                                                         self->warpFrameTimesInSeconds);
+                }
+                else if (self->useFastDTW == true) {
                     
-                    for (size_t i = 0; i < self->paletteData->triangleMagnitudeBandsCount; ++i) {
+                    AudioAnalyser32_findMatchFastDTW(self->audioAnalyser,
+                                                     self->analysisQueueComparisonData,
+                                                     self->bestTriangleBandMatches);
+                }
+                else if (self->audioAnalyser->useAsynchronousOpenCL == true) {
+                    
+                    matchesFound = false;
+                    
+                    while (AudioAnalyser32_collectMatchOpenCL(self->audioAnalyser,
+                                                              self->bestTriangleBandMatches) == true) {
                         
-                        size_t index = self->bestTriangleBandMatches[i];
-                        self->segmentLengths[i] = Matrix_getRow(self->paletteData->beats, 1)[index];
-                        self->bestTriangleBandMatches[i] = Matrix_getRow(self->paletteData->beats, 0)[index];
+                        matchesFound = true;
                     }
+                    
+                    AudioAnalyser32_submitMatchOpenCL(self->audioAnalyser,
+                                                      self->analysisQueueComparisonData);
+                }
+                else {
+                    
+                    matchesFound = AudioAnalyser32_findMatchOpenCL(self->audioAnalyser,
+                                                                   self->analysisQueueComparisonData,
+                                                                   self->warpFrameTimesInSeconds->data,
+                                                                   self->bestTriangleBandMatches);
                 }
                 
-                AudioAnalyser32_findMagnitudeDifferences(self->audioAnalyser,
-                                                         self->analysisQueueComparisonData,
-                                                         self->audioAnalyser->paletteComparisonData,
-                                                         self->segmentLengths,
-                                                         self->bestTriangleBandMatches,
-                                                         self->segmentMagnitudeDifferences);
-                
-                
-                CsoundObject_writeOpenCLPVSReadPath(self->csoundObject,
-                                                    self->paletteData->triangleMagnitudeBandsCount,
-                                                    self->bestTriangleBandMatches,
-                                                    self->segmentLengths,
-                                                    self->segmentMagnitudeDifferences,
-                                                    self->audioAnalyser->triangleBandGains);
+                if (matchesFound == true) {
+                    
+                    AudioIOProcess32_writeMatches(self);
+                }
             }
         }
         
@@ -331,38 +392,55 @@ void AudioIOProcess32_processToAudioObject(AudioIOProcess32 *self,
                                                      self->analysisQueue,
                                                      self->paletteData);
             
-            if (self->analysisQueue->currentFrame == 0) {
+            if (self->audioAnalyser->useIncremental == true) {
                 
+                AudioAnalyser32_advanceIncrementalMatch(self->audioAnalyser,
+                                                        self->analysisQueueComparisonData,
+                                                        (self->analysisQueue->currentFrame + self->analysisQueue->frameCount - 1) % self->analysisQueue->frameCount);
+            }
+            
+            if (self->analysisQueue->currentFrame == 0) {
                 
-                AudioAnalyser32_findMatchOpenCL(self->audioAnalyser,
-                                                self->analysisQueueComparisonData,
-                                                self->warpFrameTimesInSeconds->data,
-                                                self->bestTriangleBandMatches);
+                Boolean matchesFound = true;
                 
-                if (self->useBeats) {
+                if (self->audioAnalyser->useIncremental == true) {
+                    
+                    AudioAnalyser32_findMatchIncremental(self->audioAnalyser,
+                                                         self->analysisQueueComparisonData,
+                                                         self->bestTriangleBandMatches,
+                                                         self->warpFrameTimesInSeconds);
+                }
+                else if (self->useFastDTW == true) {
+                    
+                    AudioAnalyser32_findMatchFastDTW(self->audioAnalyser,
+                                                     self->analysisQueueComparisonData,
+                                                     self->bestTriangleBandMatches);
+                }
+                else if (self->audioAnalyser->useAsynchronousOpenCL == true) {
                     
-                    for (size_t i = 0; i < self->paletteData->triangleMagnitudeBandsCount; ++i) {
+                    matchesFound = false;
+                    
+                    while (AudioAnalyser32_collectMatchOpenCL(self->audioAnalyser,
+                                                              self->bestTriangleBandMatches) == true) {
                         
-                        size_t index = self->bestTriangleBandMatches[i];
-                        self->segmentLengths[i] = Matrix_getRow(self->paletteData->beats, 1)[index];
-                        self->bestTriangleBandMatches[i] = Matrix_getRow(self->paletteData->beats, 0)[index];
+                        matchesFound = true;
                     }
+                    
+                    AudioAnalyser32_submitMatchOpenCL(self->audioAnalyser,
+                                                      self->analysisQueueComparisonData);
+                }
+                else {
+                    
+                    matchesFound = AudioAnalyser32_findMatchOpenCL(self->audioAnalyser,
+                                                                   self->analysisQueueComparisonData,
+                                                                   self->warpFrameTimesInSeconds->data,
+                                                                   self->bestTriangleBandMatches);
                 }
                 
-                AudioAnalyser32_findMagnitudeDifferences(self->audioAnalyser,
-                                                         self->analysisQueueComparisonData,
-                                                         self->audioAnalyser->paletteComparisonData,
-                                                         self->segmentLengths,
-                                                         self->bestTriangleBandMatches,
-                                                         self->segmentMagnitudeDifferences);
-                
-                
-                CsoundObject_writeOpenCLPVSReadPath(self->csoundObject,
-                                                    self->paletteData->triangleMagnitudeBandsCount,
-                                                    self->bestTriangleBandMatches,
-                                                    self->segmentLengths,
-                                                    self->segmentMagnitudeDifferences,
-                                                    self->audioAnalyser->triangleBandGains);
+                if (matchesFound == true) {
+                    
+                    AudioIOProcess32_writeMatches(self);
+                }
             }
             
         }
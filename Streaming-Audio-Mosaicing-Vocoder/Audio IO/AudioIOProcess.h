@@ -39,6 +39,7 @@ extern "C"
         AudioObject *audioObject;
         Boolean useBeats;
         Boolean useFlux;
+        Boolean useFastDTW;
 
         Float32 *segmentLengths;
         Float32 *segmentMagnitudeDifferences;
@@ -62,6 +63,14 @@ extern "C"
                                            Boolean useFlux);
     
     void AudioIOProcess32_delete(AudioIOProcess32 *self);
+    
+    /*!
+     Match segments with the approximate multi-resolution search instead of the OpenCL comparisons. A larger radius is slower and closer to exact, with reportAccuracy the exact scores are calculated alongside and summarised by AudioAnalyser32_printFastDTWReport.
+     */
+    void AudioIOProcess32_setFastDTW(AudioIOProcess32 *self,
+                                     Boolean useFastDTW,
+                                     size_t radius,
+                                     Boolean reportAccuracy);
     void AudioIOProcess32_configureAudioUnit(AudioIOProcess32 *self);
     void AudioIOProcess32_configureCsound(AudioIOProcess32 *self);
     void AudioIOProcess32_process(AudioIOProcess32 *self,
@@ -30,9 +30,174 @@ AudioAnalyser32 *AudioAnalyser32_new(size_t samplerate,
     self->dtwAllocated = false;
     self->frameBuffer = calloc(self->FFTFrameSize, sizeof(Float32));
     self->previousTriangleMagnitudes = calloc(triangleFilterCount, sizeof(Float32));
+    self->workspacePool = DTWWorkspacePool32_new();
     return self;
 }
 
+void AudioAnalyser32_setDTWConstraint(AudioAnalyser32 *self,
+                                      DTWConstraint constraint,
+                                      Float32 constraintParameter)
+{
+    if (self->dtwAllocated == true) {
+        
+        printf("AudioAnalyser32_setDTWConstraint, DTW already allocated, exiting\n");
+        exit(-1);
+    }
+    
+    self->constraint = constraint;
+    self->constraintParameter = constraintParameter;
+}
+
+void AudioAnalyser32_setSubsequenceSearch(AudioAnalyser32 *self,
+                                          Boolean useSubsequence)
+{
+    if (self->dtwAllocated == true) {
+        
+        printf("AudioAnalyser32_setSubsequenceSearch, DTW already allocated, exiting\n");
+        exit(-1);
+    }
+    
+    self->useSubsequence = useSubsequence;
+}
+
+void AudioAnalyser32_setIncrementalMatching(AudioAnalyser32 *self,
+                                            Boolean useIncremental)
+{
+    if (self->dtwAllocated == true) {
+        
+        printf("AudioAnalyser32_setIncrementalMatching, DTW already allocated, exiting\n");
+        exit(-1);
+    }
+    
+    self->useIncremental = useIncremental;
+}
+
+void AudioAnalyser32_setParallelDTW(AudioAnalyser32 *self,
+                                    size_t threadCount,
+                                    size_t cellThreshold)
+{
+    if (self->dtwAllocated == true) {
+        
+        printf("AudioAnalyser32_setParallelDTW, DTW already allocated, exiting\n");
+        exit(-1);
+    }
+    
+    self->useParallelDTW = true;
+    self->dtwThreadCount = threadCount;
+    self->parallelCellThreshold = cellThreshold;
+}
+
+void AudioAnalyser32_setFastDTW(AudioAnalyser32 *self,
+                                size_t radius,
+                                Boolean reportAccuracy)
+{
+    if (self->dtwAllocated == false) {
+        
+        printf("AudioAnalyser32_setFastDTW, DTW not allocated, exiting\n");
+        exit(-1);
+    }
+    
+    size_t maximumRowCount = self->normalisedAnalysis->rowCount;
+    size_t maximumColumnCount = 0;
+    
+    for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
+        
+        size_t columnCount = self->paletteComparisonData[i]->columnCount;
+        maximumColumnCount = columnCount > maximumColumnCount ? columnCount : maximumColumnCount;
+    }
+    
+    if (self->useBeats == true) {
+        
+        for (size_t i = 0; i < self->paletteBeats->columnCount; ++i) {
+            
+            size_t length = (size_t)Matrix_getRow(self->paletteBeats, 1)[i];
+            maximumRowCount = length > maximumRowCount ? length : maximumRowCount;
+        }
+    }
+    
+    if (self->fastDTW != NULL) {
+        
+        FastDTW32_delete(self->fastDTW);
+    }
+    
+    if (self->exactDTW != NULL) {
+        
+        DTW32_delete(self->exactDTW);
+        self->exactDTW = NULL;
+    }
+    
+    self->fastDTW = FastDTW32_new(maximumRowCount, maximumColumnCount, radius);
+    self->reportFastDTW = reportAccuracy;
+    
+    if (reportAccuracy == true) {
+        
+        self->exactDTW = DTW32_newWithPool(maximumRowCount, maximumColumnCount, self->workspacePool);
+    }
+    
+    AudioAnalyser32_FastDTWReport report = {0};
+    self->fastDTWReport = report;
+}
+
+void AudioAnalyser32_setMatchCount(AudioAnalyser32 *self,
+                                   size_t matchCount)
+{
+    if (self->dtwAllocated == true) {
+        
+        printf("AudioAnalyser32_setMatchCount, DTW already allocated, exiting\n");
+        exit(-1);
+    }
+    
+    self->matchCount = matchCount;
+}
+
+void AudioAnalyser32_setCandidateLanes(AudioAnalyser32 *self,
+                                       Boolean useCandidateLanes)
+{
+    if (self->dtwAllocated == true) {
+        
+        printf("AudioAnalyser32_setCandidateLanes, DTW already allocated, exiting\n");
+        exit(-1);
+    }
+    
+    self->useCandidateLanes = useCandidateLanes;
+}
+
+void AudioAnalyser32_setNormalisedDistances(AudioAnalyser32 *self,
+                                            Boolean useNormalisedDistances)
+{
+    if (self->dtwAllocated == true) {
+        
+        printf("AudioAnalyser32_setNormalisedDistances, DTW already allocated, exiting\n");
+        exit(-1);
+    }
+    
+    self->useNormalisedDistances = useNormalisedDistances;
+}
+
+void AudioAnalyser32_setScoreKernels(AudioAnalyser32 *self,
+                                     Boolean useScoreKernels)
+{
+    if (self->dtwAllocated == true) {
+        
+        printf("AudioAnalyser32_setScoreKernels, DTW already allocated, exiting\n");
+        exit(-1);
+    }
+    
+    self->useScoreKernels = useScoreKernels;
+}
+
+void AudioAnalyser32_setAsynchronousOpenCL(AudioAnalyser32 *self,
+                                           Boolean useAsynchronousOpenCL)
+{
+    if (self->dtwAllocated == true) {
+        
+        printf("AudioAnalyser32_setAsynchronousOpenCL, DTW already allocated, exiting\n");
+        exit(-1);
+    }
+    
+    self->useAsynchronousOpenCL = useAsynchronousOpenCL;
+}
+
 void AudioAnalyser32_allocateDTW(AudioAnalyser32 *self,
                                  AudioAnalysisData32 *paletteAnalysisData,
                                  size_t rowCount,
@@ -40,9 +205,29 @@ void AudioAnalyser32_allocateDTW(AudioAnalyser32 *self,
                                  Boolean useBeats,
                                  Boolean useFlux)
 {
-    self->magnitudesDTW = DTW32_new(rowCount, columnCount);
+    if (self->useIncremental == true && self->constraint != kDTWConstraint_None) {
+        
+        printf("AudioAnalyser32_allocateDTW, incremental matching can not follow a path constraint, exiting\n");
+        exit(-1);
+    }
+    
+    size_t maximumCandidateRowCount = rowCount;
+    
+    if (self->useIncremental == true && useBeats == true) {
+        
+        for (size_t i = 0; i < paletteAnalysisData->beats->columnCount; ++i) {
+            
+            size_t beatRowCount = (size_t)Matrix_getRow(paletteAnalysisData->beats, 1)[i];
+            maximumCandidateRowCount = beatRowCount > maximumCandidateRowCount ? beatRowCount : maximumCandidateRowCount;
+        }
+    }
+    
+    self->magnitudesDTW = DTW32_newConstrainedWithPool(maximumCandidateRowCount,
+                                                       columnCount,
+                                                       self->constraint,
+                                                       self->constraintParameter,
+                                                       self->workspacePool);
     
-    self->openclDTWs = calloc(self->triangleMagnitudeBandsCount, sizeof(OpenCLDTW *));
     
     
     if (useFlux == true) {
@@ -54,27 +239,170 @@ void AudioAnalyser32_allocateDTW(AudioAnalyser32 *self,
         self->paletteComparisonData = paletteAnalysisData->triangleMagnitudeBands;
     }
     
+    self->useFlux = useFlux;
+    self->paletteEnvelopes = calloc(self->triangleMagnitudeBandsCount, sizeof(Matrix32 *));
+    
+    size_t envelopeRadius = rowCount - 1;
+    
+    if (self->constraint == kDTWConstraint_SakoeChiba && ceilf(self->constraintParameter) < envelopeRadius) {
+        
+        envelopeRadius = (size_t)ceilf(self->constraintParameter);
+    }
+    
+    if (self->useNormalisedDistances == true || self->useScoreKernels == true || self->useCandidateLanes == true) {
+        
+        if (paletteAnalysisData->normalisedTriangleMagnitudeBands == NULL) {
+            
+            AudioAnalysisData32_normaliseTriangleBands(paletteAnalysisData);
+        }
+        
+        if (useFlux == true) {
+            
+            self->normalisedPaletteComparisonData = paletteAnalysisData->normalisedTriangleFluxMagnitudeBands;
+        }
+        else {
+            
+            self->normalisedPaletteComparisonData = paletteAnalysisData->normalisedTriangleMagnitudeBands;
+        }
+    }
+    
+    if (self->constraint == kDTWConstraint_None
+        &&
+        self->useSubsequence == false
+        &&
+        self->useCandidateLanes == false
+        &&
+        self->useIncremental == false) {
+        
+        if (paletteAnalysisData->triangleBandNorms == NULL) {
+            
+            AudioAnalysisData32_calculateTriangleBandNorms(paletteAnalysisData);
+        }
+        
+        self->paletteNorms = useFlux == true ? paletteAnalysisData->triangleFluxBandNorms : paletteAnalysisData->triangleBandNorms;
+    }
+    
+    size_t maximumPaletteRowCount = 0;
+    size_t maximumBandColumnCount = 0;
+    
     for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
         
         size_t currentColumnCount = paletteAnalysisData->triangleRowBlockSizes[i];
+        size_t currentPaletteRowCount = self->paletteComparisonData[i]->rowCount;
         
-        self->openclDTWs[i] = OpenCLDTW_new(OpenCLDTW_useCPU,
-                                            rowCount,
-                                            currentColumnCount,
-                                            self->paletteComparisonData[i]->data,
-                                            self->paletteComparisonData[i]->rowCount,
-                                            paletteAnalysisData->beats,
-                                            useBeats);
+        maximumPaletteRowCount = currentPaletteRowCount > maximumPaletteRowCount ? currentPaletteRowCount : maximumPaletteRowCount;
+        maximumBandColumnCount = currentColumnCount > maximumBandColumnCount ? currentColumnCount : maximumBandColumnCount;
+        
+        self->paletteEnvelopes[i] = Matrix32_new(self->paletteComparisonData[i]->rowCount, currentColumnCount);
+        DTW32_calculateUpperEnvelope(self->paletteComparisonData[i]->data,
+                                     self->paletteComparisonData[i]->rowCount,
+                                     currentColumnCount,
+                                     envelopeRadius,
+                                     self->paletteEnvelopes[i]->data);
+    }
+    
+    self->openclBatch = OpenCLBatchDTW_new(OpenCLDTW_useCPU,
+                                           rowCount,
+                                           self->paletteComparisonData,
+                                           self->triangleMagnitudeBandsCount,
+                                           useFlux == true ? paletteAnalysisData->triangleFluxBandStorage : paletteAnalysisData->triangleBandStorage,
+                                           paletteAnalysisData->beats,
+                                           useBeats);
+    
+    OpenCLBatchDTW_setConstraint(self->openclBatch, self->constraint, self->constraintParameter);
+    
+    self->bandMatches = calloc(self->triangleMagnitudeBandsCount, sizeof(MatchHeap32 *));
+    
+    for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
         
+        self->bandMatches[i] = MatchHeap32_new(self->matchCount);
     }
     
-    self->openclSimilarityScores = calloc(self->openclDTWs[0]->globalWorkSize, sizeof(Float32));
+    self->scoreKernels = calloc(self->triangleMagnitudeBandsCount, sizeof(DTW32_ScoreKernel));
+    
+    if (self->useScoreKernels == true && self->constraint == kDTWConstraint_None) {
+        
+        for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
+            
+            self->scoreKernels[i] = DTW32_getScoreKernel(rowCount, paletteAnalysisData->triangleRowBlockSizes[i]);
+        }
+    }
+    
+    if (self->paletteNorms != NULL || self->useNormalisedDistances == true) {
+        
+        self->paletteDistanceMatrix = calloc(rowCount * maximumPaletteRowCount, sizeof(Float32));
+    }
+    
+    self->analysisNorms = calloc(rowCount, sizeof(Float32));
+    self->normalisedAnalysis = Matrix32_new(rowCount, maximumBandColumnCount);
+    self->useBeats = useBeats;
+    self->paletteBeats = paletteAnalysisData->beats;
+    
+    if (self->useIncremental == true) {
+        
+        self->incrementalDTWs = calloc(self->triangleMagnitudeBandsCount, sizeof(IncrementalDTW32 *));
+        
+        for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
+            
+            self->incrementalDTWs[i] = IncrementalDTW32_new(rowCount,
+                                                            paletteAnalysisData->triangleRowBlockSizes[i],
+                                                            self->paletteComparisonData[i]->data,
+                                                            self->paletteComparisonData[i]->rowCount,
+                                                            paletteAnalysisData->beats,
+                                                            useBeats);
+        }
+    }
+    
+    if (self->useCandidateLanes == true) {
+        
+        self->paletteCandidateLanes = calloc(self->triangleMagnitudeBandsCount, sizeof(Float32 *));
+        size_t *candidateStarts = calloc(maximumPaletteRowCount / rowCount + 1, sizeof(size_t));
+        
+        for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
+            
+            Matrix32 *palette = self->normalisedPaletteComparisonData[i];
+            size_t candidateCount = 0;
+            
+            for (size_t start = 0; start + rowCount < palette->rowCount; start += rowCount) {
+                
+                candidateStarts[candidateCount] = start;
+                candidateCount++;
+            }
+            
+            self->paletteCandidateLanes[i] = calloc(DTW32_candidateLaneGroupCount(candidateCount) * rowCount * palette->columnCount * DTW32_CANDIDATE_LANE_COUNT, sizeof(Float32));
+            DTW32_transposeCandidateLanes(palette->data,
+                                          palette->columnCount,
+                                          candidateStarts,
+                                          candidateCount,
+                                          rowCount,
+                                          self->paletteCandidateLanes[i]);
+        }
+        
+        free(candidateStarts);
+    }
+    
+    self->openclSimilarityScores = calloc(self->triangleMagnitudeBandsCount * self->openclBatch->candidateCount, sizeof(Float32));
+    self->openclBestMatches = calloc(self->triangleMagnitudeBandsCount, sizeof(size_t));
     
     self->warpPath = calloc(rowCount, sizeof(size_t));
     
-    self->frameTimesInSeconds = calloc(rowCount, sizeof(size_t));
+    size_t frameTimeCount = maximumCandidateRowCount > 2 * rowCount ? maximumCandidateRowCount : 2 * rowCount;
     
-    for (size_t i = 0; i < rowCount; ++i) {
+    if (self->useSubsequence == true) {
+        
+        DTW32_reserveSubsequenceTraceback(self->magnitudesDTW, maximumPaletteRowCount);
+        self->subsequenceMatches = calloc(self->triangleMagnitudeBandsCount, sizeof(DTW32_SubsequenceMatch));
+        frameTimeCount = maximumPaletteRowCount > frameTimeCount ? maximumPaletteRowCount : frameTimeCount;
+    }
+    
+    if (self->useParallelDTW == true && self->constraint == kDTWConstraint_None) {
+        
+        DTW32_setParallelAccumulation(self->magnitudesDTW, self->dtwThreadCount, self->parallelCellThreshold);
+    }
+    
+    self->frameTimesInSeconds = calloc(frameTimeCount, sizeof(size_t));
+    
+    for (size_t i = 0; i < frameTimeCount; ++i) {
         
         self->frameTimesInSeconds[i] = (Float32)i * (1. / (Float32)44100) * (Float32)self->hopSize;
     }
@@ -93,19 +421,63 @@ void AudioAnalyser32_delete(AudioAnalyser32 *self)
         
         for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
             
-            OpenCLDTW_delete(self->openclDTWs[i]);
+            Matrix32_delete(self->paletteEnvelopes[i]);
+            MatchHeap32_delete(self->bandMatches[i]);
         }
         
-        free(self->openclDTWs);
+        free(self->bandMatches);
+        OpenCLBatchDTW_delete(self->openclBatch);
+        free(self->paletteEnvelopes);
+        free(self->paletteDistanceMatrix);
+        free(self->analysisNorms);
+        free(self->scoreKernels);
+        Matrix32_delete(self->normalisedAnalysis);
         free(self->openclSimilarityScores);
+        free(self->openclBestMatches);
         free(self->frameTimesInSeconds);
         free(self->warpPath);
+        
+        if (self->useSubsequence == true) {
+            
+            free(self->subsequenceMatches);
+        }
+        
+        if (self->useIncremental == true) {
+            
+            for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
+                
+                IncrementalDTW32_delete(self->incrementalDTWs[i]);
+            }
+            
+            free(self->incrementalDTWs);
+        }
+        
+        if (self->useCandidateLanes == true) {
+            
+            for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
+                
+                free(self->paletteCandidateLanes[i]);
+            }
+            
+            free(self->paletteCandidateLanes);
+        }
+        
+        if (self->fastDTW != NULL) {
+            
+            FastDTW32_delete(self->fastDTW);
+        }
+        
+        if (self->exactDTW != NULL) {
+            
+            DTW32_delete(self->exactDTW);
+        }
     }
     
     free(self->frameBuffer);
     free(self->mfccBuffer);
     free(self->chromagramBuffer);
     free(self->previousTriangleMagnitudes);
+    DTWWorkspacePool32_delete(self->workspacePool);
     free(self);
     self = NULL;
 }
@@ -328,67 +700,548 @@ void AudioAnalyser32_findTriangleFilterBandGains(AudioAnalyser32 *self,
     }
 }
 
+/*
+ Add one band's counts to matchStatistics and recalculate the pruning rate over every band counted so far.
+ */
+static void AudioAnalyser32_addMatchStatistics(AudioAnalyser32 *self,
+                                               AudioAnalyser32_MatchStatistics *statistics)
+{
+    AudioAnalyser32_MatchStatistics *total = &self->matchStatistics;
+    
+    total->candidateCount += statistics->candidateCount;
+    total->kimPrunedCount += statistics->kimPrunedCount;
+    total->keoghPrunedCount += statistics->keoghPrunedCount;
+    total->abandonedCount += statistics->abandonedCount;
+    
+    if (total->candidateCount > 0) {
+        
+        total->pruningRate = (Float32)(total->kimPrunedCount + total->keoghPrunedCount + total->abandonedCount) / (Float32)total->candidateCount;
+    }
+}
+
 size_t AudioAnalyser32_findBestMatch(AudioAnalyser32 *self,
                                      Matrix32 *analysisData,
                                      Matrix32 *paletteData,
+                                     Matrix32 *paletteEnvelope,
+                                     const Float32 *paletteNorms,
+                                     Matrix32 *normalisedPaletteData,
+                                     DTW32_ScoreKernel scoreKernel,
+                                     MatchHeap32 *matches,
                                      Float32 *warpFrameTimesInSeconds)
 {
     size_t bestMatch = 0;
-    Float32 bestScore = INFINITY;
+    AudioAnalyser32_MatchStatistics statistics = {0};
+    
+    MatchHeap32_clear(matches);
+    
+    if (normalisedPaletteData != NULL) {
+        
+        Matrix32_setElementCount(self->normalisedAnalysis, analysisData->rowCount, analysisData->columnCount);
+        Matrix32_normaliseRows(analysisData, self->normalisedAnalysis);
+    }
+    
+    if (normalisedPaletteData != NULL && scoreKernel == NULL) {
+        
+        DTW32_calculateNormalisedDistanceMatrix(self->normalisedAnalysis->data,
+                                                analysisData->rowCount,
+                                                normalisedPaletteData->data,
+                                                normalisedPaletteData->rowCount,
+                                                analysisData->columnCount,
+                                                self->paletteDistanceMatrix);
+    }
+    else if (normalisedPaletteData == NULL && paletteNorms != NULL) {
+        
+        DTW32_calculateRowNorms(analysisData->data, analysisData->rowCount, analysisData->columnCount, self->analysisNorms);
+        DTW32_calculateCosineDistanceMatrix(analysisData->data,
+                                            self->analysisNorms,
+                                            analysisData->rowCount,
+                                            paletteData->data,
+                                            paletteNorms,
+                                            paletteData->rowCount,
+                                            analysisData->columnCount,
+                                            self->paletteDistanceMatrix);
+    }
     
     for (size_t i = 0; i < paletteData->rowCount - analysisData->rowCount; i += analysisData->rowCount) {
         
-        Float32 currentScore = DTW32_getSimilarityScore(self->magnitudesDTW,
+        statistics.candidateCount++;
+        Float32 threshold = MatchHeap32_getThreshold(matches);
+        
+        if (DTW32_lowerBoundKim(analysisData->data,
+                                analysisData->rowCount,
+                                Matrix_getRow(paletteData, i),
+                                analysisData->rowCount,
+                                analysisData->columnCount) >= threshold) {
+            
+            statistics.kimPrunedCount++;
+            continue;
+        }
+        
+        if (paletteEnvelope != NULL
+            &&
+            DTW32_lowerBoundKeogh(analysisData->data,
+                                  analysisData->rowCount,
+                                  Matrix_getRow(paletteEnvelope, i),
+                                  analysisData->columnCount,
+                                  threshold) >= threshold) {
+            
+            statistics.keoghPrunedCount++;
+            continue;
+        }
+        
+        Float32 currentScore;
+        
+        if (normalisedPaletteData != NULL && scoreKernel != NULL) {
+            
+            currentScore = scoreKernel(self->normalisedAnalysis->data,
+                                       Matrix_getRow(normalisedPaletteData, i),
+                                       threshold);
+        }
+        else if (normalisedPaletteData != NULL || paletteNorms != NULL) {
+            
+            currentScore = DTW32_getSimilarityScoreFromDistances(self->magnitudesDTW,
+                                                                 &self->paletteDistanceMatrix[i],
+                                                                 paletteData->rowCount,
+                                                                 analysisData->rowCount,
+                                                                 analysisData->rowCount,
+                                                                 threshold);
+        }
+        else {
+            
+            currentScore = DTW32_getSimilarityScoreOnly(self->magnitudesDTW,
                                                         analysisData->data,
                                                         analysisData->rowCount,
                                                         Matrix_getRow(paletteData, i),
                                                         analysisData->rowCount,
-                                                        analysisData->columnCount);
-        if (currentScore < bestScore) {
+                                                        analysisData->columnCount,
+                                                        threshold);
+        }
+        
+        if (currentScore == INFINITY) {
             
-            DTW32_traceWarpPath(self->magnitudesDTW, self->warpPath);
-            bestScore = currentScore;
-            bestMatch = i;
+            statistics.abandonedCount++;
+            continue;
         }
+        
+        MatchHeap32_insert(matches, i, currentScore);
     }
     
+    if (matches->count > 0) {
+        
+        bestMatch = MatchHeap32_getBest(matches, NULL);
+        
+        DTW32_getSimilarityScore(self->magnitudesDTW,
+                                 analysisData->data,
+                                 analysisData->rowCount,
+                                 Matrix_getRow(paletteData, bestMatch),
+                                 analysisData->rowCount,
+                                 analysisData->columnCount);
+        
+        DTW32_traceWarpPath(self->magnitudesDTW, self->warpPath);
+    }
+    
+    AudioAnalyser32_addMatchStatistics(self, &statistics);
+    
     vDSP_vgathr(self->frameTimesInSeconds, self->warpPath, 1, warpFrameTimesInSeconds, 1, analysisData->rowCount);
     
     return bestMatch;
 }
 
+size_t AudioAnalyser32_findBestMatchLanes(AudioAnalyser32 *self,
+                                          Matrix32 *analysisData,
+                                          Matrix32 *paletteData,
+                                          const Float32 *candidateLanes,
+                                          MatchHeap32 *matches,
+                                          Float32 *warpFrameTimesInSeconds)
+{
+    const size_t rowCount = analysisData->rowCount;
+    const size_t groupSize = rowCount * analysisData->columnCount * DTW32_CANDIDATE_LANE_COUNT;
+    size_t bestMatch = 0;
+    Float32 scores[DTW32_CANDIDATE_LANE_COUNT];
+    AudioAnalyser32_MatchStatistics statistics = {0};
+    
+    MatchHeap32_clear(matches);
+    
+    Matrix32_setElementCount(self->normalisedAnalysis, rowCount, analysisData->columnCount);
+    Matrix32_normaliseRows(analysisData, self->normalisedAnalysis);
+    
+    size_t candidateCount = paletteData->rowCount > rowCount ? (paletteData->rowCount - 1) / rowCount : 0;
+    
+    for (size_t group = 0; group < DTW32_candidateLaneGroupCount(candidateCount); ++group) {
+        
+        size_t firstCandidate = group * DTW32_CANDIDATE_LANE_COUNT;
+        size_t laneCount = candidateCount - firstCandidate < DTW32_CANDIDATE_LANE_COUNT ? candidateCount - firstCandidate : DTW32_CANDIDATE_LANE_COUNT;
+        Float32 threshold = MatchHeap32_getThreshold(matches);
+        Boolean pruned = true;
+        
+        statistics.candidateCount += laneCount;
+        
+        for (size_t lane = 0; lane < laneCount && pruned == true; ++lane) {
+            
+            pruned = DTW32_lowerBoundKim(analysisData->data,
+                                         rowCount,
+                                         Matrix_getRow(paletteData, (firstCandidate + lane) * rowCount),
+                                         rowCount,
+                                         analysisData->columnCount) >= threshold;
+        }
+        
+        if (pruned == true) {
+            
+            statistics.kimPrunedCount += laneCount;
+            continue;
+        }
+        
+        DTW32_getSimilarityScoresLanes(self->magnitudesDTW,
+                                       self->normalisedAnalysis->data,
+                                       rowCount,
+                                       &candidateLanes[group * groupSize],
+                                       laneCount,
+                                       rowCount,
+                                       analysisData->columnCount,
+                                       threshold,
+                                       scores);
+        
+        for (size_t lane = 0; lane < laneCount; ++lane) {
+            
+            if (scores[lane] == INFINITY) {
+                
+                statistics.abandonedCount++;
+                continue;
+            }
+            
+            MatchHeap32_insert(matches, (firstCandidate + lane) * rowCount, scores[lane]);
+        }
+    }
+    
+    if (matches->count > 0) {
+        
+        bestMatch = MatchHeap32_getBest(matches, NULL);
+        
+        DTW32_getSimilarityScore(self->magnitudesDTW,
+                                 analysisData->data,
+                                 rowCount,
+                                 Matrix_getRow(paletteData, bestMatch),
+                                 rowCount,
+                                 analysisData->columnCount);
+        
+        DTW32_traceWarpPath(self->magnitudesDTW, self->warpPath);
+    }
+    
+    AudioAnalyser32_addMatchStatistics(self, &statistics);
+    
+    vDSP_vgathr(self->frameTimesInSeconds, self->warpPath, 1, warpFrameTimesInSeconds, 1, rowCount);
+    
+    return bestMatch;
+}
+
+size_t AudioAnalyser32_findBestSubsequence(AudioAnalyser32 *self,
+                                           Matrix32 *analysisData,
+                                           Matrix32 *paletteData,
+                                           DTW32_SubsequenceMatch *subsequenceMatch,
+                                           Float32 *warpFrameTimesInSeconds)
+{
+    *subsequenceMatch = DTW32_findSubsequence(self->magnitudesDTW,
+                                              analysisData->data,
+                                              analysisData->rowCount,
+                                              paletteData->data,
+                                              paletteData->rowCount,
+                                              analysisData->columnCount);
+    
+    DTW32_traceSubsequenceWarpPath(self->magnitudesDTW, self->warpPath);
+    
+    vDSP_vgathr(self->frameTimesInSeconds, self->warpPath, 1, warpFrameTimesInSeconds, 1, analysisData->rowCount);
+    
+    return subsequenceMatch->start;
+}
+
+void AudioAnalyser32_printMatchStatistics(AudioAnalyser32 *self)
+{
+    AudioAnalyser32_MatchStatistics statistics = self->matchStatistics;
+    
+    printf("candidates = %zd, LB_Kim pruned = %zd, LB_Keogh pruned = %zd, abandoned = %zd, pruning rate = %.3f\n",
+           statistics.candidateCount,
+           statistics.kimPrunedCount,
+           statistics.keoghPrunedCount,
+           statistics.abandonedCount,
+           statistics.pruningRate);
+}
+
 void AudioAnalyser32_findBestTriangleBandMatches(AudioAnalyser32 *self,
                                                  AudioAnalysisQueue32 *analysisQueue,
                                                  AudioAnalysisData32 *paletteData,
                                                  size_t *bestMatches,
                                                  Matrix32 *warpFrameTimesInSeconds)
 {
+    Matrix32 **analysisComparisonData = self->useFlux ? analysisQueue->triangleFluxMagnitudeBands : analysisQueue->triangleMagnitudeBands;
+    AudioAnalyser32_MatchStatistics noStatistics = {0};
+    
+    self->matchStatistics = noStatistics;
     
     for (size_t currentBand = 0; currentBand < paletteData->triangleMagnitudeBandsCount; ++currentBand) {
         
+        if (self->useSubsequence == true) {
+            
+            bestMatches[currentBand] = AudioAnalyser32_findBestSubsequence(self,
+                                                                           analysisComparisonData[currentBand],
+                                                                           self->paletteComparisonData[currentBand],
+                                                                           &self->subsequenceMatches[currentBand],
+                                                                           Matrix_getRow(warpFrameTimesInSeconds, currentBand));
+            continue;
+        }
+        
+        if (self->useCandidateLanes == true) {
+            
+            bestMatches[currentBand] = AudioAnalyser32_findBestMatchLanes(self,
+                                                                          analysisComparisonData[currentBand],
+                                                                          self->paletteComparisonData[currentBand],
+                                                                          self->paletteCandidateLanes[currentBand],
+                                                                          self->bandMatches[currentBand],
+                                                                          Matrix_getRow(warpFrameTimesInSeconds, currentBand));
+            continue;
+        }
+        
         bestMatches[currentBand] = AudioAnalyser32_findBestMatch(self,
-                                                                 analysisQueue->triangleMagnitudeBands[currentBand],
-                                                                 paletteData->triangleMagnitudeBands[currentBand],
+                                                                 analysisComparisonData[currentBand],
+                                                                 self->paletteComparisonData[currentBand],
+                                                                 self->paletteEnvelopes[currentBand],
+                                                                 self->paletteNorms != NULL ? self->paletteNorms[currentBand] : NULL,
+                                                                 self->useNormalisedDistances == true || self->scoreKernels[currentBand] != NULL ? self->normalisedPaletteComparisonData[currentBand] : NULL,
+                                                                 self->scoreKernels[currentBand],
+                                                                 self->bandMatches[currentBand],
                                                                  Matrix_getRow(warpFrameTimesInSeconds, currentBand));
     }
 }
 
-void AudioAnalyser32_findMatchOpenCL(AudioAnalyser32 *self,
-                                     Matrix32 **triangleMagnitudeBands,
-                                     Float32 *warpFrameTimesInSeconds,
-                                     size_t *bestTriangleBandMatches)
+/*
+ Fill the band heaps from openclSimilarityScores, which hold each band's best candidate from the device argmin, or every score when more than one match is kept.
+ */
+static void AudioAnalyser32_storeMatchesOpenCL(AudioAnalyser32 *self,
+                                               size_t *bestTriangleBandMatches)
+{
+    const size_t candidateCount = self->openclBatch->candidateCount;
+    
+    for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
+        
+        MatchHeap32_clear(self->bandMatches[i]);
+        
+        if (self->matchCount <= 1) {
+            
+            MatchHeap32_insert(self->bandMatches[i], self->openclBestMatches[i], self->openclSimilarityScores[i]);
+        }
+        else {
+            
+            for (size_t j = 0; j < candidateCount; ++j) {
+                
+                MatchHeap32_insert(self->bandMatches[i], j, self->openclSimilarityScores[i * candidateCount + j]);
+            }
+        }
+        
+        bestTriangleBandMatches[i] = MatchHeap32_getBest(self->bandMatches[i], NULL);
+    }
+}
+
+Boolean AudioAnalyser32_findMatchOpenCL(AudioAnalyser32 *self,
+                                        Matrix32 **triangleMagnitudeBands,
+                                        Float32 *warpFrameTimesInSeconds,
+                                        size_t *bestTriangleBandMatches)
+{
+    Boolean found;
+    
+    if (self->matchCount <= 1) {
+        
+        found = OpenCLBatchDTW_findBestMatches(self->openclBatch, triangleMagnitudeBands, self->openclBestMatches, self->openclSimilarityScores);
+    }
+    else {
+        
+        found = OpenCLBatchDTW_getScores(self->openclBatch, triangleMagnitudeBands, self->openclSimilarityScores);
+    }
+    
+    if (found == true) {
+        
+        AudioAnalyser32_storeMatchesOpenCL(self, bestTriangleBandMatches);
+    }
+    
+    return found;
+}
+
+Boolean AudioAnalyser32_submitMatchOpenCL(AudioAnalyser32 *self,
+                                          Matrix32 **triangleMagnitudeBands)
+{
+    Boolean submitted = OpenCLBatchDTW_submit(self->openclBatch, triangleMagnitudeBands, self->matchCount > 1);
+    
+    if (submitted == false) {
+        
+        self->openclSkippedSearches++;
+    }
+    
+    return submitted;
+}
+
+Boolean AudioAnalyser32_collectMatchOpenCL(AudioAnalyser32 *self,
+                                           size_t *bestTriangleBandMatches)
+{
+    if (OpenCLBatchDTW_collect(self->openclBatch, self->openclBestMatches, self->openclSimilarityScores) == false) {
+        
+        return false;
+    }
+    
+    AudioAnalyser32_storeMatchesOpenCL(self, bestTriangleBandMatches);
+    
+    return true;
+}
+
+void AudioAnalyser32_findMatchFastDTW(AudioAnalyser32 *self,
+                                      Matrix32 **triangleMagnitudeBands,
+                                      size_t *bestTriangleBandMatches)
 {
     for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
         
-        OpenCLDTW_process(self->openclDTWs[i], triangleMagnitudeBands[i]->data, self->openclSimilarityScores);
-        Float32 minimum = 0;
-        size_t index = 0;
-        vDSP_minvi(self->openclSimilarityScores, 1, &minimum, &index, self->openclDTWs[0]->globalWorkSize);
+        Matrix32 *analysis = triangleMagnitudeBands[i];
+        Matrix32 *palette = self->paletteComparisonData[i];
+        size_t candidateCount;
+        
+        if (self->useBeats == true) {
+            
+            candidateCount = self->paletteBeats->columnCount;
+        }
+        else {
+            
+            candidateCount = palette->rowCount > analysis->rowCount ? (palette->rowCount - 1) / analysis->rowCount : 0;
+        }
+        
+        Float32 bestExactScore = INFINITY;
+        size_t bestExactCandidate = 0;
+        
+        MatchHeap32_clear(self->bandMatches[i]);
+        
+        for (size_t candidate = 0; candidate < candidateCount; ++candidate) {
+            
+            size_t start = candidate * analysis->rowCount;
+            size_t length = analysis->rowCount;
+            
+            if (self->useBeats == true) {
+                
+                start = (size_t)Matrix_getRow(self->paletteBeats, 0)[candidate];
+                length = (size_t)Matrix_getRow(self->paletteBeats, 1)[candidate];
+                
+                start = start < palette->rowCount - 1 ? start : palette->rowCount - 1;
+                length = length > 0 ? length : 1;
+                length = start + length <= palette->rowCount ? length : palette->rowCount - start;
+            }
+            
+            Float32 score = FastDTW32_getSimilarityScore(self->fastDTW,
+                                                         analysis->data,
+                                                         analysis->rowCount,
+                                                         Matrix_getRow(palette, start),
+                                                         length,
+                                                         analysis->columnCount);
+            
+            MatchHeap32_insert(self->bandMatches[i], self->useBeats == true ? candidate : start, score);
+            
+            if (self->reportFastDTW == true) {
+                
+                AudioAnalyser32_FastDTWReport *report = &self->fastDTWReport;
+                
+                Float32 exactScore = DTW32_getSimilarityScoreOnly(self->exactDTW,
+                                                                  analysis->data,
+                                                                  analysis->rowCount,
+                                                                  Matrix_getRow(palette, start),
+                                                                  length,
+                                                                  analysis->columnCount,
+                                                                  INFINITY);
+                
+                Float32 relativeError = exactScore > 0 ? (score - exactScore) / exactScore : 0;
+                
+                report->candidateCount++;
+                report->meanRelativeError += (relativeError - report->meanRelativeError) / (Float32)report->candidateCount;
+                report->maximumRelativeError = relativeError > report->maximumRelativeError ? relativeError : report->maximumRelativeError;
+                report->searchedCellCount += self->fastDTW->searchedCellCount;
+                report->exactCellCount += analysis->rowCount * length;
+                
+                if (exactScore < bestExactScore) {
+                    
+                    bestExactScore = exactScore;
+                    bestExactCandidate = candidate;
+                }
+            }
+        }
         
-        bestTriangleBandMatches[i] = index;
+        bestTriangleBandMatches[i] = MatchHeap32_getBest(self->bandMatches[i], NULL);
+        
+        if (self->reportFastDTW == true) {
+            
+            size_t bestCandidate = self->useBeats == true ? bestTriangleBandMatches[i] : bestTriangleBandMatches[i] / analysis->rowCount;
+            self->fastDTWReport.searchCount++;
+            self->fastDTWReport.bestMatchAgreementCount += bestCandidate == bestExactCandidate ? 1 : 0;
+        }
     }
+}
+
+void AudioAnalyser32_printFastDTWReport(AudioAnalyser32 *self)
+{
+    AudioAnalyser32_FastDTWReport report = self->fastDTWReport;
     
-    printf("match index = %zd\n", bestTriangleBandMatches[0]);
+    printf("FastDTW searches = %zd, best match agreement = %zd, candidates = %zd, mean relative error = %.4f, maximum relative error = %.4f, cells searched = %zd of %zd\n",
+           report.searchCount,
+           report.bestMatchAgreementCount,
+           report.candidateCount,
+           report.meanRelativeError,
+           report.maximumRelativeError,
+           report.searchedCellCount,
+           report.exactCellCount);
+}
+
+void AudioAnalyser32_printDTWWorkspace(AudioAnalyser32 *self)
+{
+    DTWWorkspacePool32_print(self->workspacePool);
+}
+
+void AudioAnalyser32_advanceIncrementalMatch(AudioAnalyser32 *self,
+                                             Matrix32 **triangleMagnitudeBands,
+                                             size_t rowIndex)
+{
+    for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
+        
+        IncrementalDTW32_advance(self->incrementalDTWs[i], Matrix_getRow(triangleMagnitudeBands[i], rowIndex));
+    }
+}
+
+void AudioAnalyser32_findMatchIncremental(AudioAnalyser32 *self,
+                                          Matrix32 **triangleMagnitudeBands,
+                                          size_t *bestTriangleBandMatches,
+                                          Matrix32 *warpFrameTimesInSeconds)
+{
+    for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
+        
+        IncrementalDTW32 *incrementalDTW = self->incrementalDTWs[i];
+        
+        if (incrementalDTW->candidateCount > 0) {
+            
+            size_t candidate = IncrementalDTW32_getBestCandidate(incrementalDTW, NULL);
+            
+            if (self->useBeats == true) {
+                
+                bestTriangleBandMatches[i] = candidate;
+            }
+            else {
+                
+                bestTriangleBandMatches[i] = incrementalDTW->candidateStarts[candidate];
+            }
+            
+            DTW32_getSimilarityScore(self->magnitudesDTW,
+                                     triangleMagnitudeBands[i]->data,
+                                     incrementalDTW->rowCount,
+                                     &incrementalDTW->paletteData[incrementalDTW->candidateStarts[candidate] * incrementalDTW->columnCount],
+                                     incrementalDTW->candidateLengths[candidate],
+                                     incrementalDTW->columnCount);
+            
+            DTW32_traceWarpPath(self->magnitudesDTW, self->warpPath);
+            
+            vDSP_vgathr(self->frameTimesInSeconds, self->warpPath, 1, Matrix_getRow(warpFrameTimesInSeconds, i), 1, incrementalDTW->rowCount);
+        }
+        
+        IncrementalDTW32_reset(incrementalDTW);
+    }
 }
 
 void AudioAnalyser32_findMagnitudeDifferences(AudioAnalyser32 *self,
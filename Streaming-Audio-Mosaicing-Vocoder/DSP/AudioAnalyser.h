@@ -16,12 +16,69 @@
 #import "AudioAnalysisQueue.h"
 #import "AudioObject.h"
 #import "OpenCLDTW.h"
+#import "OpenCLBatchDTW.h"
+#import "IncrementalDTW.h"
+#import "DTWKernels.h"
+#import "FastDTW.h"
+#import "MatchHeap.h"
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
     
+    /*!
+     @abstract Candidate counts summed over every band of the most recent <b>AudioAnalyser32_findBestTriangleBandMatches</b>, which resets them before the first band. Each call to <b>AudioAnalyser32_findBestMatch</b> or <b>AudioAnalyser32_findBestMatchLanes</b> adds its band's counts.
+     @var candidateCount
+     The number of palette windows considered.
+     @var kimPrunedCount
+     Windows rejected by the LB_Kim bound.
+     @var keoghPrunedCount
+     Windows rejected by the LB_Keogh bound.
+     @var abandonedCount
+     Windows whose dynamic time warping was abandoned part way through.
+     @var pruningRate
+     The fraction of windows over all the counted bands that did not need a complete dynamic time warping comparison.
+     */
+    typedef struct AudioAnalyser32_MatchStatistics
+    {
+        size_t candidateCount;
+        size_t kimPrunedCount;
+        size_t keoghPrunedCount;
+        size_t abandonedCount;
+        Float32 pruningRate;
+        
+    } AudioAnalyser32_MatchStatistics;
+    
+    /*!
+     @abstract How closely the FastDTW searches track exact dynamic time warping, accumulated since <b>AudioAnalyser32_setFastDTW</b> when reporting is enabled.
+     @var searchCount
+     The number of band searches compared.
+     @var candidateCount
+     The number of candidates scored both ways.
+     @var bestMatchAgreementCount
+     The searches where both scores chose the same candidate.
+     @var meanRelativeError
+     The mean of (approximate - exact) / exact over the candidates.
+     @var maximumRelativeError
+     The largest relative error of a candidate.
+     @var searchedCellCount
+     The cells accumulated by the approximate comparisons over every level.
+     @var exactCellCount
+     The cells the exact comparisons accumulated.
+     */
+    typedef struct AudioAnalyser32_FastDTWReport
+    {
+        size_t searchCount;
+        size_t candidateCount;
+        size_t bestMatchAgreementCount;
+        Float32 meanRelativeError;
+        Float32 maximumRelativeError;
+        size_t searchedCellCount;
+        size_t exactCellCount;
+        
+    } AudioAnalyser32_FastDTWReport;
+    
     /*!
      @class AudioAnalyser32
      @abstract A pseudoclass for performing analysis on AudioObjects and streaming frames of audio data
@@ -49,6 +106,76 @@ extern "C"
      A pointer to a Float32 buffer of <i>mfcc->ceptralCoefficients</i> in length which is used to temporarily store mel-frequency cepstral coefficients during analysis.
      @var chromagramBuffer
      A pointer to a Float32 buffer of <i>chromagram->nchr</i> in length which is used to temporarily store chromagrams during analysis.
+     @var paletteEnvelopes
+     Per band LB_Keogh upper envelopes of <i>paletteComparisonData</i>, calculated when the DTW is allocated.
+     @var matchStatistics
+     Pruning counts summed over the bands of the last best match search.
+     @var constraint
+     The global path constraint used by the DTW comparisons, set with <b>AudioAnalyser32_setDTWConstraint</b>.
+     @var constraintParameter
+     The Sakoe-Chiba radius or Itakura slope for <i>constraint</i>.
+     @var useSubsequence
+     Search the whole palette with subsequence DTW instead of comparing fixed windows, set with <b>AudioAnalyser32_setSubsequenceSearch</b>.
+     @var subsequenceMatches
+     The start, end and score of the best span for each band from the last subsequence search.
+     @var useIncremental
+     Advance the matching one analysis frame per hop, set with <b>AudioAnalyser32_setIncrementalMatching</b>.
+     @var useBeats
+     Whether the palette candidates are beats rather than fixed windows.
+     @var incrementalDTWs
+     One <b>IncrementalDTW32</b> pseudoclass per band, only allocated when <i>useIncremental</i> is true.
+     @var useNormalisedDistances
+     Calculate the CPU search distances from unit length copies of the palette, set with <b>AudioAnalyser32_setNormalisedDistances</b>.
+     @var normalisedPaletteComparisonData
+     The unit length copies of <i>paletteComparisonData</i> kept by the palette <b>AudioAnalysisData32</b>, only built when <i>useNormalisedDistances</i>, <i>useScoreKernels</i> or <i>useCandidateLanes</i> is true.
+     @var normalisedAnalysis
+     A unit length copy of the segment being matched.
+     @var paletteNorms
+     The row norms of <i>paletteComparisonData</i> kept by the palette <b>AudioAnalysisData32</b>, NULL when a path constraint is set or the palette windows are not searched one at a time.
+     @var analysisNorms
+     The row norms of the segment being matched.
+     @var paletteDistanceMatrix
+     Cosine distances between the segment being matched and a whole palette band, segment row count * palette row count, allocated alongside <i>paletteNorms</i> or when <i>useNormalisedDistances</i> is true.
+     @var useScoreKernels
+     Score the palette windows with the kernels specialised for their size, set with <b>AudioAnalyser32_setScoreKernels</b>.
+     @var scoreKernels
+     Per band, the <b>DTW32_ScoreKernel</b> specialised for the segment row count and band column count, or NULL where there is none, a path constraint is set or <i>useScoreKernels</i> is false.
+     @var useParallelDTW
+     Accumulate the traced comparisons of long segments on several threads, set with <b>AudioAnalyser32_setParallelDTW</b>.
+     @var dtwThreadCount
+     The thread count passed to <b>DTW32_setParallelAccumulation</b>, 0 for one per processor.
+     @var parallelCellThreshold
+     The cell count above which a traced comparison uses the threads.
+     @var paletteBeats
+     The beat starts and lengths of the palette, not owned.
+     @var fastDTW
+     The <b>FastDTW32</b> pseudoclass used by <b>AudioAnalyser32_findMatchFastDTW</b>, allocated by <b>AudioAnalyser32_setFastDTW</b>.
+     @var reportFastDTW
+     Whether every candidate is also scored exactly for <i>fastDTWReport</i>.
+     @var exactDTW
+     The <b>DTW32</b> pseudoclass for the exact scores, only allocated when <i>reportFastDTW</i> is true.
+     @var fastDTWReport
+     The accuracy of the FastDTW searches.
+     @var matchCount
+     The number of best matches kept per band, set with <b>AudioAnalyser32_setMatchCount</b>, 0 or 1 keeps only the best.
+     @var bandMatches
+     Per band, the <i>matchCount</i> best (index, score) pairs of the last search in the same form as the best match it returns.
+     @var useCandidateLanes
+     Compare the palette windows in groups of DTW32_CANDIDATE_LANE_COUNT, set with <b>AudioAnalyser32_setCandidateLanes</b>.
+     @var paletteCandidateLanes
+     Per band, the unit length palette windows transposed with <b>DTW32_transposeCandidateLanes</b>, only allocated when <i>useCandidateLanes</i> is true.
+     @var openclBatch
+     The <b>OpenCLBatchDTW</b> searching every band's palette in one launch for <b>AudioAnalyser32_findMatchOpenCL</b>.
+     @var openclSimilarityScores
+     The best score of each band, or every candidate's score band by band when <i>matchCount</i> is above 1.
+     @var openclBestMatches
+     The best candidate of each band as reduced on the device.
+     @var useAsynchronousOpenCL
+     Submit the OpenCL searches and collect them later instead of waiting, set with <b>AudioAnalyser32_setAsynchronousOpenCL</b>.
+     @var openclSkippedSearches
+     The number of asynchronous searches not submitted because every slot of <i>openclBatch</i> was still in flight.
+     @var workspacePool
+     The <b>DTWWorkspacePool32</b> the <b>DTW32</b> pseudoclasses of every band and search acquire their buffers from.
      */
     
     typedef struct AudioAnalyser32
@@ -67,14 +194,47 @@ extern "C"
         Float32 *frameTimesInSeconds;
         size_t currentSegmentSize;
         Boolean dtwAllocated;
-        OpenCLDTW **openclDTWs;
+        OpenCLBatchDTW *openclBatch;
         Float32 *openclSimilarityScores;
+        size_t *openclBestMatches;
+        Boolean useAsynchronousOpenCL;
+        size_t openclSkippedSearches;
         Float32 *frameBuffer;
         Float32 *mfccBuffer;
         Float32 *chromagramBuffer;
         Float32 *previousTriangleMagnitudes;
         Matrix32 **paletteComparisonData;
-
+        Matrix32 **paletteEnvelopes;
+        Boolean useFlux;
+        AudioAnalyser32_MatchStatistics matchStatistics;
+        DTWConstraint constraint;
+        Float32 constraintParameter;
+        Boolean useSubsequence;
+        DTW32_SubsequenceMatch *subsequenceMatches;
+        Boolean useIncremental;
+        Boolean useBeats;
+        IncrementalDTW32 **incrementalDTWs;
+        Boolean useNormalisedDistances;
+        Matrix32 **normalisedPaletteComparisonData;
+        Matrix32 *normalisedAnalysis;
+        Float32 **paletteNorms;
+        Float32 *analysisNorms;
+        Float32 *paletteDistanceMatrix;
+        Boolean useScoreKernels;
+        DTW32_ScoreKernel *scoreKernels;
+        Matrix32 *paletteBeats;
+        FastDTW32 *fastDTW;
+        Boolean reportFastDTW;
+        DTW32 *exactDTW;
+        AudioAnalyser32_FastDTWReport fastDTWReport;
+        size_t matchCount;
+        MatchHeap32 **bandMatches;
+        Boolean useParallelDTW;
+        size_t dtwThreadCount;
+        size_t parallelCellThreshold;
+        Boolean useCandidateLanes;
+        Float32 **paletteCandidateLanes;
+        DTWWorkspacePool32 *workspacePool;
         
     } AudioAnalyser32;
     
@@ -113,6 +273,107 @@ extern "C"
                                      Boolean useBeats,
                                      Boolean useFlux);
     
+    /*!
+     @abstract Restrict the DTW comparisons to a Sakoe-Chiba band or Itakura parallelogram.
+     @param constraint
+     The path constraint, kDTWConstraint_None compares every cell.
+     @param constraintParameter
+     The Sakoe-Chiba radius in frames or the Itakura slope.
+     @discussion
+     This must be called before <b>AudioAnalyser32_allocateDTW</b>.
+     */
+    
+    void AudioAnalyser32_setDTWConstraint(AudioAnalyser32 *self,
+                                          DTWConstraint constraint,
+                                          Float32 constraintParameter);
+    
+    /*!
+     @abstract Match against any palette span instead of windows at multiples of the segment row count.
+     @discussion
+     This must be called before <b>AudioAnalyser32_allocateDTW</b>. The spans found are left in <i>subsequenceMatches</i>, their warp paths are traced from the choices recorded during the search, so spans of any length up to the palette's are followed to their end.
+     */
+    
+    void AudioAnalyser32_setSubsequenceSearch(AudioAnalyser32 *self,
+                                              Boolean useSubsequence);
+    
+    /*!
+     @abstract Spread the palette search over the hops of a segment instead of running it when the analysis queue wraps.
+     @discussion
+     This must be called before <b>AudioAnalyser32_allocateDTW</b>, which exits if a path constraint is also set. Each analysed frame is passed to <b>AudioAnalyser32_advanceIncrementalMatch</b> and the matches are collected with <b>AudioAnalyser32_findMatchIncremental</b> when the queue wraps.
+     */
+    
+    void AudioAnalyser32_setIncrementalMatching(AudioAnalyser32 *self,
+                                                Boolean useIncremental);
+    
+    /*!
+     @abstract Accumulate single comparisons of more than cellThreshold cells on threadCount threads, for long beat segments where one alignment dominates a search.
+     @discussion
+     This must be called before <b>AudioAnalyser32_allocateDTW</b>, and is ignored when a path constraint is set.
+     */
+    
+    void AudioAnalyser32_setParallelDTW(AudioAnalyser32 *self,
+                                        size_t threadCount,
+                                        size_t cellThreshold);
+    
+    /*!
+     @abstract Allocate the approximate multi-resolution search used by <b>AudioAnalyser32_findMatchFastDTW</b>.
+     @param radius
+     The accuracy/speed knob, the number of cells either side of the projected path searched at each resolution.
+     @param reportAccuracy
+     Also score every candidate with exact dynamic time warping and accumulate the differences in <i>fastDTWReport</i>, for judging a radius rather than for performance.
+     @discussion
+     This must be called after <b>AudioAnalyser32_allocateDTW</b>, as the comparisons are sized for the longest palette candidate.
+     */
+    
+    void AudioAnalyser32_setFastDTW(AudioAnalyser32 *self,
+                                    size_t radius,
+                                    Boolean reportAccuracy);
+    
+    /*!
+     @abstract Keep the matchCount best candidates of each band in <i>bandMatches</i> instead of only the best, so the choice can take continuity or repetition into account without searching again.
+     @discussion
+     This must be called before <b>AudioAnalyser32_allocateDTW</b>. The CPU searches prune and abandon against the worst kept score, so a larger count prunes less.
+     */
+    
+    void AudioAnalyser32_setMatchCount(AudioAnalyser32 *self,
+                                       size_t matchCount);
+    
+    /*!
+     @abstract Compare the palette windows several at a time, one window per vector lane, instead of one after another.
+     @discussion
+     This must be called before <b>AudioAnalyser32_allocateDTW</b>. The windows of each band are transposed once when the DTW is allocated, taking the same memory again as the palette.
+     */
+    
+    void AudioAnalyser32_setCandidateLanes(AudioAnalyser32 *self,
+                                           Boolean useCandidateLanes);
+    
+    /*!
+     @abstract Calculate the distances of <b>AudioAnalyser32_findBestTriangleBandMatches</b> from unit length copies of the palette as 1 - dot, one matrix multiplication per band, instead of dividing by the row norms.
+     @discussion
+     This must be called before <b>AudioAnalyser32_allocateDTW</b>, which builds the unit length copy of the palette only when this, <b>AudioAnalyser32_setScoreKernels</b> or <b>AudioAnalyser32_setCandidateLanes</b> asks for it.
+     */
+    
+    void AudioAnalyser32_setNormalisedDistances(AudioAnalyser32 *self,
+                                                Boolean useNormalisedDistances);
+    
+    /*!
+     @abstract Score the palette windows of <b>AudioAnalyser32_findBestTriangleBandMatches</b> with the <b>DTW32_ScoreKernel</b> specialised for the segment row count and each band's column count, so only the windows that survive the lower bounds have their distances calculated.
+     @discussion
+     This must be called before <b>AudioAnalyser32_allocateDTW</b>, which looks the kernels up and builds the unit length copy of the palette they read. Bands without a kernel, and every band when a path constraint is set, are searched as without this.
+     */
+    
+    void AudioAnalyser32_setScoreKernels(AudioAnalyser32 *self,
+                                         Boolean useScoreKernels);
+    
+    /*!
+     @abstract Match with <b>AudioAnalyser32_submitMatchOpenCL</b> and <b>AudioAnalyser32_collectMatchOpenCL</b>, which never wait on the device, instead of <b>AudioAnalyser32_findMatchOpenCL</b>.
+     @discussion
+     This must be called before <b>AudioAnalyser32_allocateDTW</b>. A segment's matches are collected at the earliest when the next segment is submitted, so they arrive a segment late.
+     */
+    
+    void AudioAnalyser32_setAsynchronousOpenCL(AudioAnalyser32 *self,
+                                               Boolean useAsynchronousOpenCL);
+    
     
     /*!
      @functiongroup Audio analysis
@@ -164,13 +425,75 @@ extern "C"
      @param analysisData
      A pointer to an <b>AudioAnalysisData32</b> pseudoclass
      @discussion
-     This pseudoclass compares the high level features in the <b>AudioAnalysisQueue32</b> pseudoclass with those in an <b>AudioAnalysisData32</b> pseudoclass using dynamic time warping.
+     This pseudoclass compares the high level features in the <b>AudioAnalysisQueue32</b> pseudoclass with those in an <b>AudioAnalysisData32</b> pseudoclass using dynamic time warping. Palette windows are first tested against the LB_Kim and LB_Keogh lower bounds and the remaining comparisons are scored with two rows, over slices of one shared distance matrix when unconstrained, and abandoned once they can no longer beat the worst of the kept matches, only the winning window is compared again with a traceback. The counts are added to <i>matchStatistics</i>.
+     @param paletteEnvelope
+     The upper envelope of <i>paletteData</i> from <i>paletteEnvelopes</i>, or NULL to skip the LB_Keogh test.
+     @param paletteNorms
+     The row norms of <i>paletteData</i> from <i>paletteNorms</i>. The cosine distances to the whole palette are then calculated with one matrix multiplication and each window is compared over a slice of them, with NULL each window calculates its own distances.
+     @param normalisedPaletteData
+     The unit length copy of <i>paletteData</i> from <i>normalisedPaletteComparisonData</i>, used in place of <i>paletteNorms</i> so the distances are 1 - dot, may be NULL.
+     @param scoreKernel
+     The specialised kernel for the band from <i>scoreKernels</i>, used on <i>normalisedPaletteData</i> in place of the matrix multiplication so only the windows that survive the bounds have their distances calculated. NULL to use the general comparisons.
+     @param matches
+     Output, cleared and filled with the best windows, the worst kept score is the threshold for the bounds and abandoning.
      */
     size_t AudioAnalyser32_findBestMatch(AudioAnalyser32 *self,
                                          Matrix32 *analysisData,
                                          Matrix32 *paletteData,
+                                         Matrix32 *paletteEnvelope,
+                                         const Float32 *paletteNorms,
+                                         Matrix32 *normalisedPaletteData,
+                                         DTW32_ScoreKernel scoreKernel,
+                                         MatchHeap32 *matches,
                                          Float32 *warpFrameTimesInSeconds);
     
+    /*!
+     @abstract Find the best palette window like <b>AudioAnalyser32_findBestMatch</b>, scoring groups of DTW32_CANDIDATE_LANE_COUNT windows in lockstep with <b>DTW32_getSimilarityScoresLanes</b>.
+     @param candidateLanes
+     The transposed windows of the band from <i>paletteCandidateLanes</i>.
+     @param matches
+     Output, as for <b>AudioAnalyser32_findBestMatch</b>.
+     @discussion
+     A group is skipped when the LB_Kim bound of every window in it reaches the best score, and abandoned once every window in it has, these are counted per window and added to <i>matchStatistics</i>.
+     */
+    size_t AudioAnalyser32_findBestMatchLanes(AudioAnalyser32 *self,
+                                              Matrix32 *analysisData,
+                                              Matrix32 *paletteData,
+                                              const Float32 *candidateLanes,
+                                              MatchHeap32 *matches,
+                                              Float32 *warpFrameTimesInSeconds);
+    
+    void AudioAnalyser32_printMatchStatistics(AudioAnalyser32 *self);
+    
+    /*!
+     @abstract Find the best palette candidate of each band with <b>FastDTW32_getSimilarityScore</b>, beats when the DTW was allocated for beats and fixed windows otherwise.
+     @param bestTriangleBandMatches
+     Output, the beat index or the first palette row of each band's best candidate, as <b>AudioAnalyser32_findMatchOpenCL</b>.
+     */
+    void AudioAnalyser32_findMatchFastDTW(AudioAnalyser32 *self,
+                                          Matrix32 **triangleMagnitudeBands,
+                                          size_t *bestTriangleBandMatches);
+    
+    void AudioAnalyser32_printFastDTWReport(AudioAnalyser32 *self);
+    
+    /*!
+     @abstract Print the current and peak bytes of the DTW workspace by buffer role.
+     */
+    void AudioAnalyser32_printDTWWorkspace(AudioAnalyser32 *self);
+    
+    /*!
+     @abstract Find the best aligned palette span starting at any row with a single subsequence DTW pass.
+     @param subsequenceMatch
+     Output, the start, end and score of the span.
+     @return
+     The first palette row of the span.
+     */
+    size_t AudioAnalyser32_findBestSubsequence(AudioAnalyser32 *self,
+                                               Matrix32 *analysisData,
+                                               Matrix32 *paletteData,
+                                               DTW32_SubsequenceMatch *subsequenceMatch,
+                                               Float32 *warpFrameTimesInSeconds);
+    
     void AudioAnalyser32_findBestTriangleBandMatches(AudioAnalyser32 *self,
                                                      AudioAnalysisQueue32 *analysisQueue,
                                                      AudioAnalysisData32 *paletteData,
@@ -183,10 +506,56 @@ extern "C"
                                                                 Matrix32 **triangleMagnitudeBands,
                                                                 size_t rowIndex);
     
-    void AudioAnalyser32_findMatchOpenCL(AudioAnalyser32 *self,
-                                         Matrix32 **triangleMagnitudeBands,
-                                         Float32 *warpFrameTimesInSeconds,
-                                         size_t *bestTriangleBandMatches);
+    /*!
+     @abstract Search every band's palette on the device and wait for the result.
+     @return
+     False, with <i>bestTriangleBandMatches</i> untouched, when the device failed the search, which is counted in the <i>failedSearchCount</i> of <i>openclBatch</i>.
+     */
+    Boolean AudioAnalyser32_findMatchOpenCL(AudioAnalyser32 *self,
+                                            Matrix32 **triangleMagnitudeBands,
+                                            Float32 *warpFrameTimesInSeconds,
+                                            size_t *bestTriangleBandMatches);
+    
+    /*!
+     @abstract Enqueue the OpenCL search of a segment and return without waiting for the device.
+     @return
+     False when the searches of the two previous segments are both still in flight, the segment is then skipped and counted in <i>openclSkippedSearches</i>.
+     */
+    Boolean AudioAnalyser32_submitMatchOpenCL(AudioAnalyser32 *self,
+                                              Matrix32 **triangleMagnitudeBands);
+    
+    /*!
+     @abstract Collect the oldest submitted search if the device has finished it, without waiting.
+     @param bestTriangleBandMatches
+     Output, as <b>AudioAnalyser32_findMatchOpenCL</b>, left untouched when nothing was collected.
+     @return
+     True when a search was collected and <i>bandMatches</i> updated. A search the device failed is dropped without touching either, and counted in the <i>failedSearchCount</i> of <i>openclBatch</i>.
+     */
+    Boolean AudioAnalyser32_collectMatchOpenCL(AudioAnalyser32 *self,
+                                               size_t *bestTriangleBandMatches);
+    
+    /*!
+     @abstract Accumulate one analysis frame of each band against every palette candidate.
+     @param rowIndex
+     The queue row of the frame that was just analysed.
+     */
+    void AudioAnalyser32_advanceIncrementalMatch(AudioAnalyser32 *self,
+                                                 Matrix32 **triangleMagnitudeBands,
+                                                 size_t rowIndex);
+    
+    /*!
+     @abstract Collect the best candidate of each band once a whole segment has been accumulated and start the next segment. The incremental accumulation keeps no traceback, so each band's winner is compared once more with <i>magnitudesDTW</i> to trace its warp path.
+     @param triangleMagnitudeBands
+     The analysed segment of each band, in the order its frames were advanced.
+     @param bestTriangleBandMatches
+     Output, the palette row of each band's match, or the beat index when using beats as with <b>AudioAnalyser32_findMatchOpenCL</b>. A band whose palette holds no candidate keeps its previous match.
+     @param warpFrameTimesInSeconds
+     Output, for each band the palette time of every analysis frame along the match's warp path.
+     */
+    void AudioAnalyser32_findMatchIncremental(AudioAnalyser32 *self,
+                                              Matrix32 **triangleMagnitudeBands,
+                                              size_t *bestTriangleBandMatches,
+                                              Matrix32 *warpFrameTimesInSeconds);
     
     void AudioAnalyser32_findMagnitudeDifferences(AudioAnalyser32 *self,
                                                   Matrix32 **analysisTriangleMagnitudeBands,
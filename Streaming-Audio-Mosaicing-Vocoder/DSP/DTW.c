@@ -10,51 +10,375 @@
 #import "DTW.h"
 #import <stdio.h>
 #import <stdlib.h>
+#import <string.h>
+#import <assert.h>
+#import <pthread.h>
+#import <sched.h>
+#import <unistd.h>
 #import <Accelerate/Accelerate.h>
 #import "ConvenienceFunctions.h"
 
-DTW32 *DTW32_new(size_t rowCount, size_t maximumColumnCount)
+#if defined(__x86_64__) || defined(__i386__)
+#import <immintrin.h>
+#define DTW32_HAS_AVX2_KERNEL 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#import <arm_neon.h>
+#define DTW32_HAS_NEON_KERNEL 1
+#endif
+
+static void DTW32_selectDiagonalScalar(const Float32 *diagonal,
+                                       const Float32 *up,
+                                       const Float32 *left,
+                                       const Float32 *distances,
+                                       Float32 *result,
+                                       Float32 *traceback,
+                                       size_t count)
 {
-    DTW32 *self = calloc(1, sizeof(DTW32));
+    for (size_t i = 0; i < count; ++i) {
+        
+        Float32 best = diagonal[i];
+        Float32 index = 1;
+        
+        index = up[i] < best ? 2 : index;
+        best = up[i] < best ? up[i] : best;
+        
+        index = left[i] < best ? 3 : index;
+        best = left[i] < best ? left[i] : best;
+        
+        result[i] = distances[i] + best;
+        traceback[i] = index;
+    }
+}
+
+#ifdef DTW32_HAS_AVX2_KERNEL
+__attribute__((target("avx2")))
+static void DTW32_selectDiagonalAVX2(const Float32 *diagonal,
+                                     const Float32 *up,
+                                     const Float32 *left,
+                                     const Float32 *distances,
+                                     Float32 *result,
+                                     Float32 *traceback,
+                                     size_t count)
+{
+    const __m256 two = _mm256_set1_ps(2.f);
+    const __m256 three = _mm256_set1_ps(3.f);
+    size_t i = 0;
+    
+    for (; i + 8 <= count; i += 8) {
+        
+        __m256 best = _mm256_loadu_ps(&diagonal[i]);
+        __m256 index = _mm256_set1_ps(1.f);
+        
+        __m256 candidate = _mm256_loadu_ps(&up[i]);
+        __m256 mask = _mm256_cmp_ps(candidate, best, _CMP_LT_OQ);
+        best = _mm256_blendv_ps(best, candidate, mask);
+        index = _mm256_blendv_ps(index, two, mask);
+        
+        candidate = _mm256_loadu_ps(&left[i]);
+        mask = _mm256_cmp_ps(candidate, best, _CMP_LT_OQ);
+        best = _mm256_blendv_ps(best, candidate, mask);
+        index = _mm256_blendv_ps(index, three, mask);
+        
+        _mm256_storeu_ps(&result[i], _mm256_add_ps(_mm256_loadu_ps(&distances[i]), best));
+        _mm256_storeu_ps(&traceback[i], index);
+    }
+    
+    DTW32_selectDiagonalScalar(&diagonal[i], &up[i], &left[i], &distances[i], &result[i], &traceback[i], count - i);
+}
+#endif
+
+#ifdef DTW32_HAS_NEON_KERNEL
+static void DTW32_selectDiagonalNEON(const Float32 *diagonal,
+                                     const Float32 *up,
+                                     const Float32 *left,
+                                     const Float32 *distances,
+                                     Float32 *result,
+                                     Float32 *traceback,
+                                     size_t count)
+{
+    const float32x4_t two = vdupq_n_f32(2.f);
+    const float32x4_t three = vdupq_n_f32(3.f);
+    size_t i = 0;
     
-    if (rowCount < maximumColumnCount) {
+    for (; i + 4 <= count; i += 4) {
         
-        rowCount = maximumColumnCount;
+        float32x4_t best = vld1q_f32(&diagonal[i]);
+        float32x4_t index = vdupq_n_f32(1.f);
+        
+        float32x4_t candidate = vld1q_f32(&up[i]);
+        uint32x4_t mask = vcltq_f32(candidate, best);
+        best = vbslq_f32(mask, candidate, best);
+        index = vbslq_f32(mask, two, index);
+        
+        candidate = vld1q_f32(&left[i]);
+        mask = vcltq_f32(candidate, best);
+        best = vbslq_f32(mask, candidate, best);
+        index = vbslq_f32(mask, three, index);
+        
+        vst1q_f32(&result[i], vaddq_f32(vld1q_f32(&distances[i]), best));
+        vst1q_f32(&traceback[i], index);
     }
     
+    DTW32_selectDiagonalScalar(&diagonal[i], &up[i], &left[i], &distances[i], &result[i], &traceback[i], count - i);
+}
+#endif
+
+static DTW32_SelectFunction DTW32_chooseSelectFunction(void)
+{
+#ifdef DTW32_HAS_AVX2_KERNEL
+    if (__builtin_cpu_supports("avx2")) {
+        
+        return DTW32_selectDiagonalAVX2;
+    }
+#endif
+#ifdef DTW32_HAS_NEON_KERNEL
+    return DTW32_selectDiagonalNEON;
+#endif
+    return DTW32_selectDiagonalScalar;
+}
+
+/*
+ Traceback choices 1, 2 and 3 are packed four cells to a byte, cell n in bits 2(n % 4) and 2(n % 4) + 1.
+ */
+static inline size_t DTW32_packedTracebackSize(size_t elementCount)
+{
+    return (elementCount + 3) / 4;
+}
+
+static inline void DTW32_setTraceback(UInt8 *traceback, size_t index, UInt8 choice)
+{
+    const UInt8 shift = (UInt8)((index & 3) << 1);
+    traceback[index >> 2] = (UInt8)((traceback[index >> 2] & ~(3 << shift)) | (choice << shift));
+}
+
+/*
+ For blocks accumulated on different threads, whose first and last cells in a row can share a byte.
+ */
+static inline void DTW32_setTracebackShared(UInt8 *traceback, size_t index, UInt8 choice)
+{
+    const UInt8 shift = (UInt8)((index & 3) << 1);
+    __atomic_fetch_and(&traceback[index >> 2], (UInt8)~(3 << shift), __ATOMIC_RELAXED);
+    __atomic_fetch_or(&traceback[index >> 2], (UInt8)(choice << shift), __ATOMIC_RELAXED);
+}
+
+static inline UInt8 DTW32_getTraceback(const UInt8 *traceback, size_t index)
+{
+    return (traceback[index >> 2] >> ((index & 3) << 1)) & 3;
+}
+
+static inline void *DTW32_acquire(DTW32 *self,
+                                  DTWWorkspaceRole role,
+                                  size_t count,
+                                  size_t size)
+{
+    return DTWWorkspacePool32_acquire(self->workspacePool, role, count * size);
+}
+
+/*
+ The comparison matrices are the only buffers that grow with rowCount squared. They are acquired when the
+ pseudoclass is constructed so no comparison on the audio thread waits on the pool, and only acquired
+ again by a full comparison after DTW32_releaseMatrices.
+ */
+static void DTW32_acquireMatrices(DTW32 *self)
+{
+    if (self->constraint == kDTWConstraint_None) {
+        
+        self->globalDistanceMatrix = DTW32_acquire(self, kDTWWorkspaceRole_GlobalDistances, (self->maximumRowCount + 1) * (self->maximumRowCount + 1), sizeof(Float32));
+        self->phi = DTW32_acquire(self, kDTWWorkspaceRole_Traceback, DTW32_packedTracebackSize(self->maximumElementCount), sizeof(UInt8));
+    }
+    else {
+        
+        self->bandGlobalDistances = DTW32_acquire(self, kDTWWorkspaceRole_GlobalDistances, self->maximumElementCount, sizeof(Float32));
+        self->bandPhi = DTW32_acquire(self, kDTWWorkspaceRole_Traceback, DTW32_packedTracebackSize(self->maximumElementCount), sizeof(UInt8));
+    }
+}
+
+void DTW32_releaseMatrices(DTW32 *self)
+{
+    DTWWorkspacePool32_release(self->workspacePool, self->globalDistanceMatrix);
+    DTWWorkspacePool32_release(self->workspacePool, self->phi);
+    DTWWorkspacePool32_release(self->workspacePool, self->bandGlobalDistances);
+    DTWWorkspacePool32_release(self->workspacePool, self->bandPhi);
+    
+    self->globalDistanceMatrix = NULL;
+    self->phi = NULL;
+    self->bandGlobalDistances = NULL;
+    self->bandPhi = NULL;
+    self->currentInputRowCount = 0;
+    self->currentComparisonDataRowCount = 0;
+}
+
+static DTW32 *DTW32_allocate(size_t rowCount,
+                             size_t maximumColumnCount,
+                             DTWWorkspacePool32 *workspacePool)
+{
+    DTW32 *self = calloc(1, sizeof(DTW32));
+    
     self->maximumRowCount = rowCount;
     self->maximumColumnCount = maximumColumnCount;
+    self->ownsWorkspacePool = workspacePool == NULL;
+    self->workspacePool = workspacePool != NULL ? workspacePool : DTWWorkspacePool32_new();
+    self->threadCount = 1;
+    
+    self->inputTemp = DTW32_acquire(self, kDTWWorkspaceRole_Norms, rowCount, sizeof(Float32));
+    self->comparisonDataTemp = DTW32_acquire(self, kDTWWorkspaceRole_Norms, rowCount, sizeof(Float32));
+    self->p = DTW32_acquire(self, kDTWWorkspaceRole_Path, 2 * rowCount, sizeof(Float32));
+    self->q = DTW32_acquire(self, kDTWWorkspaceRole_Path, 2 * rowCount, sizeof(Float32));
+    self->warpSegments = DTW32_acquire(self, kDTWWorkspaceRole_Path, 2 * rowCount, sizeof(DTW32_WarpSegment));
+    self->subsequenceStarts = DTW32_acquire(self, kDTWWorkspaceRole_Path, 2 * rowCount, sizeof(size_t));
+    self->scoreRows = DTW32_acquire(self, kDTWWorkspaceRole_ScoreRows, 3 * rowCount, sizeof(Float32));
+    self->laneRows = DTW32_acquire(self, kDTWWorkspaceRole_ScoreRows, 3 * rowCount * DTW32_CANDIDATE_LANE_COUNT, sizeof(Float32));
+    
+    return self;
+}
+
+DTW32 *DTW32_new(size_t rowCount, size_t maximumColumnCount)
+{
+    return DTW32_newWithPool(rowCount, maximumColumnCount, NULL);
+}
+
+DTW32 *DTW32_newWithPool(size_t rowCount,
+                         size_t maximumColumnCount,
+                         DTWWorkspacePool32 *workspacePool)
+{
+    DTW32 *self = DTW32_allocate(rowCount, maximumColumnCount, workspacePool);
+    
     self->maximumElementCount = rowCount * rowCount;
     
-    self->ones = calloc(self->maximumElementCount, sizeof(Float32));
-    Float32 one = 1;
-    vDSP_vfill(&one, self->ones, 1, self->maximumElementCount);
+    self->diagonalBuffers = DTW32_acquire(self, kDTWWorkspaceRole_Diagonals, 3 * (rowCount + 1), sizeof(Float32));
+    self->diagonalDistances = DTW32_acquire(self, kDTWWorkspaceRole_Diagonals, rowCount, sizeof(Float32));
+    self->diagonalTraceback = DTW32_acquire(self, kDTWWorkspaceRole_Diagonals, rowCount, sizeof(Float32));
+    self->selectDiagonal = DTW32_chooseSelectFunction();
+    self->tileBuffer = DTW32_acquire(self, kDTWWorkspaceRole_Tiles, (DTW32_TILE_SIZE + 1) * (DTW32_TILE_SIZE + 1), sizeof(Float32));
+    self->tileDiagonals = DTW32_acquire(self, kDTWWorkspaceRole_Tiles, 6 * DTW32_TILE_SIZE, sizeof(Float32));
+    
+    DTW32_acquireMatrices(self);
+    
+    return self;
+}
+
+static void DTW32_calculateBand(DTWConstraint constraint,
+                                Float32 constraintParameter,
+                                size_t inputRowCount,
+                                size_t comparisonDataRowCount,
+                                size_t *rowStarts,
+                                size_t *rowEnds)
+{
+    const Float32 lastColumn = (Float32)(comparisonDataRowCount - 1);
+    
+    for (size_t i = 0; i < inputRowCount; ++i) {
+        
+        Float32 first = 0, last = lastColumn;
+        
+        if (inputRowCount > 1) {
+            
+            Float32 x = (Float32)i / (Float32)(inputRowCount - 1);
+            
+            if (constraint == kDTWConstraint_SakoeChiba) {
+                
+                first = x * lastColumn - constraintParameter;
+                last = x * lastColumn + constraintParameter;
+            }
+            else if (constraint == kDTWConstraint_Itakura) {
+                
+                Float32 slope = constraintParameter;
+                first = fmaxf(x / slope, 1.f - (1.f - x) * slope) * lastColumn;
+                last = fminf(x * slope, 1.f - (1.f - x) / slope) * lastColumn;
+            }
+        }
+        
+        first = floorf(first);
+        last = ceilf(last);
+        rowStarts[i] = first > 0 ? (size_t)first : 0;
+        rowEnds[i] = last < lastColumn ? (size_t)last : comparisonDataRowCount - 1;
+    }
+    
+    for (size_t i = 1; i < inputRowCount; ++i) {
+        
+        if (rowStarts[i] > rowEnds[i - 1] + 1) {
+            
+            rowEnds[i - 1] = rowStarts[i] - 1;
+        }
+    }
+}
+
+DTW32 *DTW32_newConstrained(size_t rowCount,
+                            size_t maximumColumnCount,
+                            DTWConstraint constraint,
+                            Float32 constraintParameter)
+{
+    return DTW32_newConstrainedWithPool(rowCount, maximumColumnCount, constraint, constraintParameter, NULL);
+}
+
+DTW32 *DTW32_newConstrainedWithPool(size_t rowCount,
+                                    size_t maximumColumnCount,
+                                    DTWConstraint constraint,
+                                    Float32 constraintParameter,
+                                    DTWWorkspacePool32 *workspacePool)
+{
+    if (constraint == kDTWConstraint_None) {
+        
+        return DTW32_newWithPool(rowCount, maximumColumnCount, workspacePool);
+    }
+    
+    if (constraint == kDTWConstraint_Itakura && constraintParameter <= 1) {
+        
+        printf("DTW32_newConstrained, Itakura slope must be greater than 1, exiting\n");
+        exit(-1);
+    }
+    
+    DTW32 *self = DTW32_allocate(rowCount, maximumColumnCount, workspacePool);
+    
+    self->constraint = constraint;
+    self->constraintParameter = constraintParameter;
     
-    self->distanceMatrix = calloc(self->maximumElementCount, sizeof(Float32));
+    self->bandRowStarts = DTW32_acquire(self, kDTWWorkspaceRole_Band, rowCount, sizeof(size_t));
+    self->bandRowEnds = DTW32_acquire(self, kDTWWorkspaceRole_Band, rowCount, sizeof(size_t));
     
-    size_t globalDistanceElementCount = (rowCount + 1) * (rowCount + 1);
-    self->globalDistanceMatrix = calloc(globalDistanceElementCount, sizeof(Float32));
-    self->multiplicationTemp = calloc(self->maximumElementCount, sizeof(Float32));
-    self->inputTemp = calloc(self->maximumElementCount, sizeof(Float32));
-    self->comparisonDataTemp = calloc(self->maximumElementCount, sizeof(Float32));
+    DTW32_calculateBand(constraint, constraintParameter, rowCount, rowCount, self->bandRowStarts, self->bandRowEnds);
+    
+    for (size_t i = 0; i < rowCount; ++i) {
+        
+        size_t width = self->bandRowEnds[i] - self->bandRowStarts[i] + 2;
+        self->bandWidth = width > self->bandWidth ? width : self->bandWidth;
+    }
+    
+    self->bandWidth = self->bandWidth < rowCount ? self->bandWidth : rowCount;
+    self->maximumElementCount = rowCount * self->bandWidth;
+    
+    DTW32_acquireMatrices(self);
     
-    self->normalisationMatrix = calloc(self->maximumElementCount, sizeof(Float32));
-    self->phi = calloc(self->maximumElementCount, sizeof(Float32));;
-    self->p = calloc(self->maximumElementCount, sizeof(Float32));
-    self->q = calloc(self->maximumElementCount, sizeof(Float32));
     return self;
 }
 
+static void DTW32_stopThreads(DTW32 *self);
+
 void DTW32_delete(DTW32 *self)
 {
-    free(self->globalDistanceMatrix);
-    free(self->ones);
-    free(self->distanceMatrix);
-    free(self->multiplicationTemp);
-    free(self->phi);
-    free(self->normalisationMatrix);
-    free(self->p);
-    free(self->q);
+    DTW32_stopThreads(self);
+    DTW32_releaseMatrices(self);
+    
+    void *buffers[] =
+    {
+        self->inputTemp, self->comparisonDataTemp,
+        self->p, self->q, self->warpSegments, self->subsequenceStarts, self->subsequencePhi,
+        self->scoreRows, self->laneRows,
+        self->diagonalBuffers, self->diagonalDistances, self->diagonalTraceback,
+        self->tileBuffer, self->tileDiagonals,
+        self->threadTileBuffers, self->threadTileDiagonals, self->tileRowProgress,
+        self->bandRowStarts, self->bandRowEnds
+    };
+    
+    for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); ++i) {
+        
+        DTWWorkspacePool32_release(self->workspacePool, buffers[i]);
+    }
+    
+    if (self->ownsWorkspacePool) {
+        
+        DTWWorkspacePool32_delete(self->workspacePool);
+    }
+    
     free(self);
     self = NULL;
 }
@@ -67,127 +391,1172 @@ static inline void DTW32_checkBounds(DTW32 *self,
         ||
         inputBRowCount > self->maximumRowCount) {
         
-        printf("DTW32_getSimilarityScore, input row count is larger than allocated comparison matrix, exiting\n");
-        exit(-1);
+        printf("DTW32_getSimilarityScore, input row count is larger than allocated comparison matrix, exiting\n");
+        exit(-1);
+    }
+}
+
+/*
+ Sweeps the global distance matrix one anti-diagonal at a time. Cells on an anti-diagonal are independent,
+ so their predecessors are gathered into three contiguous rolling buffers and resolved with the vector
+ select step; the result and traceback are then scattered back into globalDistanceMatrix and phi.
+ Buffer index 0 stands for the NaN border row, entries outside the current diagonal stay at INFINITY,
+ which with strict less-than comparisons reproduces vDSP_minvi's lowest-index choice.
+ */
+static void DTW32_accumulateWavefront(DTW32 *self,
+                                      size_t inputRowCount,
+                                      size_t comparisonDataRowCount)
+{
+    const size_t bufferLength = inputRowCount + 1;
+    const size_t stride = comparisonDataRowCount + 1;
+    Float32 *previous2 = self->diagonalBuffers;
+    Float32 *previous1 = &self->diagonalBuffers[bufferLength];
+    Float32 *current = &self->diagonalBuffers[2 * bufferLength];
+    Float32 infinity = INFINITY;
+    
+    vDSP_vfill(&infinity, self->diagonalBuffers, 1, 3 * bufferLength);
+    previous2[0] = 0;
+    
+    for (size_t k = 0; k < inputRowCount + comparisonDataRowCount - 1; ++k) {
+        
+        size_t firstRow = k < comparisonDataRowCount ? 0 : k - (comparisonDataRowCount - 1);
+        size_t lastRow = k < inputRowCount ? k : inputRowCount - 1;
+        size_t count = lastRow - firstRow + 1;
+        
+        for (size_t i = firstRow; i <= lastRow; ++i) {
+            
+            self->diagonalDistances[i] = self->globalDistanceMatrix[(i + 1) * stride + (k - i + 1)];
+        }
+        
+        self->selectDiagonal(&previous2[firstRow],
+                             &previous1[firstRow],
+                             &previous1[firstRow + 1],
+                             &self->diagonalDistances[firstRow],
+                             &current[firstRow + 1],
+                             &self->diagonalTraceback[firstRow],
+                             count);
+        
+        for (size_t i = firstRow; i <= lastRow; ++i) {
+            
+            self->globalDistanceMatrix[(i + 1) * stride + (k - i + 1)] = current[i + 1];
+            DTW32_setTraceback(self->phi, i * comparisonDataRowCount + (k - i), (UInt8)self->diagonalTraceback[i]);
+        }
+        
+        if (k == 0) {
+            
+            previous2[0] = INFINITY;
+        }
+        
+        Float32 *recycled = previous2;
+        previous2 = previous1;
+        previous1 = current;
+        current = recycled;
+    }
+}
+
+/*
+ Accumulates the block of cells rows firstRow to lastRow by columns firstColumn to lastColumn. The row
+ above and the column to the left, already final, are copied in as a halo with the border replaced by
+ the values the anti-diagonal sweep sees there, then the block is swept by anti-diagonals with the vector
+ select step in L1 and copied back. The arithmetic is the same as DTW32_accumulateWavefront so the results
+ are identical.
+ */
+static void DTW32_accumulateTile(DTW32 *self,
+                                 Float32 *tile,
+                                 Float32 *tileDiagonals,
+                                 Boolean shared,
+                                 size_t comparisonDataRowCount,
+                                 size_t firstRow,
+                                 size_t lastRow,
+                                 size_t firstColumn,
+                                 size_t lastColumn)
+{
+    const size_t stride = comparisonDataRowCount + 1;
+    const size_t height = lastRow - firstRow + 1;
+    const size_t width = lastColumn - firstColumn + 1;
+    const size_t tileStride = width + 1;
+    Float32 *diagonal = tileDiagonals;
+    Float32 *up = &tileDiagonals[DTW32_TILE_SIZE];
+    Float32 *left = &tileDiagonals[2 * DTW32_TILE_SIZE];
+    Float32 *distances = &tileDiagonals[3 * DTW32_TILE_SIZE];
+    Float32 *result = &tileDiagonals[4 * DTW32_TILE_SIZE];
+    Float32 *traceback = &tileDiagonals[5 * DTW32_TILE_SIZE];
+    
+    for (size_t a = 0; a <= height; ++a) {
+        
+        memcpy(&tile[a * tileStride], &self->globalDistanceMatrix[(firstRow + a) * stride + firstColumn], tileStride * sizeof(Float32));
+    }
+    
+    if (firstRow == 0) {
+        
+        Float32 infinity = INFINITY;
+        vDSP_vfill(&infinity, tile, 1, tileStride);
+    }
+    
+    if (firstColumn == 0) {
+        
+        for (size_t a = 0; a <= height; ++a) {
+            
+            tile[a * tileStride] = INFINITY;
+        }
+    }
+    
+    if (firstRow == 0 && firstColumn == 0) {
+        
+        tile[0] = 0;
+    }
+    
+    for (size_t k = 0; k < height + width - 1; ++k) {
+        
+        size_t firstA = k < width ? 0 : k - (width - 1);
+        size_t lastA = k < height ? k : height - 1;
+        size_t count = lastA - firstA + 1;
+        
+        for (size_t c = 0; c < count; ++c) {
+            
+            size_t a = firstA + c;
+            size_t index = (a + 1) * tileStride + (k - a + 1);
+            diagonal[c] = tile[index - tileStride - 1];
+            up[c] = tile[index - tileStride];
+            left[c] = tile[index - 1];
+            distances[c] = tile[index];
+        }
+        
+        self->selectDiagonal(diagonal, up, left, distances, result, traceback, count);
+        
+        for (size_t c = 0; c < count; ++c) {
+            
+            size_t a = firstA + c;
+            size_t b = k - a;
+            size_t phiIndex = (firstRow + a) * comparisonDataRowCount + firstColumn + b;
+            tile[(a + 1) * tileStride + (b + 1)] = result[c];
+            
+            if (shared == true && (b < 3 || b + 3 >= width)) {
+                
+                DTW32_setTracebackShared(self->phi, phiIndex, (UInt8)traceback[c]);
+            }
+            else {
+                
+                DTW32_setTraceback(self->phi, phiIndex, (UInt8)traceback[c]);
+            }
+        }
+    }
+    
+    for (size_t a = 1; a <= height; ++a) {
+        
+        memcpy(&self->globalDistanceMatrix[(firstRow + a) * stride + firstColumn + 1], &tile[a * tileStride + 1], width * sizeof(Float32));
+    }
+}
+
+/*
+ Blocks are visited in row major order, so the blocks above and to the left of each one are already final.
+ */
+static void DTW32_accumulateTiled(DTW32 *self,
+                                  size_t inputRowCount,
+                                  size_t comparisonDataRowCount)
+{
+    for (size_t firstRow = 0; firstRow < inputRowCount; firstRow += DTW32_TILE_SIZE) {
+        
+        size_t lastRow = firstRow + DTW32_TILE_SIZE < inputRowCount ? firstRow + DTW32_TILE_SIZE - 1 : inputRowCount - 1;
+        
+        for (size_t firstColumn = 0; firstColumn < comparisonDataRowCount; firstColumn += DTW32_TILE_SIZE) {
+            
+            size_t lastColumn = firstColumn + DTW32_TILE_SIZE < comparisonDataRowCount ? firstColumn + DTW32_TILE_SIZE - 1 : comparisonDataRowCount - 1;
+            
+            DTW32_accumulateTile(self, self->tileBuffer, self->tileDiagonals, false, comparisonDataRowCount, firstRow, lastRow, firstColumn, lastColumn);
+        }
+    }
+}
+
+typedef struct DTW32_TileWorker
+{
+    DTW32 *self;
+    size_t index;
+    
+} DTW32_TileWorker;
+
+/*
+ Worker n takes block rows n, n + threadCount, ... left to right. A block only depends on the block above
+ and the block to its left, so each worker waits until the row above has published a higher column count
+ in tileRowProgress, which gives an anti-diagonal wavefront of blocks across the workers.
+ */
+static void *DTW32_accumulateTileRows(void *argument)
+{
+    DTW32_TileWorker *worker = argument;
+    DTW32 *self = worker->self;
+    const size_t inputRowCount = self->currentInputRowCount;
+    const size_t comparisonDataRowCount = self->currentComparisonDataRowCount;
+    const size_t tileRowCount = (inputRowCount + DTW32_TILE_SIZE - 1) / DTW32_TILE_SIZE;
+    const size_t tileColumnCount = (comparisonDataRowCount + DTW32_TILE_SIZE - 1) / DTW32_TILE_SIZE;
+    Float32 *tile = &self->threadTileBuffers[worker->index * (DTW32_TILE_SIZE + 1) * (DTW32_TILE_SIZE + 1)];
+    Float32 *tileDiagonals = &self->threadTileDiagonals[worker->index * 6 * DTW32_TILE_SIZE];
+    
+    for (size_t tileRow = worker->index; tileRow < tileRowCount; tileRow += self->threadCount) {
+        
+        size_t firstRow = tileRow * DTW32_TILE_SIZE;
+        size_t lastRow = firstRow + DTW32_TILE_SIZE < inputRowCount ? firstRow + DTW32_TILE_SIZE - 1 : inputRowCount - 1;
+        
+        for (size_t tileColumn = 0; tileColumn < tileColumnCount; ++tileColumn) {
+            
+            size_t firstColumn = tileColumn * DTW32_TILE_SIZE;
+            size_t lastColumn = firstColumn + DTW32_TILE_SIZE < comparisonDataRowCount ? firstColumn + DTW32_TILE_SIZE - 1 : comparisonDataRowCount - 1;
+            
+            while (tileRow > 0 && __atomic_load_n(&self->tileRowProgress[tileRow - 1], __ATOMIC_ACQUIRE) <= tileColumn) {
+                
+                sched_yield();
+            }
+            
+            DTW32_accumulateTile(self, tile, tileDiagonals, true, comparisonDataRowCount, firstRow, lastRow, firstColumn, lastColumn);
+            
+            __atomic_store_n(&self->tileRowProgress[tileRow], tileColumn + 1, __ATOMIC_RELEASE);
+        }
+    }
+    
+    return NULL;
+}
+
+/*
+ Each worker thread sleeps on threadStart until threadGeneration moves on, accumulates its share of block
+ rows and the last one to finish wakes the calling thread.
+ */
+static void *DTW32_runTileWorker(void *argument)
+{
+    DTW32_TileWorker *worker = argument;
+    DTW32 *self = worker->self;
+    size_t generation = 0;
+    
+    pthread_mutex_lock(&self->threadLock);
+    
+    while (true) {
+        
+        while (self->stopThreads == false && self->threadGeneration == generation) {
+            
+            pthread_cond_wait(&self->threadStart, &self->threadLock);
+        }
+        
+        if (self->stopThreads == true) {
+            
+            break;
+        }
+        
+        generation = self->threadGeneration;
+        pthread_mutex_unlock(&self->threadLock);
+        
+        DTW32_accumulateTileRows(worker);
+        
+        pthread_mutex_lock(&self->threadLock);
+        self->runningThreadCount--;
+        
+        if (self->runningThreadCount == 0) {
+            
+            pthread_cond_signal(&self->threadFinish);
+        }
+    }
+    
+    pthread_mutex_unlock(&self->threadLock);
+    
+    return NULL;
+}
+
+static void DTW32_accumulateTiledParallel(DTW32 *self)
+{
+    const size_t tileRowCount = (self->currentInputRowCount + DTW32_TILE_SIZE - 1) / DTW32_TILE_SIZE;
+    
+    memset(self->tileRowProgress, 0, tileRowCount * sizeof(size_t));
+    
+    pthread_mutex_lock(&self->threadLock);
+    self->runningThreadCount = self->threadCount - 1;
+    self->threadGeneration++;
+    pthread_cond_broadcast(&self->threadStart);
+    pthread_mutex_unlock(&self->threadLock);
+    
+    DTW32_accumulateTileRows(&self->tileWorkers[0]);
+    
+    pthread_mutex_lock(&self->threadLock);
+    
+    while (self->runningThreadCount > 0) {
+        
+        pthread_cond_wait(&self->threadFinish, &self->threadLock);
+    }
+    
+    pthread_mutex_unlock(&self->threadLock);
+}
+
+static void DTW32_stopThreads(DTW32 *self)
+{
+    if (self->tileWorkers == NULL) {
+        
+        return;
+    }
+    
+    pthread_mutex_lock(&self->threadLock);
+    self->stopThreads = true;
+    pthread_cond_broadcast(&self->threadStart);
+    pthread_mutex_unlock(&self->threadLock);
+    
+    for (size_t i = 1; i < self->threadCount; ++i) {
+        
+        pthread_join(self->threads[i], NULL);
+    }
+    
+    pthread_cond_destroy(&self->threadFinish);
+    pthread_cond_destroy(&self->threadStart);
+    pthread_mutex_destroy(&self->threadLock);
+    free(self->threads);
+    free(self->tileWorkers);
+    self->threads = NULL;
+    self->tileWorkers = NULL;
+    self->threadCount = 1;
+}
+
+/*
+ Worker threads that fail to start are left out, the block rows are shared between those that did and a
+ single thread falls back to DTW32_accumulateTiled.
+ */
+static void DTW32_startThreads(DTW32 *self, size_t threadCount)
+{
+    self->threads = calloc(threadCount, sizeof(pthread_t));
+    self->tileWorkers = calloc(threadCount, sizeof(DTW32_TileWorker));
+    self->threadGeneration = 0;
+    self->runningThreadCount = 0;
+    self->stopThreads = false;
+    self->threadCount = 1;
+    
+    pthread_mutex_init(&self->threadLock, NULL);
+    pthread_cond_init(&self->threadStart, NULL);
+    pthread_cond_init(&self->threadFinish, NULL);
+    
+    for (size_t i = 0; i < threadCount; ++i) {
+        
+        self->tileWorkers[i].self = self;
+        self->tileWorkers[i].index = i;
+    }
+    
+    for (size_t i = 1; i < threadCount; ++i) {
+        
+        if (pthread_create(&self->threads[i], NULL, DTW32_runTileWorker, &self->tileWorkers[i]) != 0) {
+            
+            printf("DTW32_setParallelAccumulation, could only start %zu of %zu threads\n", i, threadCount);
+            break;
+        }
+        
+        self->threadCount = i + 1;
+    }
+}
+
+void DTW32_setParallelAccumulation(DTW32 *self,
+                                   size_t threadCount,
+                                   size_t cellThreshold)
+{
+    if (self->constraint != kDTWConstraint_None) {
+        
+        printf("DTW32_setParallelAccumulation, only unconstrained comparisons can be accumulated in parallel, exiting\n");
+        exit(-1);
+    }
+    
+    if (threadCount == 0) {
+        
+        long processorCount = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = processorCount > 0 ? (size_t)processorCount : 1;
+    }
+    
+    DTW32_stopThreads(self);
+    DTWWorkspacePool32_release(self->workspacePool, self->threadTileBuffers);
+    DTWWorkspacePool32_release(self->workspacePool, self->threadTileDiagonals);
+    DTWWorkspacePool32_release(self->workspacePool, self->tileRowProgress);
+    
+    DTW32_startThreads(self, threadCount);
+    self->parallelCellThreshold = cellThreshold;
+    self->threadTileBuffers = DTW32_acquire(self, kDTWWorkspaceRole_Tiles, threadCount * (DTW32_TILE_SIZE + 1) * (DTW32_TILE_SIZE + 1), sizeof(Float32));
+    self->threadTileDiagonals = DTW32_acquire(self, kDTWWorkspaceRole_Tiles, threadCount * 6 * DTW32_TILE_SIZE, sizeof(Float32));
+    self->tileRowProgress = DTW32_acquire(self, kDTWWorkspaceRole_Tiles, (self->maximumRowCount + DTW32_TILE_SIZE - 1) / DTW32_TILE_SIZE, sizeof(size_t));
+}
+
+/*
+ One matrix multiply writes -dot for every pair of rows straight into the padded globalDistanceMatrix,
+ starting at row 1 column 1 with the padded stride, and each cell is then scaled in place to
+ 1 - dot / (|a||b|) with the row norms calculated once per comparison.
+ */
+static void DTW32_calculateDistances(DTW32 *self,
+                                     Float32 *inputData,
+                                     size_t inputRowCount,
+                                     Float32 *comparisonData,
+                                     size_t comparisonDataRowCount,
+                                     size_t currentColumnCount)
+{
+    if (self->globalDistanceMatrix == NULL) {
+        
+        DTW32_acquireMatrices(self);
+    }
+    
+    self->currentInputRowCount = inputRowCount;
+    self->currentComparisonDataRowCount = comparisonDataRowCount;
+    
+    DTW32_calculateRowNorms(inputData, inputRowCount, currentColumnCount, self->inputTemp);
+    DTW32_calculateRowNorms(comparisonData, comparisonDataRowCount, currentColumnCount, self->comparisonDataTemp);
+    
+    const size_t stride = comparisonDataRowCount + 1;
+    
+    cblas_sgemm(CblasRowMajor,
+                CblasNoTrans,
+                CblasTrans,
+                (SInt32)inputRowCount,
+                (SInt32)comparisonDataRowCount,
+                (SInt32)currentColumnCount,
+                -1.f,
+                inputData,
+                (SInt32)currentColumnCount,
+                comparisonData,
+                (SInt32)currentColumnCount,
+                0.f,
+                &self->globalDistanceMatrix[stride + 1],
+                (SInt32)stride);
+    
+    for (size_t i = 0; i < inputRowCount; ++i) {
+        
+        const Float32 inputNorm = self->inputTemp[i];
+        Float32 *row = &self->globalDistanceMatrix[(i + 1) * stride + 1];
+        
+        for (size_t j = 0; j < comparisonDataRowCount; ++j) {
+            
+            row[j] = 1.f + row[j] / (inputNorm * self->comparisonDataTemp[j]);
+        }
+    }
+    
+    Float32 nan = NAN;
+    
+    self->globalDistanceMatrix[0] = 0;
+    vDSP_vfill(&nan, &self->globalDistanceMatrix[1], 1, comparisonDataRowCount);
+    vDSP_vfill(&nan, &self->globalDistanceMatrix[comparisonDataRowCount + 1], comparisonDataRowCount + 1, inputRowCount);
+}
+
+void DTW32_calculateRowNorms(Float32 *data,
+                             size_t rowCount,
+                             size_t columnCount,
+                             Float32 *norms)
+{
+    for (size_t i = 0; i < rowCount; ++i) {
+        
+        vDSP_svesq(&data[i * columnCount], 1, &norms[i], columnCount);
+    }
+    
+    const int elementCount = (int)rowCount;
+    vvsqrtf(norms, norms, &elementCount);
+}
+
+/*
+ The band was sized for the square comparison of the longest inputs, so a steeper comparison can have rows
+ wider than bandWidth. Those rows are clamped to bandWidth cells along the diagonal instead, which keeps
+ every comparison inside the buffers acquired at construction. Returns false when the comparison is so
+ steep that no path fits in clamped rows, it is then scored INFINITY.
+ */
+static Boolean DTW32_prepareBand(DTW32 *self,
+                                 size_t inputRowCount,
+                                 size_t comparisonDataRowCount)
+{
+    DTW32_calculateBand(self->constraint,
+                        self->constraintParameter,
+                        inputRowCount,
+                        comparisonDataRowCount,
+                        self->bandRowStarts,
+                        self->bandRowEnds);
+    
+    const size_t width = self->bandWidth;
+    
+    for (size_t i = 0; i < inputRowCount; ++i) {
+        
+        if (self->bandRowEnds[i] - self->bandRowStarts[i] + 1 <= width) {
+            
+            continue;
+        }
+        
+        size_t diagonal = inputRowCount > 1 ? i * (comparisonDataRowCount - 1) / (inputRowCount - 1) : 0;
+        size_t start = diagonal > (width - 1) / 2 ? diagonal - (width - 1) / 2 : 0;
+        
+        start = start > self->bandRowStarts[i] ? start : self->bandRowStarts[i];
+        start = start < self->bandRowEnds[i] + 1 - width ? start : self->bandRowEnds[i] + 1 - width;
+        self->bandRowStarts[i] = start;
+        self->bandRowEnds[i] = start + width - 1;
+    }
+    
+    if (self->bandRowStarts[0] != 0 || self->bandRowEnds[inputRowCount - 1] != comparisonDataRowCount - 1) {
+        
+        return false;
+    }
+    
+    for (size_t i = 1; i < inputRowCount; ++i) {
+        
+        if (self->bandRowStarts[i] > self->bandRowEnds[i - 1] + 1) {
+            
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+/*
+ Row by row accumulation over the cells inside the band only. Distances are calculated per cell from
+ the row norms, cells outside the band count as INFINITY.
+ */
+static Float32 DTW32_accumulateBand(DTW32 *self,
+                                    Float32 *inputData,
+                                    size_t inputRowCount,
+                                    Float32 *comparisonData,
+                                    size_t comparisonDataRowCount,
+                                    size_t currentColumnCount,
+                                    Float32 abandonThreshold)
+{
+    if (DTW32_prepareBand(self, inputRowCount, comparisonDataRowCount) == false) {
+        
+        self->currentInputRowCount = 0;
+        self->currentComparisonDataRowCount = 0;
+        
+        return INFINITY;
+    }
+    
+    if (self->bandGlobalDistances == NULL) {
+        
+        DTW32_acquireMatrices(self);
+    }
+    
+    self->currentInputRowCount = inputRowCount;
+    self->currentComparisonDataRowCount = comparisonDataRowCount;
+    
+    DTW32_calculateRowNorms(inputData, inputRowCount, currentColumnCount, self->inputTemp);
+    DTW32_calculateRowNorms(comparisonData, comparisonDataRowCount, currentColumnCount, self->comparisonDataTemp);
+    
+    const size_t width = self->bandWidth;
+    
+    for (size_t i = 0; i < inputRowCount; ++i) {
+        
+        const size_t start = self->bandRowStarts[i];
+        const size_t end = self->bandRowEnds[i];
+        const size_t previousStart = i > 0 ? self->bandRowStarts[i - 1] : 0;
+        const size_t previousEnd = i > 0 ? self->bandRowEnds[i - 1] : 0;
+        Float32 *row = &self->bandGlobalDistances[i * width];
+        Float32 *previousRow = i > 0 ? &self->bandGlobalDistances[(i - 1) * width] : NULL;
+        const size_t phiRow = i * width;
+        Float32 *input = &inputData[i * currentColumnCount];
+        Float32 rowMinimum = INFINITY;
+        
+        for (size_t j = start; j <= end; ++j) {
+            
+            Float32 *comparison = &comparisonData[j * currentColumnCount];
+            Float32 dot = 0;
+            
+            for (size_t k = 0; k < currentColumnCount; ++k) {
+                
+                dot += input[k] * comparison[k];
+            }
+            
+            Float32 distance = 1.f - dot / (self->inputTemp[i] * self->comparisonDataTemp[j]);
+            Float32 best = INFINITY;
+            UInt8 index = 1;
+            
+            if (i == 0 && j == 0) {
+                
+                best = 0;
+            }
+            else {
+                
+                Float32 up = INFINITY, left = INFINITY;
+                
+                if (i > 0 && j > previousStart && j - 1 <= previousEnd) {
+                    
+                    best = previousRow[j - 1 - previousStart];
+                }
+                
+                if (i > 0 && j >= previousStart && j <= previousEnd) {
+                    
+                    up = previousRow[j - previousStart];
+                }
+                
+                if (j > start) {
+                    
+                    left = row[j - 1 - start];
+                }
+                
+                index = up < best ? 2 : index;
+                best = up < best ? up : best;
+                
+                index = left < best ? 3 : index;
+                best = left < best ? left : best;
+            }
+            
+            row[j - start] = distance + best;
+            DTW32_setTraceback(self->bandPhi, phiRow + j - start, index);
+            rowMinimum = row[j - start] < rowMinimum ? row[j - start] : rowMinimum;
+        }
+        
+        if (rowMinimum >= abandonThreshold) {
+            
+            return INFINITY;
+        }
+    }
+    
+    return self->bandGlobalDistances[(inputRowCount - 1) * width + (comparisonDataRowCount - 1 - self->bandRowStarts[inputRowCount - 1])];
+}
+
+/*
+ One row of the two row accumulation, distances are indexed by comparison row. Returns the row minimum.
+ */
+static Float32 DTW32_accumulateScoreRow(const Float32 *distances,
+                                        const Float32 *previousRow,
+                                        Float32 *row,
+                                        size_t i,
+                                        size_t start,
+                                        size_t end,
+                                        size_t previousStart,
+                                        size_t previousEnd)
+{
+    Float32 rowMinimum = INFINITY;
+    
+    for (size_t j = start; j <= end; ++j) {
+        
+        Float32 best = INFINITY;
+        
+        if (i == 0 && j == 0) {
+            
+            best = 0;
+        }
+        else {
+            
+            if (i > 0 && j > previousStart && j - 1 <= previousEnd) {
+                
+                best = previousRow[j - 1];
+            }
+            
+            if (i > 0 && j >= previousStart && j <= previousEnd && previousRow[j] < best) {
+                
+                best = previousRow[j];
+            }
+            
+            if (j > start && row[j - 1] < best) {
+                
+                best = row[j - 1];
+            }
+        }
+        
+        row[j] = distances[j] + best;
+        rowMinimum = row[j] < rowMinimum ? row[j] : rowMinimum;
+    }
+    
+    return rowMinimum;
+}
+
+/*
+ Two row accumulation for searches, the distances are calculated a row at a time from the row norms so
+ neither the distance matrix, the global distance matrix nor phi are touched.
+ */
+Float32 DTW32_getSimilarityScoreOnly(DTW32 *self,
+                                     Float32 *inputData,
+                                     size_t inputRowCount,
+                                     Float32 *comparisonData,
+                                     size_t comparisonDataRowCount,
+                                     size_t currentColumnCount,
+                                     Float32 abandonThreshold)
+{
+    if (self->constraint != kDTWConstraint_None && DTW32_prepareBand(self, inputRowCount, comparisonDataRowCount) == false) {
+        
+        return INFINITY;
+    }
+    
+    DTW32_calculateRowNorms(inputData, inputRowCount, currentColumnCount, self->inputTemp);
+    DTW32_calculateRowNorms(comparisonData, comparisonDataRowCount, currentColumnCount, self->comparisonDataTemp);
+    
+    Float32 *previousRow = self->scoreRows;
+    Float32 *row = &self->scoreRows[self->maximumRowCount];
+    Float32 *distances = &self->scoreRows[2 * self->maximumRowCount];
+    size_t previousStart = 0, previousEnd = 0;
+    
+    for (size_t i = 0; i < inputRowCount; ++i) {
+        
+        size_t start = 0, end = comparisonDataRowCount - 1;
+        
+        if (self->constraint != kDTWConstraint_None) {
+            
+            start = self->bandRowStarts[i];
+            end = self->bandRowEnds[i];
+        }
+        
+        Float32 *input = &inputData[i * currentColumnCount];
+        
+        for (size_t j = start; j <= end; ++j) {
+            
+            Float32 *comparison = &comparisonData[j * currentColumnCount];
+            Float32 dot = 0;
+            
+            for (size_t k = 0; k < currentColumnCount; ++k) {
+                
+                dot += input[k] * comparison[k];
+            }
+            
+            distances[j] = 1.f - dot / (self->inputTemp[i] * self->comparisonDataTemp[j]);
+        }
+        
+        if (DTW32_accumulateScoreRow(distances, previousRow, row, i, start, end, previousStart, previousEnd) >= abandonThreshold) {
+            
+            return INFINITY;
+        }
+        
+        Float32 *temp = previousRow;
+        previousRow = row;
+        row = temp;
+        previousStart = start;
+        previousEnd = end;
+    }
+    
+    return previousRow[comparisonDataRowCount - 1];
+}
+
+Float32 DTW32_getSimilarityScoreFromDistances(DTW32 *self,
+                                              const Float32 *distanceMatrix,
+                                              size_t distanceMatrixRowStride,
+                                              size_t inputRowCount,
+                                              size_t comparisonDataRowCount,
+                                              Float32 abandonThreshold)
+{
+    if (self->constraint != kDTWConstraint_None && DTW32_prepareBand(self, inputRowCount, comparisonDataRowCount) == false) {
+        
+        return INFINITY;
+    }
+    
+    Float32 *previousRow = self->scoreRows;
+    Float32 *row = &self->scoreRows[self->maximumRowCount];
+    size_t previousStart = 0, previousEnd = 0;
+    
+    for (size_t i = 0; i < inputRowCount; ++i) {
+        
+        size_t start = 0, end = comparisonDataRowCount - 1;
+        
+        if (self->constraint != kDTWConstraint_None) {
+            
+            start = self->bandRowStarts[i];
+            end = self->bandRowEnds[i];
+        }
+        
+        if (DTW32_accumulateScoreRow(&distanceMatrix[i * distanceMatrixRowStride], previousRow, row, i, start, end, previousStart, previousEnd) >= abandonThreshold) {
+            
+            return INFINITY;
+        }
+        
+        Float32 *temp = previousRow;
+        previousRow = row;
+        row = temp;
+        previousStart = start;
+        previousEnd = end;
     }
+    
+    return previousRow[comparisonDataRowCount - 1];
 }
 
-Float32 DTW32_getSimilarityScore(DTW32 *self,
-                                 Float32 *inputData,
-                                 size_t inputRowCount,
-                                 Float32 *comparisonData,
-                                 size_t comparisonDataRowCount,
-                                 size_t currentColumnCount)
+size_t DTW32_candidateLaneGroupCount(size_t candidateCount)
 {
-    
-//    Float32_printContiguous2DArray(inputData, inputRowCount, currentColumnCount, "input");
-//    Float32_printContiguous2DArray(comparisonData, comparisonDataRowCount, currentColumnCount, "compare");
+    return (candidateCount + DTW32_CANDIDATE_LANE_COUNT - 1) / DTW32_CANDIDATE_LANE_COUNT;
+}
 
-    Float32 similarity = INFINITY;
-    self->currentInputRowCount = inputRowCount;
-    self->currentComparisonDataRowCount = comparisonDataRowCount;
-    vDSP_vsq(inputData, 1, self->inputTemp, 1, inputRowCount * currentColumnCount);
-    vDSP_vsq(comparisonData, 1, self->comparisonDataTemp, 1, comparisonDataRowCount * currentColumnCount);
+void DTW32_transposeCandidateLanes(Float32 *paletteData,
+                                   size_t columnCount,
+                                   const size_t *candidateStarts,
+                                   size_t candidateCount,
+                                   size_t comparisonDataRowCount,
+                                   Float32 *candidateLanes)
+{
+    const size_t L = DTW32_CANDIDATE_LANE_COUNT;
+    const size_t groupSize = comparisonDataRowCount * columnCount * L;
+    size_t groupCount = DTW32_candidateLaneGroupCount(candidateCount);
     
+    memset(candidateLanes, 0, groupCount * groupSize * sizeof(Float32));
+    
+    for (size_t candidate = 0; candidate < candidateCount; ++candidate) {
+        
+        Float32 *group = &candidateLanes[(candidate / L) * groupSize];
+        Float32 *source = &paletteData[candidateStarts[candidate] * columnCount];
+        size_t lane = candidate % L;
+        
+        for (size_t element = 0; element < comparisonDataRowCount * columnCount; ++element) {
+            
+            group[element * L + lane] = source[element];
+        }
+    }
+}
 
+/*
+ The two row accumulation of DTW32_accumulateScoreRow with DTW32_CANDIDATE_LANE_COUNT candidates
+ interleaved per cell. The band and the boundary tests are the same for every lane so they are decided
+ once per cell, leaving fixed length lane loops with no branches for the compiler to vectorise. The
+ padding lanes of a partial group are still accumulated but only the real lanes decide abandonment.
+ */
+void DTW32_getSimilarityScoresLanes(DTW32 *self,
+                                    Float32 *normalisedInputData,
+                                    size_t inputRowCount,
+                                    const Float32 *candidateLanes,
+                                    size_t laneCount,
+                                    size_t comparisonDataRowCount,
+                                    size_t columnCount,
+                                    Float32 abandonThreshold,
+                                    Float32 *scores)
+{
+    const size_t L = DTW32_CANDIDATE_LANE_COUNT;
     
-    vDSP_mtrans(self->inputTemp, 1, self->multiplicationTemp, 1, currentColumnCount, inputRowCount);
-    vDSP_mmul(self->ones, 1, self->multiplicationTemp, 1, self->inputTemp, 1, 1, inputRowCount, currentColumnCount);
+    if (self->constraint != kDTWConstraint_None && DTW32_prepareBand(self, inputRowCount, comparisonDataRowCount) == false) {
+        
+        for (size_t lane = 0; lane < laneCount; ++lane) {
+            
+            scores[lane] = INFINITY;
+        }
+        
+        return;
+    }
     
-    vDSP_mtrans(self->comparisonDataTemp, 1, self->multiplicationTemp, 1, currentColumnCount, comparisonDataRowCount);
-    vDSP_mmul(self->ones, 1, self->multiplicationTemp, 1, self->comparisonDataTemp, 1, 1, comparisonDataRowCount, currentColumnCount);
+    Float32 *previousRow = self->laneRows;
+    Float32 *row = &self->laneRows[self->maximumRowCount * L];
+    Float32 *distances = &self->laneRows[2 * self->maximumRowCount * L];
+    size_t previousStart = 0, previousEnd = 0;
     
-    const int elementCountInput = (int)inputRowCount;
-    const int elementCountComparisonData = (int)comparisonDataRowCount;
+    for (size_t i = 0; i < inputRowCount; ++i) {
+        
+        size_t start = 0, end = comparisonDataRowCount - 1;
+        
+        if (self->constraint != kDTWConstraint_None) {
+            
+            start = self->bandRowStarts[i];
+            end = self->bandRowEnds[i];
+        }
+        
+        Float32 *input = &normalisedInputData[i * columnCount];
+        
+        for (size_t j = start; j <= end; ++j) {
+            
+            const Float32 *comparison = &candidateLanes[j * columnCount * L];
+            Float32 *distance = &distances[j * L];
+            
+            for (size_t l = 0; l < L; ++l) {
+                
+                distance[l] = 1.f;
+            }
+            
+            for (size_t k = 0; k < columnCount; ++k) {
+                
+                for (size_t l = 0; l < L; ++l) {
+                    
+                    distance[l] -= input[k] * comparison[k * L + l];
+                }
+            }
+        }
+        
+        Float32 rowMinimum[DTW32_CANDIDATE_LANE_COUNT];
+        
+        for (size_t l = 0; l < L; ++l) {
+            
+            rowMinimum[l] = INFINITY;
+        }
+        
+        for (size_t j = start; j <= end; ++j) {
+            
+            Float32 best[DTW32_CANDIDATE_LANE_COUNT];
+            Boolean hasDiagonal = i > 0 && j > previousStart && j - 1 <= previousEnd;
+            Boolean hasUp = i > 0 && j >= previousStart && j <= previousEnd;
+            Boolean hasLeft = j > start;
+            
+            for (size_t l = 0; l < L; ++l) {
+                
+                best[l] = (i == 0 && j == 0) ? 0 : INFINITY;
+            }
+            
+            if (hasDiagonal == true) {
+                
+                for (size_t l = 0; l < L; ++l) {
+                    
+                    best[l] = previousRow[(j - 1) * L + l];
+                }
+            }
+            
+            if (hasUp == true) {
+                
+                for (size_t l = 0; l < L; ++l) {
+                    
+                    Float32 up = previousRow[j * L + l];
+                    best[l] = up < best[l] ? up : best[l];
+                }
+            }
+            
+            if (hasLeft == true) {
+                
+                for (size_t l = 0; l < L; ++l) {
+                    
+                    Float32 left = row[(j - 1) * L + l];
+                    best[l] = left < best[l] ? left : best[l];
+                }
+            }
+            
+            for (size_t l = 0; l < L; ++l) {
+                
+                Float32 value = distances[j * L + l] + best[l];
+                row[j * L + l] = value;
+                rowMinimum[l] = value < rowMinimum[l] ? value : rowMinimum[l];
+            }
+        }
+        
+        Boolean abandoned = true;
+        
+        for (size_t l = 0; l < laneCount; ++l) {
+            
+            abandoned = abandoned && rowMinimum[l] >= abandonThreshold;
+        }
+        
+        if (abandoned == true) {
+            
+            for (size_t l = 0; l < L; ++l) {
+                
+                scores[l] = INFINITY;
+            }
+            
+            return;
+        }
+        
+        Float32 *temp = previousRow;
+        previousRow = row;
+        row = temp;
+        previousStart = start;
+        previousEnd = end;
+    }
     
-    vvsqrtf(self->inputTemp, self->inputTemp, &elementCountInput);
-    vvsqrtf(self->comparisonDataTemp, self->comparisonDataTemp, &elementCountComparisonData);
- 
+    for (size_t l = 0; l < L; ++l) {
+        
+        scores[l] = previousRow[(comparisonDataRowCount - 1) * L + l];
+    }
+}
+
+void DTW32_calculateCosineDistanceMatrix(Float32 *inputData,
+                                         const Float32 *inputNorms,
+                                         size_t inputRowCount,
+                                         Float32 *paletteData,
+                                         const Float32 *paletteNorms,
+                                         size_t paletteRowCount,
+                                         size_t columnCount,
+                                         Float32 *distanceMatrix)
+{
     cblas_sgemm(CblasRowMajor,
                 CblasNoTrans,
                 CblasTrans,
                 (SInt32)inputRowCount,
-                (SInt32)comparisonDataRowCount,
-                1,
-                1.0,
-                self->inputTemp,
-                1,
-                self->comparisonDataTemp,
-                1,
-                0.,
-                self->normalisationMatrix,
-                (SInt32)comparisonDataRowCount);
+                (SInt32)paletteRowCount,
+                (SInt32)columnCount,
+                -1.f,
+                inputData,
+                (SInt32)columnCount,
+                paletteData,
+                (SInt32)columnCount,
+                0.f,
+                distanceMatrix,
+                (SInt32)paletteRowCount);
+    
+    for (size_t i = 0; i < inputRowCount; ++i) {
+        
+        Float32 *row = &distanceMatrix[i * paletteRowCount];
+        Float32 inputNorm = inputNorms[i];
+        
+        for (size_t j = 0; j < paletteRowCount; ++j) {
+            
+            row[j] = 1.f + row[j] / (inputNorm * paletteNorms[j]);
+        }
+    }
+}
+
+void DTW32_calculateNormalisedDistanceMatrix(Float32 *normalisedInputData,
+                                             size_t inputRowCount,
+                                             Float32 *normalisedPaletteData,
+                                             size_t paletteRowCount,
+                                             size_t columnCount,
+                                             Float32 *distanceMatrix)
+{
+    Float32 one = 1;
+    vDSP_vfill(&one, distanceMatrix, 1, inputRowCount * paletteRowCount);
     
     cblas_sgemm(CblasRowMajor,
                 CblasNoTrans,
                 CblasTrans,
                 (SInt32)inputRowCount,
-                (SInt32)comparisonDataRowCount,
-                (SInt32)currentColumnCount,
-                1.0,
-                inputData,
-                (SInt32)currentColumnCount,
-                comparisonData,
-                (SInt32)currentColumnCount,
-                0.,
-                self->distanceMatrix,
-                (SInt32)comparisonDataRowCount);
+                (SInt32)paletteRowCount,
+                (SInt32)columnCount,
+                -1.f,
+                normalisedInputData,
+                (SInt32)columnCount,
+                normalisedPaletteData,
+                (SInt32)columnCount,
+                1.f,
+                distanceMatrix,
+                (SInt32)paletteRowCount);
+}
+
+Float32 DTW32_getSimilarityScore(DTW32 *self,
+                                 Float32 *inputData,
+                                 size_t inputRowCount,
+                                 Float32 *comparisonData,
+                                 size_t comparisonDataRowCount,
+                                 size_t currentColumnCount)
+{
+    if (self->constraint != kDTWConstraint_None) {
+        
+        return DTW32_accumulateBand(self, inputData, inputRowCount, comparisonData, comparisonDataRowCount, currentColumnCount, INFINITY);
+    }
     
-    vDSP_vdiv(self->normalisationMatrix, 1, self->distanceMatrix, 1, self->distanceMatrix, 1, inputRowCount * comparisonDataRowCount);
+    DTW32_calculateDistances(self, inputData, inputRowCount, comparisonData, comparisonDataRowCount, currentColumnCount);
     
-//    Float32_printContiguous2DArray(self->distanceMatrix, inputRowCount, comparisonDataRowCount, "norm");
-
+    if (self->threadCount > 1 && inputRowCount * comparisonDataRowCount > self->parallelCellThreshold) {
+        
+        DTW32_accumulateTiledParallel(self);
+    }
+    else if (inputRowCount * comparisonDataRowCount > DTW32_TILED_CELL_THRESHOLD) {
+        
+        DTW32_accumulateTiled(self, inputRowCount, comparisonDataRowCount);
+    }
+    else {
+        
+        DTW32_accumulateWavefront(self, inputRowCount, comparisonDataRowCount);
+    }
     
-    Float32 minusOne =  -1.f;
-
-    vDSP_vsma(self->distanceMatrix, 1, &minusOne, self->ones, 1, self->distanceMatrix, 1, inputRowCount * comparisonDataRowCount);
-
-//    Float32_printContiguous2DArray(self->distanceMatrix, inputRowCount, comparisonDataRowCount, "norm");
+    Float32 similarity = self->globalDistanceMatrix[(comparisonDataRowCount + 1) * (inputRowCount + 1) - 1];
+        
+    return similarity;
+}
 
+static inline Float32 DTW32_cosineDistance(const Float32 *inputA,
+                                           const Float32 *inputB,
+                                           size_t columnCount)
+{
+    Float32 dot = 0, sumA = 0, sumB = 0;
     
-    vDSP_mmov(self->distanceMatrix, &self->globalDistanceMatrix[comparisonDataRowCount + 2], comparisonDataRowCount, inputRowCount, comparisonDataRowCount, comparisonDataRowCount + 1);
-
-
-    Float32 nan = NAN;
+    for (size_t i = 0; i < columnCount; ++i) {
+        
+        dot += inputA[i] * inputB[i];
+        sumA += inputA[i] * inputA[i];
+        sumB += inputB[i] * inputB[i];
+    }
     
-    vDSP_vfill(&nan, &self->globalDistanceMatrix[1], 1, comparisonDataRowCount);
-    vDSP_vfill(&nan, &self->globalDistanceMatrix[comparisonDataRowCount + 1], comparisonDataRowCount + 1, inputRowCount);
+    return 1.f - dot / (sqrtf(sumA) * sqrtf(sumB));
+}
+
+Float32 DTW32_lowerBoundKim(Float32 *inputData,
+                            size_t inputRowCount,
+                            Float32 *comparisonData,
+                            size_t comparisonDataRowCount,
+                            size_t columnCount)
+{
+    Float32 bound = DTW32_cosineDistance(inputData, comparisonData, columnCount);
     
-    Float32 comparisonArray[3] = {0};
+    if (inputRowCount > 1 || comparisonDataRowCount > 1) {
+        
+        bound += DTW32_cosineDistance(&inputData[(inputRowCount - 1) * columnCount],
+                                      &comparisonData[(comparisonDataRowCount - 1) * columnCount],
+                                      columnCount);
+    }
     
+    return bound;
+}
 
+Float32 DTW32_lowerBoundKeogh(Float32 *inputData,
+                              size_t inputRowCount,
+                              Float32 *upperEnvelope,
+                              size_t columnCount,
+                              Float32 abandonThreshold)
+{
+    Float32 bound = 0;
     
-    for (size_t i = 0; i < inputRowCount; ++i) {
+    for (size_t i = 0; i < inputRowCount && bound < abandonThreshold; ++i) {
         
-        for (size_t j = 0; j < comparisonDataRowCount; ++j) {
+        Float32 *row = &inputData[i * columnCount];
+        Float32 *envelope = &upperEnvelope[i * columnCount];
+        Float32 dot = 0, sum = 0;
+        
+        for (size_t j = 0; j < columnCount; ++j) {
             
-            comparisonArray[0] = self->globalDistanceMatrix[i * (comparisonDataRowCount + 1) + j];
-            comparisonArray[1] = self->globalDistanceMatrix[i * (comparisonDataRowCount + 1) + (j + 1)];
-            comparisonArray[2] = self->globalDistanceMatrix[(i + 1) * (comparisonDataRowCount + 1) + j];
+            dot += row[j] * envelope[j];
+            sum += row[j] * row[j];
+        }
+        
+        Float32 rowBound = 1.f - dot / sqrtf(sum);
+        bound += rowBound > 0 ? rowBound : 0;
+    }
+    
+    return bound;
+}
+
+void DTW32_calculateUpperEnvelope(Float32 *data,
+                                  size_t rowCount,
+                                  size_t columnCount,
+                                  size_t radius,
+                                  Float32 *upperEnvelope)
+{
+    Float32 *normalised = calloc(rowCount * columnCount, sizeof(Float32));
+    
+    for (size_t i = 0; i < rowCount; ++i) {
+        
+        Float32 sum = 0;
+        vDSP_svesq(&data[i * columnCount], 1, &sum, columnCount);
+        Float32 norm = sqrtf(sum);
+        
+        if (norm > 0) {
             
+            vDSP_vsdiv(&data[i * columnCount], 1, &norm, &normalised[i * columnCount], 1, columnCount);
+        }
+    }
+    
+    size_t *window = calloc(rowCount, sizeof(size_t));
+    
+    for (size_t j = 0; j < columnCount; ++j) {
+        
+        size_t head = 0, tail = 0, next = 0;
+        
+        for (size_t i = 0; i < rowCount; ++i) {
             
-            Float32 dmax;
-            size_t index;
-            vDSP_minvi(comparisonArray, 1, &dmax, &index, 3);
-            self->phi[(i * comparisonDataRowCount) + j] = index + 1;
+            size_t last = i + radius < rowCount ? i + radius : rowCount - 1;
             
+            for (; next <= last; ++next) {
+                
+                while (tail > head && normalised[window[tail - 1] * columnCount + j] <= normalised[next * columnCount + j]) {
+                    
+                    tail--;
+                }
+                
+                window[tail++] = next;
+            }
             
-            self->globalDistanceMatrix[(i + 1) * (comparisonDataRowCount + 1) + (j + 1)] = self->globalDistanceMatrix[(i + 1) * (comparisonDataRowCount + 1) + (j + 1)] + dmax;
+            while (window[head] + radius < i) {
+                
+                head++;
+            }
             
+            upperEnvelope[i * columnCount + j] = normalised[window[head] * columnCount + j];
         }
     }
     
+    free(window);
+    free(normalised);
+}
 
-    
-    similarity = self->globalDistanceMatrix[(comparisonDataRowCount + 1) * (inputRowCount + 1) - 1];
+
+static inline DTWStep DTW32_getStep(size_t fromRow, size_t fromColumn, size_t toRow, size_t toColumn)
+{
+    if (fromRow == toRow) {
         
-    return similarity;
+        return kDTWStep_Comparison;
+    }
+    
+    return fromColumn == toColumn ? kDTWStep_Input : kDTWStep_Diagonal;
 }
 
-
-void DTW32_traceWarpPath(DTW32 *self,
-                         size_t *warpPath)
+size_t DTW32_traceWarpPath(DTW32 *self,
+                           size_t *warpPath)
 {
+    if (self->currentInputRowCount == 0) {
+        
+        printf("DTW32_traceWarpPath, no full comparison has been made since construction or since the matrices were released, exiting\n");
+        exit(-1);
+    }
+    
     SInt32 i = (SInt32)self->currentInputRowCount - 1;
     SInt32 j = (SInt32)self->currentComparisonDataRowCount - 1;
     
@@ -197,7 +1566,16 @@ void DTW32_traceWarpPath(DTW32 *self,
     index++;
     while (i > 0 && j > 0) {
         
-        size_t tb = self->phi[i * self->currentComparisonDataRowCount + j];
+        size_t tb;
+        
+        if (self->constraint == kDTWConstraint_None) {
+            
+            tb = DTW32_getTraceback(self->phi, i * self->currentComparisonDataRowCount + j);
+        }
+        else {
+            
+            tb = DTW32_getTraceback(self->bandPhi, i * self->bandWidth + (j - self->bandRowStarts[i]));
+        }
         
         switch (tb) {
             case 1:{
@@ -223,19 +1601,214 @@ void DTW32_traceWarpPath(DTW32 *self,
         index++;
     }
     
-    vDSP_vrvrs(self->p, 1, index);
-    vDSP_vrvrs(self->q, 1, index);
+    /*
+     The path was collected from its end, so walking it backwards visits it in order. Each input row takes
+     the first path element reaching it, and consecutive steps in the same direction form one segment.
+     */
+    size_t nextRow = 0;
+    self->warpSegmentCount = 0;
+    
+    for (size_t k = index; k-- > 0;) {
+        
+        size_t row = (size_t)self->p[k];
+        size_t column = (size_t)self->q[k];
+        
+        while (nextRow <= row && nextRow < self->currentInputRowCount) {
+            
+            warpPath[nextRow] = column + 1;
+            nextRow++;
+        }
+        
+        DTWStep step = kDTWStep_Diagonal;
+        
+        if (k + 1 < index) {
+            
+            step = DTW32_getStep((size_t)self->p[k + 1], (size_t)self->q[k + 1], row, column);
+        }
+        else if (k > 0) {
+            
+            step = DTW32_getStep(row, column, (size_t)self->p[k - 1], (size_t)self->q[k - 1]);
+        }
+        
+        if (self->warpSegmentCount > 0 && self->warpSegments[self->warpSegmentCount - 1].step == step) {
+            
+            self->warpSegments[self->warpSegmentCount - 1].length++;
+        }
+        else {
+            
+            DTW32_WarpSegment segment = {row, column, 1, step};
+            self->warpSegments[self->warpSegmentCount] = segment;
+            self->warpSegmentCount++;
+        }
+    }
+    
+    return self->warpSegmentCount;
+}
+
+DTW32_SubsequenceMatch DTW32_findSubsequence(DTW32 *self,
+                                             Float32 *inputData,
+                                             size_t inputRowCount,
+                                             Float32 *paletteData,
+                                             size_t paletteRowCount,
+                                             size_t columnCount)
+{
+    DTW32_SubsequenceMatch match = {0, 0, INFINITY};
+    
+    if (inputRowCount > self->maximumRowCount) {
+        
+        printf("DTW32_findSubsequence, input row count is greater than the maximum row count, exiting\n");
+        exit(-1);
+    }
+    
+    UInt8 *traceback = inputRowCount * paletteRowCount <= self->subsequenceCellCount ? self->subsequencePhi : NULL;
+    self->subsequenceInputRowCount = inputRowCount;
+    
+    DTW32_calculateRowNorms(inputData, inputRowCount, columnCount, self->inputTemp);
     
-    for (size_t i = 0; i < self->currentInputRowCount; ++i) {
+    Float32 *previousColumn = self->scoreRows;
+    Float32 *column = &self->scoreRows[self->maximumRowCount];
+    size_t *previousStarts = self->subsequenceStarts;
+    size_t *starts = &self->subsequenceStarts[self->maximumRowCount];
+    
+    for (size_t j = 0; j < paletteRowCount; ++j) {
+        
+        Float32 *palette = &paletteData[j * columnCount];
+        Float32 paletteNorm;
+        vDSP_svesq(palette, 1, &paletteNorm, columnCount);
+        paletteNorm = sqrtf(paletteNorm);
         
-        for (size_t j = 0; j < index; ++j) {
+        for (size_t i = 0; i < inputRowCount; ++i) {
             
-            if (self->p[j] >= i) {
+            Float32 *input = &inputData[i * columnCount];
+            Float32 dot = 0;
+            
+            for (size_t k = 0; k < columnCount; ++k) {
                 
-                warpPath[i] = (size_t)self->q[j] + 1;
-                break;
+                dot += input[k] * palette[k];
+            }
+            
+            Float32 distance = 1.f - dot / (self->inputTemp[i] * paletteNorm);
+            Float32 best;
+            size_t start;
+            UInt8 index = 0;
+            
+            if (i == 0) {
+                
+                best = 0;
+                start = j;
+            }
+            else {
+                
+                best = INFINITY;
+                start = j;
+                
+                if (j > 0) {
+                    
+                    best = previousColumn[i - 1];
+                    start = previousStarts[i - 1];
+                    index = kDTWStep_Diagonal;
+                }
+                
+                if (column[i - 1] < best) {
+                    
+                    best = column[i - 1];
+                    start = starts[i - 1];
+                    index = kDTWStep_Input;
+                }
+                
+                if (j > 0 && previousColumn[i] < best) {
+                    
+                    best = previousColumn[i];
+                    start = previousStarts[i];
+                    index = kDTWStep_Comparison;
+                }
+            }
+            
+            column[i] = distance + best;
+            starts[i] = start;
+            
+            if (traceback != NULL) {
+                
+                DTW32_setTraceback(traceback, j * inputRowCount + i, index);
             }
         }
+        
+        if (column[inputRowCount - 1] < match.score) {
+            
+            match.score = column[inputRowCount - 1];
+            match.start = starts[inputRowCount - 1];
+            match.end = j;
+        }
+        
+        Float32 *temp = previousColumn;
+        previousColumn = column;
+        column = temp;
+        
+        size_t *startsTemp = previousStarts;
+        previousStarts = starts;
+        starts = startsTemp;
     }
+    
+    self->subsequenceMatch = traceback != NULL ? match : (DTW32_SubsequenceMatch){0, 0, INFINITY};
+    
+    return match;
+}
+
+void DTW32_reserveSubsequenceTraceback(DTW32 *self,
+                                       size_t paletteRowCount)
+{
+    DTWWorkspacePool32_release(self->workspacePool, self->subsequencePhi);
+    
+    self->subsequenceCellCount = self->maximumRowCount * paletteRowCount;
+    self->subsequencePhi = DTW32_acquire(self, kDTWWorkspaceRole_Traceback, DTW32_packedTracebackSize(self->subsequenceCellCount), sizeof(UInt8));
 }
 
+/*
+ Walking back from the span end, the cells of an input row are met from right to left, so the last one
+ written for each row is the first the path reaches it with. The choice 0 of the first input row ends the
+ walk at the span start.
+ */
+void DTW32_traceSubsequenceWarpPath(DTW32 *self,
+                                    size_t *warpPath)
+{
+    const size_t inputRowCount = self->subsequenceInputRowCount;
+    const DTW32_SubsequenceMatch match = self->subsequenceMatch;
+    
+    if (!(match.score < INFINITY)) {
+        
+        for (size_t i = 0; i < inputRowCount; ++i) {
+            
+            warpPath[i] = i + 1;
+        }
+        
+        return;
+    }
+    
+    size_t i = inputRowCount - 1;
+    size_t j = match.end;
+    
+    while (true) {
+        
+        warpPath[i] = j - match.start + 1;
+        
+        UInt8 choice = DTW32_getTraceback(self->subsequencePhi, j * inputRowCount + i);
+        
+        if (choice == kDTWStep_Diagonal) {
+            
+            i--;
+            j--;
+        }
+        else if (choice == kDTWStep_Input) {
+            
+            i--;
+        }
+        else if (choice == kDTWStep_Comparison) {
+            
+            j--;
+        }
+        else {
+            
+            break;
+        }
+    }
+}
@@ -8,11 +8,107 @@
 
 #import <MacTypes.h>
 #import "Matrix.h"
+#import "DTWWorkspace.h"
 #ifdef __cplusplus
 extern "C"
 {
 #endif
     
+    /*!
+     The number of palette candidates compared side by side by DTW32_getSimilarityScoresLanes, one per vector lane.
+     */
+#define DTW32_CANDIDATE_LANE_COUNT 8
+    
+    /*!
+     The side of the square blocks a tiled accumulation works through, a block and its halo stay in L1.
+     */
+#define DTW32_TILE_SIZE 64
+    
+    /*!
+     Full comparisons with more cells than this are accumulated block by block instead of in one anti-diagonal sweep, around the point where the global distance matrix stops fitting in L2.
+     */
+#define DTW32_TILED_CELL_THRESHOLD (256 * 256)
+    
+    /*!
+     Global path constraints.
+     @constant kDTWConstraint_None
+     Every cell of the comparison matrix is considered.
+     @constant kDTWConstraint_SakoeChiba
+     Cells within a radius of the diagonal, scaled to the comparison lengths.
+     @constant kDTWConstraint_Itakura
+     Cells within a parallelogram whose sides have a slope of the constraint parameter and its inverse.
+     */
+    typedef enum DTWConstraint
+    {
+        kDTWConstraint_None,
+        kDTWConstraint_SakoeChiba,
+        kDTWConstraint_Itakura
+    } DTWConstraint;
+    
+    /*!
+     The direction of a warp path step, with the same values as the traceback choices.
+     @constant kDTWStep_Diagonal
+     Both the input and the comparison advance.
+     @constant kDTWStep_Input
+     The input advances while the comparison frame is held.
+     @constant kDTWStep_Comparison
+     The comparison advances while the input frame is held.
+     */
+    typedef enum DTWStep
+    {
+        kDTWStep_Diagonal = 1,
+        kDTWStep_Input = 2,
+        kDTWStep_Comparison = 3
+    } DTWStep;
+    
+    /*!
+     A run of warp path elements reached by steps in the same direction.
+     @var inputRow
+     The input row of the first element.
+     @var comparisonRow
+     The comparison row of the first element.
+     @var length
+     The number of path elements in the run, each one step on from the last.
+     @var step
+     The direction of the steps.
+     */
+    typedef struct DTW32_WarpSegment
+    {
+        size_t inputRow;
+        size_t comparisonRow;
+        size_t length;
+        DTWStep step;
+        
+    } DTW32_WarpSegment;
+    
+    /*!
+     The best aligned span of a subsequence search.
+     @var start
+     The first palette row of the span.
+     @var end
+     The last palette row of the span.
+     @var score
+     The accumulated distance along the span.
+     */
+    typedef struct DTW32_SubsequenceMatch
+    {
+        size_t start;
+        size_t end;
+        Float32 score;
+        
+    } DTW32_SubsequenceMatch;
+    
+    /*!
+     Signature of the branchless minimum/select step used by the anti-diagonal accumulation, one implementation per instruction set.
+     */
+    typedef void (*DTW32_SelectFunction)(const Float32 *diagonal,
+                                         const Float32 *up,
+                                         const Float32 *left,
+                                         const Float32 *distances,
+                                         Float32 *result,
+                                         Float32 *traceback,
+                                         size_t count);
+    
     /*!
      @class DTW32
      @abstract Dynamic time warping DSP module
@@ -20,14 +116,92 @@ extern "C"
      The maximum number of rows in the comparison matrix.
      @var columnCount
      The maximum number of columns in the comparison matrix.
-     @var distanceMatrix
-     A pointer to the distance matrix.
      @var globalDistanceMatrix
-     A pointer to the global distance matrix.
-     @var ones
-     A ones vector of columnCount in size used for doing matrix column addition by multiplication.
-     @var temp
-     A pointer to temporary memory used for calculation.
+     A pointer to the global distance matrix, the local distances are written into it padded by a border row and column and accumulated in place.
+     @var inputTemp
+     The input row norms, maximumRowCount in length.
+     @var comparisonDataTemp
+     The comparison row norms, maximumRowCount in length.
+     @var diagonalBuffers
+     Three rolling anti-diagonals of the global distance matrix, each rowCount + 1 in length with a border element at index 0.
+     @var diagonalDistances
+     The local distances gathered along the current anti-diagonal.
+     @var diagonalTraceback
+     The predecessor choices computed along the current anti-diagonal before they are scattered into phi.
+     @var selectDiagonal
+     The minimum/select step for the instruction set detected at construction.
+     @var constraint
+     The global path constraint, the full matrix buffers are only allocated for kDTWConstraint_None.
+     @var constraintParameter
+     The Sakoe-Chiba radius in rows, or the Itakura slope.
+     @var bandWidth
+     The allocated number of cells per row for a constrained comparison, sized at construction for the square comparison of rowCount rows. The rows of a steeper comparison are clamped to it along the diagonal.
+     @var bandRowStarts
+     The first comparison row inside the band for each input row.
+     @var bandRowEnds
+     The last comparison row inside the band for each input row.
+     @var bandGlobalDistances
+     The global distance matrix for a constrained comparison, bandWidth cells per row starting at bandRowStarts.
+     @var phi
+     The traceback matrix, the predecessor choice of each cell packed into 2 bits.
+     @var p
+     The input rows of the traced warp path, at most 2 * maximumRowCount long.
+     @var q
+     The comparison rows of the traced warp path.
+     @var warpSegments
+     The run-length segments of the last traced warp path, at most 2 * maximumRowCount.
+     @var warpSegmentCount
+     The number of segments in warpSegments.
+     @var bandPhi
+     The packed traceback matrix for a constrained comparison, in the same layout as bandGlobalDistances.
+     @var scoreRows
+     Two rolling rows and a row of distances, 3 * maximumRowCount, used by the score only and subsequence searches.
+     @var subsequenceStarts
+     The span start carried along with each cell of scoreRows by DTW32_findSubsequence.
+     @var subsequencePhi
+     The packed predecessor choices of the last subsequence search, palette row by palette row, NULL until DTW32_reserveSubsequenceTraceback is called.
+     @var subsequenceCellCount
+     The number of cells subsequencePhi holds, maximumRowCount * the palette row count it was reserved for.
+     @var subsequenceInputRowCount
+     The input row count of the last subsequence search.
+     @var subsequenceMatch
+     The span found by the last subsequence search, traced by DTW32_traceSubsequenceWarpPath.
+     @var tileBuffer
+     One block of the global distance matrix with its halo row and column, (DTW32_TILE_SIZE + 1)^2.
+     @var tileDiagonals
+     The predecessors, distances, results and traceback choices of one anti-diagonal of a block, 6 * DTW32_TILE_SIZE.
+     @var threadCount
+     The number of threads a full comparison above parallelCellThreshold cells is accumulated on, 1 until DTW32_setParallelAccumulation is called.
+     @var parallelCellThreshold
+     The cell count above which a full comparison is accumulated on threadCount threads.
+     @var threadTileBuffers
+     A tileBuffer for each thread.
+     @var threadTileDiagonals
+     A tileDiagonals for each thread.
+     @var tileRowProgress
+     The number of finished blocks in each row of blocks during a parallel accumulation.
+     @var threads
+     The threadCount - 1 worker threads started by DTW32_setParallelAccumulation, they wait on threadStart between comparisons.
+     @var tileWorkers
+     The block row share of the calling thread and of each worker thread.
+     @var threadLock
+     Guards threadGeneration, runningThreadCount and stopThreads.
+     @var threadStart
+     Signalled when a parallel accumulation is handed to the worker threads or they are stopped.
+     @var threadFinish
+     Signalled when the last worker thread finishes its share of an accumulation.
+     @var threadGeneration
+     Incremented for each parallel accumulation handed to the worker threads.
+     @var runningThreadCount
+     The worker threads still accumulating the current comparison.
+     @var stopThreads
+     Set when the worker threads should exit.
+     @var laneRows
+     Two rolling rows and a row of distances for DTW32_CANDIDATE_LANE_COUNT candidates, with the lanes of each cell adjacent.
+     @var workspacePool
+     The pool every buffer above is acquired from and released back to.
+     @var ownsWorkspacePool
+     True when the pool was created for this pseudoclass alone and is deleted with it.
      */
     typedef struct DTW32
     {
@@ -37,18 +211,52 @@ extern "C"
         size_t maximumColumnCount;
         size_t maximumElementCount;
         
-        Float32 *ones;
-        
-        Float32 *distanceMatrix;
         Float32 *globalDistanceMatrix;
-        Float32 *multiplicationTemp;
         Float32 *inputTemp;
         Float32 *comparisonDataTemp;
-        Float32 *normalisationMatrix;
         
-        Float32 *phi;
+        UInt8 *phi;
         Float32 *p;
         Float32 *q;
+        DTW32_WarpSegment *warpSegments;
+        size_t warpSegmentCount;
+        
+        Float32 *diagonalBuffers;
+        Float32 *diagonalDistances;
+        Float32 *diagonalTraceback;
+        DTW32_SelectFunction selectDiagonal;
+        
+        DTWConstraint constraint;
+        Float32 constraintParameter;
+        size_t bandWidth;
+        size_t *bandRowStarts;
+        size_t *bandRowEnds;
+        Float32 *bandGlobalDistances;
+        UInt8 *bandPhi;
+        Float32 *scoreRows;
+        size_t *subsequenceStarts;
+        UInt8 *subsequencePhi;
+        size_t subsequenceCellCount;
+        size_t subsequenceInputRowCount;
+        DTW32_SubsequenceMatch subsequenceMatch;
+        Float32 *tileBuffer;
+        Float32 *tileDiagonals;
+        size_t threadCount;
+        size_t parallelCellThreshold;
+        Float32 *threadTileBuffers;
+        Float32 *threadTileDiagonals;
+        size_t *tileRowProgress;
+        pthread_t *threads;
+        struct DTW32_TileWorker *tileWorkers;
+        pthread_mutex_t threadLock;
+        pthread_cond_t threadStart;
+        pthread_cond_t threadFinish;
+        size_t threadGeneration;
+        size_t runningThreadCount;
+        Boolean stopThreads;
+        Float32 *laneRows;
+        DTWWorkspacePool32 *workspacePool;
+        Boolean ownsWorkspacePool;
         
     } DTW32;
     /*!
@@ -64,6 +272,36 @@ extern "C"
      Returns a DTW32 pseudoclass.
      */
     DTW32 *DTW32_new(size_t rowCount, size_t maximumColumnCount);
+    
+    /*!
+     Construct a DTW32 structure which only considers and stores the cells inside a global path constraint, using O(rowCount * band width) memory.
+     @param constraint
+     The path constraint.
+     @param constraintParameter
+     The Sakoe-Chiba radius in rows, or the Itakura slope which must be greater than 1. The band is sized for the square comparison of rowCount rows and never grows, the rows of a steeper comparison are clamped to that width along the diagonal and a comparison too steep for any path to fit in them scores INFINITY.
+     */
+    DTW32 *DTW32_newConstrained(size_t rowCount,
+                                size_t maximumColumnCount,
+                                DTWConstraint constraint,
+                                Float32 constraintParameter);
+    
+    /*!
+     Construct a DTW32 structure whose buffers are acquired from a shared workspace pool, so pseudoclasses for several bands or worker threads reuse each other's memory once released.
+     @param workspacePool
+     The pool to acquire from, NULL for a pool private to the pseudoclass. It must outlive the pseudoclass.
+     */
+    DTW32 *DTW32_newWithPool(size_t rowCount,
+                             size_t maximumColumnCount,
+                             DTWWorkspacePool32 *workspacePool);
+    
+    /*!
+     DTW32_newConstrained acquiring its buffers from a shared workspace pool.
+     */
+    DTW32 *DTW32_newConstrainedWithPool(size_t rowCount,
+                                        size_t maximumColumnCount,
+                                        DTWConstraint constraint,
+                                        Float32 constraintParameter,
+                                        DTWWorkspacePool32 *workspacePool);
     /*!
      Destruct a DTW32 structure.
      @param self
@@ -71,6 +309,26 @@ extern "C"
      */
     void DTW32_delete(DTW32 *self);
     
+    /*!
+     Hand the global distance and traceback matrices, which are acquired at construction, back to the workspace pool while the pseudoclass is idle. The next full comparison acquires them again, off the audio thread if possible.
+     @discussion
+     DTW32_traceWarpPath can not be called until then.
+     */
+    void DTW32_releaseMatrices(DTW32 *self);
+    
+    /*!
+     Accumulate full comparisons of more than cellThreshold cells on several threads, blocks of DTW32_TILE_SIZE are handed out by block row and each waits only for the block above it. The results are identical to the single threaded accumulation.
+     @param threadCount
+     The number of threads including the calling thread, 0 for one per processor.
+     @param cellThreshold
+     Input rows * comparison rows above which the threads are used.
+     @discussion
+     Only for pseudoclasses from DTW32_new. The worker threads are started here and wait between comparisons until DTW32_delete or the next call stops them, if some cannot be started the accumulation runs on those that were, or on the calling thread alone.
+     */
+    void DTW32_setParallelAccumulation(DTW32 *self,
+                                       size_t threadCount,
+                                       size_t cellThreshold);
+    
     /*!
      @functiongroup Processing
      */
@@ -93,10 +351,199 @@ extern "C"
                                      size_t comparisonDataRowCount,
                                      size_t currentColumnCount);
     
+    /*!
+     Calculate only the similarity value of two input matrices, keeping two rows of the global distance matrix and giving up as soon as a whole row reaches abandonThreshold.
+     @param abandonThreshold
+     The score to beat, usually the best score found so far in a search.
+     @return
+     The similarity value, or INFINITY if the comparison was abandoned. Nothing is left to trace, call DTW32_getSimilarityScore on the chosen comparison before DTW32_traceWarpPath.
+     */
+    Float32 DTW32_getSimilarityScoreOnly(DTW32 *self,
+                                         Float32 *inputData,
+                                         size_t inputRowCount,
+                                         Float32 *comparisonData,
+                                         size_t comparisonDataRowCount,
+                                         size_t currentColumnCount,
+                                         Float32 abandonThreshold);
+    
+    /*!
+     Calculate only the similarity value like DTW32_getSimilarityScoreOnly, reading the distances from a slice of a matrix from DTW32_calculateCosineDistanceMatrix or DTW32_calculateNormalisedDistanceMatrix instead of calculating them.
+     @param distanceMatrix
+     The distance between input row 0 and comparison row 0, row i starts distanceMatrixRowStride elements later.
+     */
+    Float32 DTW32_getSimilarityScoreFromDistances(DTW32 *self,
+                                                  const Float32 *distanceMatrix,
+                                                  size_t distanceMatrixRowStride,
+                                                  size_t inputRowCount,
+                                                  size_t comparisonDataRowCount,
+                                                  Float32 abandonThreshold);
+    
+    /*!
+     Calculate only the similarity values of DTW32_CANDIDATE_LANE_COUNT comparisons at once, one candidate per vector lane. Every candidate shares the input and the row count so the recurrences run in lockstep and each cell is a lane-wise minimum.
+     @param normalisedInputData
+     The input with unit length rows.
+     @param candidateLanes
+     One group of candidates from DTW32_transposeCandidateLanes.
+     @param laneCount
+     The number of real candidates in the group, the zeroed padding lanes after them are ignored.
+     @param abandonThreshold
+     The group is abandoned once a whole row of every real lane reaches this value.
+     @param scores
+     Output, DTW32_CANDIDATE_LANE_COUNT in length, INFINITY for every lane if the group was abandoned. Only the first laneCount are meaningful.
+     */
+    void DTW32_getSimilarityScoresLanes(DTW32 *self,
+                                        Float32 *normalisedInputData,
+                                        size_t inputRowCount,
+                                        const Float32 *candidateLanes,
+                                        size_t laneCount,
+                                        size_t comparisonDataRowCount,
+                                        size_t columnCount,
+                                        Float32 abandonThreshold,
+                                        Float32 *scores);
+    
+    /*!
+     Transpose palette candidates into groups of DTW32_CANDIDATE_LANE_COUNT in structure of arrays layout, element k of row j of the candidate in lane l is at (j * columnCount + k) * DTW32_CANDIDATE_LANE_COUNT + l. Lanes past candidateCount in the last group are zero.
+     @param candidateStarts
+     The first palette row of each candidate.
+     @param candidateLanes
+     Output, DTW32_candidateLaneGroupCount(candidateCount) * comparisonDataRowCount * columnCount * DTW32_CANDIDATE_LANE_COUNT in size.
+     */
+    void DTW32_transposeCandidateLanes(Float32 *paletteData,
+                                       size_t columnCount,
+                                       const size_t *candidateStarts,
+                                       size_t candidateCount,
+                                       size_t comparisonDataRowCount,
+                                       Float32 *candidateLanes);
+    
+    /*!
+     The number of lane groups needed for candidateCount candidates.
+     */
+    size_t DTW32_candidateLaneGroupCount(size_t candidateCount);
+    
+    /*!
+     @functiongroup Distance matrices
+     */
     
+    /*!
+     The euclidean norm of each row of a matrix.
+     */
+    void DTW32_calculateRowNorms(Float32 *data,
+                                 size_t rowCount,
+                                 size_t columnCount,
+                                 Float32 *norms);
+    
+    /*!
+     Cosine distances between every input row and every palette row with a single matrix multiplication, so all the candidate windows of a palette can be compared as slices of one matrix.
+     @param inputNorms
+     The input row norms from DTW32_calculateRowNorms.
+     @param paletteNorms
+     The palette row norms from DTW32_calculateRowNorms, these only need calculating once per palette.
+     @param distanceMatrix
+     Output, inputRowCount * paletteRowCount in size.
+     */
+    void DTW32_calculateCosineDistanceMatrix(Float32 *inputData,
+                                             const Float32 *inputNorms,
+                                             size_t inputRowCount,
+                                             Float32 *paletteData,
+                                             const Float32 *paletteNorms,
+                                             size_t paletteRowCount,
+                                             size_t columnCount,
+                                             Float32 *distanceMatrix);
     
-    void DTW32_traceWarpPath(DTW32 *self,
-                             size_t *warpPath);
+    /*!
+     Cosine distances like DTW32_calculateCosineDistanceMatrix for rows that are already unit length, so each distance is 1 - dot and no norms or divisions are needed.
+     @param distanceMatrix
+     Output, inputRowCount * paletteRowCount in size.
+     */
+    void DTW32_calculateNormalisedDistanceMatrix(Float32 *normalisedInputData,
+                                                 size_t inputRowCount,
+                                                 Float32 *normalisedPaletteData,
+                                                 size_t paletteRowCount,
+                                                 size_t columnCount,
+                                                 Float32 *distanceMatrix);
+    
+    /*!
+     Trace the warp path of the last full comparison.
+     @param warpPath
+     Output, inputRowCount in length, the 1 based comparison row that each input row is first aligned with.
+     @return
+     The number of run-length segments the path was compacted into, left in warpSegments.
+     */
+    size_t DTW32_traceWarpPath(DTW32 *self,
+                               size_t *warpPath);
+    
+    /*!
+     @functiongroup Lower bounds
+     */
+    
+    /*!
+     LB_Kim lower bound, the cosine distances of the first and last row pairs which every warp path must contain.
+     */
+    Float32 DTW32_lowerBoundKim(Float32 *inputData,
+                                size_t inputRowCount,
+                                Float32 *comparisonData,
+                                size_t comparisonDataRowCount,
+                                size_t columnCount);
+    
+    /*!
+     LB_Keogh lower bound against an upper envelope from DTW32_calculateUpperEnvelope. As the features are non-negative, each input row is at least 1 - dot(row / |row|, envelope) away from any comparison row under the envelope.
+     @param upperEnvelope
+     The envelope rows aligned with the input rows, inputRowCount * columnCount in size.
+     @param abandonThreshold
+     Summation stops once the bound reaches this value.
+     */
+    Float32 DTW32_lowerBoundKeogh(Float32 *inputData,
+                                  size_t inputRowCount,
+                                  Float32 *upperEnvelope,
+                                  size_t columnCount,
+                                  Float32 abandonThreshold);
+    
+    /*!
+     Calculate the element-wise maximum of the unit-normalised rows of data within radius rows either side of each row.
+     @param upperEnvelope
+     Output, rowCount * columnCount in size.
+     */
+    void DTW32_calculateUpperEnvelope(Float32 *data,
+                                      size_t rowCount,
+                                      size_t columnCount,
+                                      size_t radius,
+                                      Float32 *upperEnvelope);
+    
+    /*!
+     @functiongroup Subsequence search
+     */
+    
+    /*!
+     Find the palette span that the input aligns to best, with an open beginning and end, in a single pass over the palette. Cells are accumulated one palette row at a time so only two columns of inputRowCount are kept, the span start is carried along the cheapest predecessor.
+     @param inputRowCount
+     The input row count, at most maximumRowCount.
+     @return
+     The start and end palette rows and the score of the best span, the earliest end wins ties, a score of INFINITY when nothing matched. The path constraint is not applied.
+     @discussion
+     The predecessor choices are recorded for DTW32_traceSubsequenceWarpPath when a traceback for at least paletteRowCount rows has been reserved.
+     */
+    DTW32_SubsequenceMatch DTW32_findSubsequence(DTW32 *self,
+                                                 Float32 *inputData,
+                                                 size_t inputRowCount,
+                                                 Float32 *paletteData,
+                                                 size_t paletteRowCount,
+                                                 size_t columnCount);
+    
+    /*!
+     Acquire the traceback DTW32_findSubsequence records into, maximumRowCount * paletteRowCount cells at 2 bits each, so the winning span can be traced without comparing it again.
+     @param paletteRowCount
+     The longest palette that will be searched.
+     */
+    void DTW32_reserveSubsequenceTraceback(DTW32 *self,
+                                           size_t paletteRowCount);
+    
+    /*!
+     Trace the warp path of the span found by the last DTW32_findSubsequence, from its end back to the input's first row.
+     @param warpPath
+     Output, inputRowCount in length, the 1 based row counted from the span start that each input row is first aligned with. Every input row is aligned with the row of the same number when the search found no span.
+     */
+    void DTW32_traceSubsequenceWarpPath(DTW32 *self,
+                                        size_t *warpPath);
 
     
 #ifdef __cplusplus
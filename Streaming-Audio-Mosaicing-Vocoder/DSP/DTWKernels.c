@@ -0,0 +1,130 @@
+    //
+    //  DTWKernels.c
+    //  Streaming-Audio-Mosaicing-Vocoder
+    //
+
+#import "DTWKernels.h"
+#import <math.h>
+
+/*
+ Expands to DTW32_scoreKernel_C_N. The two rows live on the stack and are swapped by parity, the first
+ row and column are peeled so the interior cell has no border tests left once the loops are unrolled.
+ */
+#define DTW32_SCORE_KERNEL(C, N)                                                                        \
+static Float32 DTW32_scoreKernel_##C##_##N(const Float32 *normalisedInputData,                          \
+                                           const Float32 *normalisedComparisonData,                     \
+                                           Float32 abandonThreshold)                                    \
+{                                                                                                       \
+    Float32 rows[2][N];                                                                                 \
+                                                                                                        \
+    for (size_t i = 0; i < N; ++i) {                                                                    \
+                                                                                                        \
+        const Float32 *input = &normalisedInputData[i * C];                                             \
+        const Float32 *previousRow = rows[(i + 1) & 1];                                                 \
+        Float32 *row = rows[i & 1];                                                                     \
+        Float32 rowMinimum = INFINITY;                                                                  \
+                                                                                                        \
+        for (size_t j = 0; j < N; ++j) {                                                                \
+                                                                                                        \
+            const Float32 *comparison = &normalisedComparisonData[j * C];                               \
+            Float32 distance = 1.f;                                                                     \
+                                                                                                        \
+            for (size_t k = 0; k < C; ++k) {                                                            \
+                                                                                                        \
+                distance -= input[k] * comparison[k];                                                   \
+            }                                                                                           \
+                                                                                                        \
+            Float32 best;                                                                               \
+                                                                                                        \
+            if (i == 0) {                                                                               \
+                                                                                                        \
+                best = j == 0 ? 0 : row[j - 1];                                                         \
+            }                                                                                           \
+            else if (j == 0) {                                                                          \
+                                                                                                        \
+                best = previousRow[0];                                                                  \
+            }                                                                                           \
+            else {                                                                                      \
+                                                                                                        \
+                best = previousRow[j - 1];                                                              \
+                best = previousRow[j] < best ? previousRow[j] : best;                                   \
+                best = row[j - 1] < best ? row[j - 1] : best;                                           \
+            }                                                                                           \
+                                                                                                        \
+            row[j] = distance + best;                                                                   \
+            rowMinimum = row[j] < rowMinimum ? row[j] : rowMinimum;                                     \
+        }                                                                                               \
+                                                                                                        \
+        if (rowMinimum >= abandonThreshold) {                                                           \
+                                                                                                        \
+            return INFINITY;                                                                            \
+        }                                                                                               \
+    }                                                                                                   \
+                                                                                                        \
+    return rows[(N - 1) & 1][N - 1];                                                                    \
+}
+
+#define DTW32_SCORE_KERNELS_FOR_ROW_COUNT(N)                                                            \
+DTW32_SCORE_KERNEL(1, N)                                                                                \
+DTW32_SCORE_KERNEL(2, N)                                                                                \
+DTW32_SCORE_KERNEL(3, N)                                                                                \
+DTW32_SCORE_KERNEL(4, N)                                                                                \
+DTW32_SCORE_KERNEL(5, N)                                                                                \
+DTW32_SCORE_KERNEL(6, N)                                                                                \
+DTW32_SCORE_KERNEL(7, N)                                                                                \
+DTW32_SCORE_KERNEL(8, N)
+
+#define DTW32_SCORE_KERNEL_TABLE_ROW(N)                                                                 \
+{                                                                                                       \
+    DTW32_scoreKernel_1_##N,                                                                            \
+    DTW32_scoreKernel_2_##N,                                                                            \
+    DTW32_scoreKernel_3_##N,                                                                            \
+    DTW32_scoreKernel_4_##N,                                                                            \
+    DTW32_scoreKernel_5_##N,                                                                            \
+    DTW32_scoreKernel_6_##N,                                                                            \
+    DTW32_scoreKernel_7_##N,                                                                            \
+    DTW32_scoreKernel_8_##N                                                                             \
+}
+
+DTW32_SCORE_KERNELS_FOR_ROW_COUNT(2)
+DTW32_SCORE_KERNELS_FOR_ROW_COUNT(4)
+DTW32_SCORE_KERNELS_FOR_ROW_COUNT(8)
+DTW32_SCORE_KERNELS_FOR_ROW_COUNT(16)
+DTW32_SCORE_KERNELS_FOR_ROW_COUNT(32)
+
+/*
+ Indexed by log2(rowCount) - 1 and columnCount - 1.
+ */
+static const DTW32_ScoreKernel DTW32_scoreKernels[5][DTW32_SCORE_KERNEL_MAXIMUM_COLUMN_COUNT] =
+{
+    DTW32_SCORE_KERNEL_TABLE_ROW(2),
+    DTW32_SCORE_KERNEL_TABLE_ROW(4),
+    DTW32_SCORE_KERNEL_TABLE_ROW(8),
+    DTW32_SCORE_KERNEL_TABLE_ROW(16),
+    DTW32_SCORE_KERNEL_TABLE_ROW(32)
+};
+
+DTW32_ScoreKernel DTW32_getScoreKernel(size_t rowCount,
+                                       size_t columnCount)
+{
+    if (columnCount == 0 || columnCount > DTW32_SCORE_KERNEL_MAXIMUM_COLUMN_COUNT) {
+        
+        return NULL;
+    }
+    
+    switch (rowCount) {
+            
+        case 2:
+            return DTW32_scoreKernels[0][columnCount - 1];
+        case 4:
+            return DTW32_scoreKernels[1][columnCount - 1];
+        case 8:
+            return DTW32_scoreKernels[2][columnCount - 1];
+        case 16:
+            return DTW32_scoreKernels[3][columnCount - 1];
+        case 32:
+            return DTW32_scoreKernels[4][columnCount - 1];
+        default:
+            return NULL;
+    }
+}
@@ -0,0 +1,44 @@
+    //
+    //  DTWKernels.h
+    //  Streaming-Audio-Mosaicing-Vocoder
+    //
+
+#import <MacTypes.h>
+#import <stdlib.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    
+    /*!
+     A score only dynamic time warping comparison compiled for one column count and one square row count, so the distance and accumulation loops have fixed trip counts and are unrolled. Both inputs have unit length rows, distances are 1 - dot and the predecessor ties and abandoning follow <b>DTW32_getSimilarityScoreFromDistances</b> without a path constraint.
+     @param normalisedInputData
+     The input rows.
+     @param normalisedComparisonData
+     The comparison rows, the same row count as the input.
+     @param abandonThreshold
+     The comparison gives up once a whole row reaches this value.
+     @return
+     The similarity value, or INFINITY if the comparison was abandoned.
+     */
+    typedef Float32 (*DTW32_ScoreKernel)(const Float32 *normalisedInputData,
+                                         const Float32 *normalisedComparisonData,
+                                         Float32 abandonThreshold);
+    
+    /*!
+     The largest column count with specialised kernels, row counts of 2, 4, 8, 16 and 32 are specialised.
+     */
+#define DTW32_SCORE_KERNEL_MAXIMUM_COLUMN_COUNT 8
+    
+    /*!
+     Look up the specialised kernel for a comparison.
+     @return
+     The kernel, or NULL if rowCount and columnCount were not specialised.
+     */
+    DTW32_ScoreKernel DTW32_getScoreKernel(size_t rowCount,
+                                           size_t columnCount);
+    
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,200 @@
+    //
+    //  DTWWorkspace.c
+    //  Streaming-Audio-Mosaicing-Vocoder
+    //
+
+#import "DTWWorkspace.h"
+#import <stdio.h>
+#import <string.h>
+
+/*
+ Every buffer is preceded by its header, padded out to a cache line so the data handed out starts on one.
+ */
+#define DTWWORKSPACE_ALIGNMENT 64
+
+struct DTWWorkspaceBuffer32
+{
+    DTWWorkspaceBuffer32 *next;
+    size_t capacity;
+    DTWWorkspaceRole role;
+};
+
+static const char *DTWWorkspacePool32_roleNames[kDTWWorkspaceRoleCount] =
+{
+    "global distances",
+    "traceback",
+    "norms",
+    "path",
+    "score rows",
+    "diagonals",
+    "tiles",
+    "band"
+};
+
+static inline void *DTWWorkspaceBuffer32_getData(DTWWorkspaceBuffer32 *buffer)
+{
+    return (UInt8 *)buffer + DTWWORKSPACE_ALIGNMENT;
+}
+
+static inline DTWWorkspaceBuffer32 *DTWWorkspaceBuffer32_getBuffer(void *data)
+{
+    return (DTWWorkspaceBuffer32 *)((UInt8 *)data - DTWWORKSPACE_ALIGNMENT);
+}
+
+DTWWorkspacePool32 *DTWWorkspacePool32_new(void)
+{
+    DTWWorkspacePool32 *self = calloc(1, sizeof(DTWWorkspacePool32));
+    
+    pthread_mutex_init(&self->lock, NULL);
+    
+    return self;
+}
+
+void DTWWorkspacePool32_delete(DTWWorkspacePool32 *self)
+{
+    DTWWorkspacePool32_trim(self);
+    
+    if (self->lentByteCount != 0) {
+    
+        printf("DTWWorkspacePool32_delete, %zu bytes are still acquired, exiting\n", self->lentByteCount);
+        exit(-1);
+    }
+    
+    pthread_mutex_destroy(&self->lock);
+    free(self);
+    self = NULL;
+}
+
+void *DTWWorkspacePool32_acquire(DTWWorkspacePool32 *self,
+                                 DTWWorkspaceRole role,
+                                 size_t byteCount)
+{
+    byteCount = byteCount > 0 ? byteCount : 1;
+    
+    pthread_mutex_lock(&self->lock);
+    
+    DTWWorkspaceBuffer32 **best = NULL;
+    
+    for (DTWWorkspaceBuffer32 **link = &self->idleBuffers[role]; *link != NULL; link = &(*link)->next) {
+    
+        if ((*link)->capacity >= byteCount && (best == NULL || (*link)->capacity < (*best)->capacity)) {
+    
+            best = link;
+        }
+    }
+    
+    DTWWorkspaceBuffer32 *buffer;
+    
+    if (best != NULL) {
+    
+        buffer = *best;
+        *best = buffer->next;
+    }
+    else {
+    
+        void *block = NULL;
+    
+        if (posix_memalign(&block, DTWWORKSPACE_ALIGNMENT, DTWWORKSPACE_ALIGNMENT + byteCount) != 0) {
+    
+            printf("DTWWorkspacePool32_acquire, could not allocate %zu bytes, exiting\n", byteCount);
+            exit(-1);
+        }
+    
+        buffer = block;
+        buffer->capacity = byteCount;
+        buffer->role = role;
+    
+        self->roleByteCounts[role] += byteCount;
+        self->byteCount += byteCount;
+    
+        if (self->roleByteCounts[role] > self->rolePeakByteCounts[role]) {
+    
+            self->rolePeakByteCounts[role] = self->roleByteCounts[role];
+        }
+    
+        if (self->byteCount > self->peakByteCount) {
+    
+            self->peakByteCount = self->byteCount;
+        }
+    }
+    
+    buffer->next = NULL;
+    self->lentByteCount += buffer->capacity;
+    
+    if (self->lentByteCount > self->peakLentByteCount) {
+    
+        self->peakLentByteCount = self->lentByteCount;
+    }
+    
+    pthread_mutex_unlock(&self->lock);
+    
+    return DTWWorkspaceBuffer32_getData(buffer);
+}
+
+void DTWWorkspacePool32_release(DTWWorkspacePool32 *self,
+                                void *data)
+{
+    if (data == NULL) {
+    
+        return;
+    }
+    
+    DTWWorkspaceBuffer32 *buffer = DTWWorkspaceBuffer32_getBuffer(data);
+    
+    pthread_mutex_lock(&self->lock);
+    
+    buffer->next = self->idleBuffers[buffer->role];
+    self->idleBuffers[buffer->role] = buffer;
+    self->lentByteCount -= buffer->capacity;
+    
+    pthread_mutex_unlock(&self->lock);
+}
+
+void DTWWorkspacePool32_trim(DTWWorkspacePool32 *self)
+{
+    pthread_mutex_lock(&self->lock);
+    
+    for (size_t role = 0; role < kDTWWorkspaceRoleCount; ++role) {
+    
+        while (self->idleBuffers[role] != NULL) {
+    
+            DTWWorkspaceBuffer32 *buffer = self->idleBuffers[role];
+            self->idleBuffers[role] = buffer->next;
+            self->roleByteCounts[role] -= buffer->capacity;
+            self->byteCount -= buffer->capacity;
+            free(buffer);
+        }
+    }
+    
+    pthread_mutex_unlock(&self->lock);
+}
+
+size_t DTWWorkspacePool32_getPeakByteCount(DTWWorkspacePool32 *self)
+{
+    pthread_mutex_lock(&self->lock);
+    size_t peakByteCount = self->peakByteCount;
+    pthread_mutex_unlock(&self->lock);
+    
+    return peakByteCount;
+}
+
+void DTWWorkspacePool32_print(DTWWorkspacePool32 *self)
+{
+    pthread_mutex_lock(&self->lock);
+    
+    printf("DTW workspace, %zu bytes allocated, %zu acquired, peak %zu allocated, %zu acquired\n",
+           self->byteCount,
+           self->lentByteCount,
+           self->peakByteCount,
+           self->peakLentByteCount);
+    
+    for (size_t role = 0; role < kDTWWorkspaceRoleCount; ++role) {
+    
+        printf("    %-16s %10zu bytes, peak %10zu\n",
+               DTWWorkspacePool32_roleNames[role],
+               self->roleByteCounts[role],
+               self->rolePeakByteCounts[role]);
+    }
+    
+    pthread_mutex_unlock(&self->lock);
+}
@@ -0,0 +1,134 @@
+    //
+    //  DTWWorkspace.h
+    //  Streaming-Audio-Mosaicing-Vocoder
+    //
+
+#import <MacTypes.h>
+#import <stdlib.h>
+#import <pthread.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    
+    /*!
+     The roles a DTW32 workspace buffer is acquired for, buffers are only handed back out for the role they were allocated for.
+     @constant kDTWWorkspaceRole_GlobalDistances
+     The padded global distance matrix, or the band of it kept by a constrained comparison.
+     @constant kDTWWorkspaceRole_Traceback
+     The packed predecessor choices.
+     @constant kDTWWorkspaceRole_Norms
+     The input and comparison row norms.
+     @constant kDTWWorkspaceRole_Path
+     The warp path, its segments and the subsequence start positions.
+     @constant kDTWWorkspaceRole_ScoreRows
+     The rolling rows of the score only and candidate lane comparisons.
+     @constant kDTWWorkspaceRole_Diagonals
+     The rolling anti-diagonals of the wavefront accumulation.
+     @constant kDTWWorkspaceRole_Tiles
+     The blocks, block diagonals and block row progress of the tiled accumulations.
+     @constant kDTWWorkspaceRole_Band
+     The first and last cell of each row of a path constraint.
+     */
+    typedef enum DTWWorkspaceRole
+    {
+        kDTWWorkspaceRole_GlobalDistances,
+        kDTWWorkspaceRole_Traceback,
+        kDTWWorkspaceRole_Norms,
+        kDTWWorkspaceRole_Path,
+        kDTWWorkspaceRole_ScoreRows,
+        kDTWWorkspaceRole_Diagonals,
+        kDTWWorkspaceRole_Tiles,
+        kDTWWorkspaceRole_Band,
+        kDTWWorkspaceRoleCount
+    } DTWWorkspaceRole;
+    
+    typedef struct DTWWorkspaceBuffer32 DTWWorkspaceBuffer32;
+    
+    /*!
+     @class DTWWorkspacePool32
+     @abstract A thread safe pool of DTW32 workspace buffers. Buffers released by one pseudoclass are handed to the next one acquiring the same role, so several DTW32s on different bands or worker threads share memory instead of each holding their own.
+     @var lock
+     Guards the idle lists and counters, acquiring and releasing can happen on any thread.
+     @var idleBuffers
+     A list of released buffers for each role.
+     @var roleByteCounts
+     The bytes allocated for each role, lent out or idle.
+     @var rolePeakByteCounts
+     The largest value of each roleByteCounts.
+     @var byteCount
+     The bytes allocated for all roles.
+     @var peakByteCount
+     The largest value of byteCount, the footprint of the pool.
+     @var lentByteCount
+     The bytes currently acquired and not yet released.
+     @var peakLentByteCount
+     The largest value of lentByteCount, the footprint the pseudoclasses using the pool actually needed at once.
+     */
+    typedef struct DTWWorkspacePool32
+    {
+        pthread_mutex_t lock;
+        DTWWorkspaceBuffer32 *idleBuffers[kDTWWorkspaceRoleCount];
+        size_t roleByteCounts[kDTWWorkspaceRoleCount];
+        size_t rolePeakByteCounts[kDTWWorkspaceRoleCount];
+        size_t byteCount;
+        size_t peakByteCount;
+        size_t lentByteCount;
+        size_t peakLentByteCount;
+    
+    } DTWWorkspacePool32;
+    
+    /*!
+     @functiongroup Construct/Destruct
+     */
+    
+    /*!
+     Construct an empty DTWWorkspacePool32.
+     */
+    DTWWorkspacePool32 *DTWWorkspacePool32_new(void);
+    
+    /*!
+     Destroy a DTWWorkspacePool32 and its idle buffers, every pseudoclass acquiring from it must be deleted first.
+     */
+    void DTWWorkspacePool32_delete(DTWWorkspacePool32 *self);
+    
+    /*!
+     @functiongroup Buffers
+     */
+    
+    /*!
+     Take a buffer of at least byteCount bytes for a role, the smallest idle buffer of that role which is large enough is reused before a new one is allocated. The contents are left as the last user wrote them, every DTW32 buffer is written before it is read.
+     */
+    void *DTWWorkspacePool32_acquire(DTWWorkspacePool32 *self,
+                                     DTWWorkspaceRole role,
+                                     size_t byteCount);
+    
+    /*!
+     Hand a buffer from DTWWorkspacePool32_acquire back to the pool, NULL is ignored.
+     */
+    void DTWWorkspacePool32_release(DTWWorkspacePool32 *self,
+                                    void *buffer);
+    
+    /*!
+     Free the idle buffers, the peak counters are kept.
+     */
+    void DTWWorkspacePool32_trim(DTWWorkspacePool32 *self);
+    
+    /*!
+     @functiongroup Reporting
+     */
+    
+    /*!
+     The most bytes the pool has held at once.
+     */
+    size_t DTWWorkspacePool32_getPeakByteCount(DTWWorkspacePool32 *self);
+    
+    /*!
+     Print the current and peak bytes of each role.
+     */
+    void DTWWorkspacePool32_print(DTWWorkspacePool32 *self);
+    
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,407 @@
+    //
+    //  FastDTW.c
+    //  Streaming-Audio-Mosaicing-Vocoder
+    //
+
+#import "FastDTW.h"
+#import "DTW.h"
+#import <stdio.h>
+#import <string.h>
+#import <math.h>
+#import <Accelerate/Accelerate.h>
+
+/*
+ The coarsest level is compared in full, but one of its sides has at most radius + 2 rows. At a finer level
+ the projected path covers at most 2 (n + m) + 4 cells. The path is monotone, so widening each row to its
+ neighbours within radius adds at most 2 radius m cells, and widening by radius either side adds
+ (2 radius + 1) n more. No window is larger than the full matrix.
+ */
+static size_t FastDTW32_getWindowCapacity(size_t maximumRowCount,
+                                          size_t radius)
+{
+    size_t capacity = (4 * radius + 5) * maximumRowCount + 4;
+    
+    return capacity < maximumRowCount * maximumRowCount ? capacity : maximumRowCount * maximumRowCount;
+}
+
+FastDTW32 *FastDTW32_new(size_t maximumRowCount,
+                         size_t maximumColumnCount,
+                         size_t radius)
+{
+    FastDTW32 *self = calloc(1, sizeof(FastDTW32));
+    
+    self->maximumRowCount = maximumRowCount;
+    self->maximumColumnCount = maximumColumnCount;
+    self->radius = radius;
+    
+    size_t pyramidRowCount = 2 * maximumRowCount + FASTDTW32_MAXIMUM_LEVEL_COUNT;
+    
+    self->inputPyramid = calloc(pyramidRowCount * maximumColumnCount, sizeof(Float32));
+    self->comparisonPyramid = calloc(pyramidRowCount * maximumColumnCount, sizeof(Float32));
+    self->inputNorms = calloc(pyramidRowCount, sizeof(Float32));
+    self->comparisonNorms = calloc(pyramidRowCount, sizeof(Float32));
+    self->rowStarts = calloc(maximumRowCount, sizeof(size_t));
+    self->rowEnds = calloc(maximumRowCount, sizeof(size_t));
+    self->rowOffsets = calloc(maximumRowCount + 1, sizeof(size_t));
+    self->expandedStarts = calloc(maximumRowCount, sizeof(size_t));
+    self->expandedEnds = calloc(maximumRowCount, sizeof(size_t));
+    self->pathRows = calloc(2 * maximumRowCount, sizeof(size_t));
+    self->pathColumns = calloc(2 * maximumRowCount, sizeof(size_t));
+    
+    self->windowCapacity = FastDTW32_getWindowCapacity(maximumRowCount, radius);
+    self->cost = calloc(self->windowCapacity, sizeof(Float32));
+    self->traceback = calloc(self->windowCapacity, sizeof(UInt8));
+    
+    return self;
+}
+
+void FastDTW32_delete(FastDTW32 *self)
+{
+    free(self->inputPyramid);
+    free(self->comparisonPyramid);
+    free(self->inputNorms);
+    free(self->comparisonNorms);
+    free(self->rowStarts);
+    free(self->rowEnds);
+    free(self->rowOffsets);
+    free(self->expandedStarts);
+    free(self->expandedEnds);
+    free(self->pathRows);
+    free(self->pathColumns);
+    free(self->cost);
+    free(self->traceback);
+    free(self);
+    self = NULL;
+}
+
+/*
+ Writes the halved copy of rowCount rows at source to destination, each row the mean of a pair of rows
+ and the last row copied on its own when rowCount is odd. Returns the halved row count.
+ */
+static size_t FastDTW32_coarsen(const Float32 *source,
+                                size_t rowCount,
+                                size_t columnCount,
+                                Float32 *destination)
+{
+    size_t coarseRowCount = (rowCount + 1) / 2;
+    
+    for (size_t i = 0; i < coarseRowCount; ++i) {
+        
+        const Float32 *first = &source[2 * i * columnCount];
+        
+        if (2 * i + 1 < rowCount) {
+            
+            const Float32 *second = &first[columnCount];
+            
+            for (size_t k = 0; k < columnCount; ++k) {
+                
+                destination[i * columnCount + k] = 0.5f * (first[k] + second[k]);
+            }
+        }
+        else {
+            
+            memcpy(&destination[i * columnCount], first, columnCount * sizeof(Float32));
+        }
+    }
+    
+    return coarseRowCount;
+}
+
+/*
+ Lays the window out from rowStarts and rowEnds, cost and traceback are sized for any window at construction.
+ */
+static void FastDTW32_prepareWindow(FastDTW32 *self,
+                                    size_t inputRowCount)
+{
+    self->rowOffsets[0] = 0;
+    
+    for (size_t i = 0; i < inputRowCount; ++i) {
+        
+        self->rowOffsets[i + 1] = self->rowOffsets[i] + self->rowEnds[i] - self->rowStarts[i] + 1;
+    }
+    
+    size_t cellCount = self->rowOffsets[inputRowCount];
+    self->searchedCellCount += cellCount;
+    
+    if (cellCount > self->windowCapacity) {
+        
+        printf("FastDTW32_prepareWindow, window is larger than allocated, exiting\n");
+        exit(-1);
+    }
+}
+
+/*
+ Accumulates the cells of the window with the predecessor order of DTW32_accumulateScoreRow and traces
+ the path from the last cell back into pathRows and pathColumns.
+ */
+static Float32 FastDTW32_accumulateWindow(FastDTW32 *self,
+                                          const Float32 *inputData,
+                                          const Float32 *inputNorms,
+                                          size_t inputRowCount,
+                                          const Float32 *comparisonData,
+                                          const Float32 *comparisonNorms,
+                                          size_t comparisonDataRowCount,
+                                          size_t columnCount)
+{
+    FastDTW32_prepareWindow(self, inputRowCount);
+    
+    for (size_t i = 0; i < inputRowCount; ++i) {
+        
+        const Float32 *input = &inputData[i * columnCount];
+        size_t start = self->rowStarts[i];
+        size_t end = self->rowEnds[i];
+        size_t previousStart = i > 0 ? self->rowStarts[i - 1] : 0;
+        size_t previousEnd = i > 0 ? self->rowEnds[i - 1] : 0;
+        Float32 *row = &self->cost[self->rowOffsets[i] - start];
+        const Float32 *previousRow = i > 0 ? &self->cost[self->rowOffsets[i - 1] - previousStart] : NULL;
+        UInt8 *traceback = &self->traceback[self->rowOffsets[i] - start];
+        
+        for (size_t j = start; j <= end; ++j) {
+            
+            Float32 dot;
+            vDSP_dotpr(input, 1, &comparisonData[j * columnCount], 1, &dot, columnCount);
+            
+            Float32 best = INFINITY;
+            UInt8 choice = kDTWStep_Diagonal;
+            
+            if (i == 0 && j == 0) {
+                
+                best = 0;
+            }
+            else {
+                
+                if (i > 0 && j > previousStart && j - 1 <= previousEnd) {
+                    
+                    best = previousRow[j - 1];
+                }
+                
+                if (i > 0 && j >= previousStart && j <= previousEnd && previousRow[j] < best) {
+                    
+                    best = previousRow[j];
+                    choice = kDTWStep_Input;
+                }
+                
+                if (j > start && row[j - 1] < best) {
+                    
+                    best = row[j - 1];
+                    choice = kDTWStep_Comparison;
+                }
+            }
+            
+            row[j] = 1.f - dot / (inputNorms[i] * comparisonNorms[j]) + best;
+            traceback[j] = choice;
+        }
+    }
+    
+    size_t i = inputRowCount - 1;
+    size_t j = comparisonDataRowCount - 1;
+    size_t length = 0;
+    
+    while (true) {
+        
+        self->pathRows[length] = i;
+        self->pathColumns[length] = j;
+        length++;
+        
+        if (i == 0 && j == 0) {
+            
+            break;
+        }
+        
+        UInt8 choice = self->traceback[self->rowOffsets[i] + j - self->rowStarts[i]];
+        
+        if (choice == kDTWStep_Diagonal) {
+            
+            i--;
+            j--;
+        }
+        else if (choice == kDTWStep_Input) {
+            
+            i--;
+        }
+        else {
+            
+            j--;
+        }
+    }
+    
+    for (size_t k = 0; k < length / 2; ++k) {
+        
+        size_t temp = self->pathRows[k];
+        self->pathRows[k] = self->pathRows[length - 1 - k];
+        self->pathRows[length - 1 - k] = temp;
+        
+        temp = self->pathColumns[k];
+        self->pathColumns[k] = self->pathColumns[length - 1 - k];
+        self->pathColumns[length - 1 - k] = temp;
+    }
+    
+    self->pathLength = length;
+    
+    return self->cost[self->rowOffsets[inputRowCount] - 1];
+}
+
+/*
+ Projects the coarse path in pathRows and pathColumns onto the next finer level, each coarse cell
+ covering a 2 x 2 block, then widens the window by radius rows and columns in every direction.
+ */
+static void FastDTW32_projectWindow(FastDTW32 *self,
+                                    size_t inputRowCount,
+                                    size_t comparisonDataRowCount)
+{
+    for (size_t i = 0; i < inputRowCount; ++i) {
+        
+        self->rowStarts[i] = comparisonDataRowCount - 1;
+        self->rowEnds[i] = 0;
+    }
+    
+    for (size_t k = 0; k < self->pathLength; ++k) {
+        
+        size_t firstColumn = 2 * self->pathColumns[k];
+        size_t lastColumn = firstColumn + 1 < comparisonDataRowCount ? firstColumn + 1 : comparisonDataRowCount - 1;
+        
+        for (size_t i = 2 * self->pathRows[k]; i <= 2 * self->pathRows[k] + 1 && i < inputRowCount; ++i) {
+            
+            self->rowStarts[i] = firstColumn < self->rowStarts[i] ? firstColumn : self->rowStarts[i];
+            self->rowEnds[i] = lastColumn > self->rowEnds[i] ? lastColumn : self->rowEnds[i];
+        }
+    }
+    
+    const size_t radius = self->radius;
+    
+    for (size_t i = 0; i < inputRowCount; ++i) {
+        
+        size_t first = i > radius ? i - radius : 0;
+        size_t last = i + radius < inputRowCount ? i + radius : inputRowCount - 1;
+        size_t start = self->rowStarts[i];
+        size_t end = self->rowEnds[i];
+        
+        for (size_t k = first; k <= last; ++k) {
+            
+            start = self->rowStarts[k] < start ? self->rowStarts[k] : start;
+            end = self->rowEnds[k] > end ? self->rowEnds[k] : end;
+        }
+        
+        self->expandedStarts[i] = start > radius ? start - radius : 0;
+        self->expandedEnds[i] = end + radius < comparisonDataRowCount ? end + radius : comparisonDataRowCount - 1;
+    }
+    
+    memcpy(self->rowStarts, self->expandedStarts, inputRowCount * sizeof(size_t));
+    memcpy(self->rowEnds, self->expandedEnds, inputRowCount * sizeof(size_t));
+}
+
+Float32 FastDTW32_getSimilarityScore(FastDTW32 *self,
+                                     Float32 *inputData,
+                                     size_t inputRowCount,
+                                     Float32 *comparisonData,
+                                     size_t comparisonDataRowCount,
+                                     size_t columnCount)
+{
+    if (inputRowCount > self->maximumRowCount
+        ||
+        comparisonDataRowCount > self->maximumRowCount
+        ||
+        columnCount > self->maximumColumnCount) {
+        
+        printf("FastDTW32_getSimilarityScore, comparison is larger than allocated, exiting\n");
+        exit(-1);
+    }
+    
+    size_t inputRowCounts[FASTDTW32_MAXIMUM_LEVEL_COUNT];
+    size_t comparisonRowCounts[FASTDTW32_MAXIMUM_LEVEL_COUNT];
+    size_t inputOffsets[FASTDTW32_MAXIMUM_LEVEL_COUNT];
+    size_t comparisonOffsets[FASTDTW32_MAXIMUM_LEVEL_COUNT];
+    const size_t minimumRowCount = self->radius + 2;
+    size_t levelCount = 1;
+    
+    memcpy(self->inputPyramid, inputData, inputRowCount * columnCount * sizeof(Float32));
+    memcpy(self->comparisonPyramid, comparisonData, comparisonDataRowCount * columnCount * sizeof(Float32));
+    inputRowCounts[0] = inputRowCount;
+    comparisonRowCounts[0] = comparisonDataRowCount;
+    inputOffsets[0] = 0;
+    comparisonOffsets[0] = 0;
+    
+    while (levelCount < FASTDTW32_MAXIMUM_LEVEL_COUNT
+           &&
+           inputRowCounts[levelCount - 1] > minimumRowCount
+           &&
+           comparisonRowCounts[levelCount - 1] > minimumRowCount) {
+        
+        size_t level = levelCount;
+        inputOffsets[level] = inputOffsets[level - 1] + inputRowCounts[level - 1];
+        comparisonOffsets[level] = comparisonOffsets[level - 1] + comparisonRowCounts[level - 1];
+        
+        inputRowCounts[level] = FastDTW32_coarsen(&self->inputPyramid[inputOffsets[level - 1] * columnCount],
+                                                  inputRowCounts[level - 1],
+                                                  columnCount,
+                                                  &self->inputPyramid[inputOffsets[level] * columnCount]);
+        
+        comparisonRowCounts[level] = FastDTW32_coarsen(&self->comparisonPyramid[comparisonOffsets[level - 1] * columnCount],
+                                                       comparisonRowCounts[level - 1],
+                                                       columnCount,
+                                                       &self->comparisonPyramid[comparisonOffsets[level] * columnCount]);
+        levelCount++;
+    }
+    
+    DTW32_calculateRowNorms(self->inputPyramid, inputOffsets[levelCount - 1] + inputRowCounts[levelCount - 1], columnCount, self->inputNorms);
+    DTW32_calculateRowNorms(self->comparisonPyramid, comparisonOffsets[levelCount - 1] + comparisonRowCounts[levelCount - 1], columnCount, self->comparisonNorms);
+    
+    self->searchedCellCount = 0;
+    Float32 score = INFINITY;
+    
+    for (size_t level = levelCount; level-- > 0;) {
+        
+        if (level == levelCount - 1) {
+            
+            for (size_t i = 0; i < inputRowCounts[level]; ++i) {
+                
+                self->rowStarts[i] = 0;
+                self->rowEnds[i] = comparisonRowCounts[level] - 1;
+            }
+        }
+        else {
+            
+            FastDTW32_projectWindow(self, inputRowCounts[level], comparisonRowCounts[level]);
+        }
+        
+        score = FastDTW32_accumulateWindow(self,
+                                           &self->inputPyramid[inputOffsets[level] * columnCount],
+                                           &self->inputNorms[inputOffsets[level]],
+                                           inputRowCounts[level],
+                                           &self->comparisonPyramid[comparisonOffsets[level] * columnCount],
+                                           &self->comparisonNorms[comparisonOffsets[level]],
+                                           comparisonRowCounts[level],
+                                           columnCount);
+    }
+    
+    return score;
+}
+
+/*
+ DTW32_traceWarpPath stops as soon as its path reaches the first row or column, so the path is taken from
+ its last element on that border and every input row up to it is given that comparison row.
+ */
+void FastDTW32_getWarpPath(FastDTW32 *self,
+                           size_t *warpPath)
+{
+    size_t first = 0;
+    
+    for (size_t k = 0; k < self->pathLength; ++k) {
+        
+        if (self->pathRows[k] == 0 || self->pathColumns[k] == 0) {
+            
+            first = k;
+        }
+    }
+    
+    size_t nextRow = 0;
+    
+    for (size_t k = first; k < self->pathLength; ++k) {
+        
+        while (nextRow <= self->pathRows[k]) {
+            
+            warpPath[nextRow] = self->pathColumns[k] + 1;
+            nextRow++;
+        }
+    }
+}
@@ -0,0 +1,128 @@
+    //
+    //  FastDTW.h
+    //  Streaming-Audio-Mosaicing-Vocoder
+    //
+
+#import <MacTypes.h>
+#import <stdlib.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    
+    /*!
+     The deepest pyramid a FastDTW32 builds, enough to halve any row count down to a handful of rows.
+     */
+#define FASTDTW32_MAXIMUM_LEVEL_COUNT 64
+    
+    /*!
+     @class FastDTW32
+     @abstract A pseudoclass for approximate multi-resolution dynamic time warping. The input and comparison are halved repeatedly by averaging neighbouring rows, the coarsest pair is compared in full and at each finer level only the cells within radius of the projected warp path are accumulated, so a comparison costs O((n + m) * radius) instead of O(n * m).
+     @var maximumRowCount
+     The largest input or comparison row count.
+     @var maximumColumnCount
+     The largest feature vector length.
+     @var radius
+     The number of cells either side of the projected path that are searched at each level, larger values are slower and closer to exact dynamic time warping.
+     @var inputPyramid
+     Every level of the input one after another, finest first. Odd row counts round up when halved, so at most 2 * maximumRowCount + FASTDTW32_MAXIMUM_LEVEL_COUNT rows.
+     @var comparisonPyramid
+     Every level of the comparison in the same layout.
+     @var inputNorms
+     The euclidean norm of each row of inputPyramid.
+     @var comparisonNorms
+     The euclidean norm of each row of comparisonPyramid.
+     @var rowStarts
+     The first comparison row searched for each input row of the current level.
+     @var rowEnds
+     The last comparison row searched for each input row of the current level.
+     @var rowOffsets
+     The offset of each input row's cells in cost and traceback.
+     @var expandedStarts
+     Temporary rowStarts while the window is widened by radius.
+     @var expandedEnds
+     Temporary rowEnds while the window is widened by radius.
+     @var cost
+     The accumulated distances of the searched cells.
+     @var traceback
+     The predecessor choice of each searched cell, with the values of DTWStep.
+     @var windowCapacity
+     The allocated length of cost and traceback, enough for the widest window maximumRowCount and radius allow.
+     @var pathRows
+     The input rows of the warp path from the last comparison, up to 2 * maximumRowCount long.
+     @var pathColumns
+     The comparison rows of the warp path.
+     @var pathLength
+     The number of elements in the warp path.
+     @var searchedCellCount
+     The number of cells accumulated over every level by the last comparison.
+     */
+    typedef struct FastDTW32
+    {
+        size_t maximumRowCount;
+        size_t maximumColumnCount;
+        size_t radius;
+        Float32 *inputPyramid;
+        Float32 *comparisonPyramid;
+        Float32 *inputNorms;
+        Float32 *comparisonNorms;
+        size_t *rowStarts;
+        size_t *rowEnds;
+        size_t *rowOffsets;
+        size_t *expandedStarts;
+        size_t *expandedEnds;
+        Float32 *cost;
+        UInt8 *traceback;
+        size_t windowCapacity;
+        size_t *pathRows;
+        size_t *pathColumns;
+        size_t pathLength;
+        size_t searchedCellCount;
+        
+    } FastDTW32;
+    
+    /*!
+     @functiongroup Construct/Destruct
+     */
+    
+    /*!
+     Construct a FastDTW32 pseudoclass.
+     @param maximumRowCount
+     The largest input or comparison row count.
+     @param radius
+     The accuracy/speed trade off, 0 follows the projected path alone and a radius as large as the comparisons is exact.
+     */
+    FastDTW32 *FastDTW32_new(size_t maximumRowCount,
+                             size_t maximumColumnCount,
+                             size_t radius);
+    
+    void FastDTW32_delete(FastDTW32 *self);
+    
+    /*!
+     @functiongroup Processing
+     */
+    
+    /*!
+     Approximate the cosine distance dynamic time warping score of DTW32_getSimilarityScore. The ties between predecessors are broken the same way, so with a radius covering the whole comparison the score is exact.
+     @return
+     The approximate similarity value. Only a subset of the warp paths is searched so, rounding aside, it is never lower than the exact value. The path is left in pathRows and pathColumns.
+     */
+    Float32 FastDTW32_getSimilarityScore(FastDTW32 *self,
+                                         Float32 *inputData,
+                                         size_t inputRowCount,
+                                         Float32 *comparisonData,
+                                         size_t comparisonDataRowCount,
+                                         size_t columnCount);
+    
+    /*!
+     Convert the last warp path to the same form as DTW32_traceWarpPath.
+     @param warpPath
+     Output, inputRowCount in length, the 1 based comparison row that each input row is first aligned with.
+     */
+    void FastDTW32_getWarpPath(FastDTW32 *self,
+                               size_t *warpPath);
+    
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,178 @@
+    //
+    //  IncrementalDTW.c
+    //  Streaming-Audio-Mosaicing-Vocoder
+    //
+
+#import "IncrementalDTW.h"
+#import <stdio.h>
+#import <stdlib.h>
+#import <math.h>
+#import <Accelerate/Accelerate.h>
+
+IncrementalDTW32 *IncrementalDTW32_new(size_t rowCount,
+                                       size_t columnCount,
+                                       Float32 *paletteData,
+                                       size_t paletteRowCount,
+                                       Matrix32 *beats,
+                                       Boolean useBeats)
+{
+    IncrementalDTW32 *self = calloc(1, sizeof(IncrementalDTW32));
+    
+    self->rowCount = rowCount;
+    self->columnCount = columnCount;
+    self->paletteData = paletteData;
+    
+    if (useBeats == false) {
+        
+        self->candidateCount = paletteRowCount > rowCount ? (paletteRowCount - 1) / rowCount : 0;
+    }
+    else {
+        
+        self->candidateCount = beats->columnCount;
+    }
+    
+    self->candidateStarts = calloc(self->candidateCount, sizeof(size_t));
+    self->candidateLengths = calloc(self->candidateCount, sizeof(size_t));
+    self->frontierOffsets = calloc(self->candidateCount, sizeof(size_t));
+    
+    size_t frontierCount = 0;
+    
+    for (size_t i = 0; i < self->candidateCount; ++i) {
+        
+        if (useBeats == false) {
+            
+            self->candidateStarts[i] = i * rowCount;
+            self->candidateLengths[i] = rowCount;
+        }
+        else {
+            
+            size_t start = (size_t)Matrix_getRow(beats, 0)[i];
+            size_t length = (size_t)Matrix_getRow(beats, 1)[i];
+            
+            start = start < paletteRowCount - 1 ? start : paletteRowCount - 1;
+            length = length > 0 ? length : 1;
+            length = start + length <= paletteRowCount ? length : paletteRowCount - start;
+            
+            self->candidateStarts[i] = start;
+            self->candidateLengths[i] = length;
+        }
+        
+        self->frontierOffsets[i] = frontierCount;
+        frontierCount += self->candidateLengths[i];
+    }
+    
+    self->frontier = calloc(frontierCount, sizeof(Float32));
+    self->paletteNorms = calloc(paletteRowCount, sizeof(Float32));
+    
+    for (size_t i = 0; i < paletteRowCount; ++i) {
+        
+        vDSP_svesq(&paletteData[i * columnCount], 1, &self->paletteNorms[i], columnCount);
+    }
+    
+    const int elementCount = (int)paletteRowCount;
+    vvsqrtf(self->paletteNorms, self->paletteNorms, &elementCount);
+    
+    return self;
+}
+
+void IncrementalDTW32_delete(IncrementalDTW32 *self)
+{
+    free(self->paletteNorms);
+    free(self->candidateStarts);
+    free(self->candidateLengths);
+    free(self->frontierOffsets);
+    free(self->frontier);
+    free(self);
+    self = NULL;
+}
+
+void IncrementalDTW32_reset(IncrementalDTW32 *self)
+{
+    self->currentRow = 0;
+}
+
+/*
+ The candidate's previous row is overwritten in place, the diagonal predecessor is kept aside before
+ each cell is replaced. Ties go to the diagonal, then up, then left as in DTW32. The bands are only a
+ few columns wide, so the dot products are an inline loop rather than a vDSP call per cell.
+ */
+void IncrementalDTW32_advance(IncrementalDTW32 *self,
+                              Float32 *analysisRow)
+{
+    if (self->currentRow >= self->rowCount) {
+        
+        return;
+    }
+    
+    Float32 analysisNorm;
+    vDSP_svesq(analysisRow, 1, &analysisNorm, self->columnCount);
+    analysisNorm = sqrtf(analysisNorm);
+    
+    const Boolean firstRow = self->currentRow == 0;
+    
+    for (size_t candidate = 0; candidate < self->candidateCount; ++candidate) {
+        
+        Float32 *row = &self->frontier[self->frontierOffsets[candidate]];
+        Float32 *palette = &self->paletteData[self->candidateStarts[candidate] * self->columnCount];
+        Float32 *paletteNorms = &self->paletteNorms[self->candidateStarts[candidate]];
+        Float32 diagonal = 0;
+        
+        for (size_t j = 0; j < self->candidateLengths[candidate]; ++j) {
+            
+            const Float32 *paletteRow = &palette[j * self->columnCount];
+            Float32 dot = 0;
+            
+            for (size_t k = 0; k < self->columnCount; ++k) {
+                
+                dot += analysisRow[k] * paletteRow[k];
+            }
+            
+            Float32 distance = 1.f - dot / (analysisNorm * paletteNorms[j]);
+            Float32 best;
+            
+            if (firstRow == true) {
+                
+                best = j == 0 ? 0 : row[j - 1];
+            }
+            else {
+                
+                Float32 up = row[j];
+                
+                best = j == 0 ? INFINITY : diagonal;
+                best = up < best ? up : best;
+                best = (j > 0 && row[j - 1] < best) ? row[j - 1] : best;
+                
+                diagonal = up;
+            }
+            
+            row[j] = distance + best;
+        }
+    }
+    
+    self->currentRow++;
+}
+
+size_t IncrementalDTW32_getBestCandidate(IncrementalDTW32 *self,
+                                         Float32 *score)
+{
+    size_t bestCandidate = 0;
+    Float32 bestScore = INFINITY;
+    
+    for (size_t candidate = 0; candidate < self->candidateCount; ++candidate) {
+        
+        Float32 currentScore = self->frontier[self->frontierOffsets[candidate] + self->candidateLengths[candidate] - 1];
+        
+        if (currentScore < bestScore) {
+            
+            bestScore = currentScore;
+            bestCandidate = candidate;
+        }
+    }
+    
+    if (score != NULL) {
+        
+        *score = bestScore;
+    }
+    
+    return bestCandidate;
+}
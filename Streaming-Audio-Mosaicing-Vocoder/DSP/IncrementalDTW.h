@@ -0,0 +1,94 @@
+    //
+    //  IncrementalDTW.h
+    //  Streaming-Audio-Mosaicing-Vocoder
+    //
+
+#import <MacTypes.h>
+#import "Matrix.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    
+    /*!
+     @class IncrementalDTW32
+     @abstract A pseudoclass which advances the dynamic time warping of an analysis segment against every palette candidate one analysis frame at a time, so a search is spread evenly over the hops of a segment instead of running when the analysis queue wraps.
+     @var rowCount
+     The number of analysis frames in a segment.
+     @var columnCount
+     The feature vector length.
+     @var candidateCount
+     The number of palette candidates, fixed windows of rowCount or one per beat.
+     @var currentRow
+     The number of analysis frames accumulated since the last reset.
+     @var paletteData
+     The palette feature vectors, not owned.
+     @var paletteNorms
+     The euclidean norm of each palette row.
+     @var candidateStarts
+     The first palette row of each candidate.
+     @var candidateLengths
+     The palette row count of each candidate.
+     @var frontierOffsets
+     The offset of each candidate's row in <i>frontier</i>.
+     @var frontier
+     The most recent row of each candidate's global distance matrix.
+     */
+    typedef struct IncrementalDTW32
+    {
+        size_t rowCount;
+        size_t columnCount;
+        size_t candidateCount;
+        size_t currentRow;
+        Float32 *paletteData;
+        Float32 *paletteNorms;
+        size_t *candidateStarts;
+        size_t *candidateLengths;
+        size_t *frontierOffsets;
+        Float32 *frontier;
+        
+    } IncrementalDTW32;
+    
+    /*!
+     @abstract Construct an <b>IncrementalDTW32</b> pseudoclass
+     @param rowCount
+     The number of analysis frames in a segment.
+     @param beats
+     Beat start indexes and row counts, used for the candidates when useBeats is true.
+     */
+    IncrementalDTW32 *IncrementalDTW32_new(size_t rowCount,
+                                           size_t columnCount,
+                                           Float32 *paletteData,
+                                           size_t paletteRowCount,
+                                           Matrix32 *beats,
+                                           Boolean useBeats);
+    
+    void IncrementalDTW32_delete(IncrementalDTW32 *self);
+    
+    /*!
+     @abstract Start a new segment.
+     */
+    void IncrementalDTW32_reset(IncrementalDTW32 *self);
+    
+    /*!
+     @abstract Accumulate the next analysis frame against every candidate.
+     @param analysisRow
+     A feature vector of columnCount in length. Frames beyond rowCount since the last reset are ignored.
+     */
+    void IncrementalDTW32_advance(IncrementalDTW32 *self,
+                                  Float32 *analysisRow);
+    
+    /*!
+     @abstract The candidate with the lowest accumulated distance after the last frame.
+     @param score
+     Output, the candidate's score, may be NULL.
+     @return
+     The candidate index, the first one wins ties.
+     */
+    size_t IncrementalDTW32_getBestCandidate(IncrementalDTW32 *self,
+                                             Float32 *score);
+    
+#ifdef __cplusplus
+}
+#endif
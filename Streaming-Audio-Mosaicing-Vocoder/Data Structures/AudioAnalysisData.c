@@ -11,6 +11,7 @@
 #import <Accelerate/Accelerate.h>
 #import <stdio.h>
 #import <string.h>
+#import <unistd.h>
 #import "hdf5.h"
 
 AudioAnalysisData32 *AudioAnalysisData32_new(size_t samplerate,
@@ -64,12 +65,76 @@ void AudioAnalysisData32_delete(AudioAnalysisData32 *self)
 
     }
     
+    if (self->normalisedTriangleMagnitudeBands != NULL) {
+        
+        for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
+            
+            Matrix32_delete(self->normalisedTriangleMagnitudeBands[i]);
+            Matrix32_delete(self->normalisedTriangleFluxMagnitudeBands[i]);
+        }
+        
+        free(self->normalisedTriangleMagnitudeBands);
+        free(self->normalisedTriangleFluxMagnitudeBands);
+    }
+    
+    if (self->triangleBandNorms != NULL) {
+        
+        for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
+            
+            free(self->triangleBandNorms[i]);
+            free(self->triangleFluxBandNorms[i]);
+        }
+        
+        free(self->triangleBandNorms);
+        free(self->triangleFluxBandNorms);
+    }
+    
     free(self->triangleMagnitudeBands);
     free(self->triangleRowBlockSizes);
+    free(self->triangleBandStorage);
+    free(self->triangleFluxBandStorage);
     free(self);
     self = NULL;
 }
 
+/*
+ Every band of a set lives in one zeroed block from posix_memalign, each starting on a page boundary and
+ the block rounded up to whole pages, the layout OpenCL wants for a CL_MEM_USE_HOST_PTR buffer.
+ */
+static Float32 *AudioAnalysisData32_newBands(AudioAnalysisData32 *self, Matrix32 **bands)
+{
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t pageElementCount = pageSize / sizeof(Float32);
+    size_t *offsets = calloc(self->triangleMagnitudeBandsCount, sizeof(size_t));
+    size_t elementCount = 0;
+    
+    for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
+        
+        offsets[i] = elementCount;
+        size_t capacity = Matrix32_getCapacity(self->hopCount, self->triangleRowBlockSizes[i]);
+        elementCount += (capacity + pageElementCount - 1) / pageElementCount * pageElementCount;
+    }
+    
+    Float32 *storage = NULL;
+    
+    if (posix_memalign((void **)&storage, pageSize, elementCount * sizeof(Float32)) != 0) {
+        
+        printf("AudioAnalysisData32_newBands, could not allocate band storage, exiting\n");
+        exit(-1);
+    }
+    
+    memset(storage, 0, elementCount * sizeof(Float32));
+    
+    for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
+        
+        bands[i] = Matrix32_newWithData(self->hopCount, self->triangleRowBlockSizes[i], &storage[offsets[i]]);
+    }
+    
+    free(offsets);
+    
+    return storage;
+}
+
 void AudioAnalysisData32_calculateTriangleFilterBandSizes(AudioAnalysisData32 *self)
 {
     Float32 averageBlockSize = (Float32)self->triangleMagnitudes->columnCount / (Float32)self->triangleMagnitudeBandsCount;
@@ -87,11 +152,58 @@ void AudioAnalysisData32_calculateTriangleFilterBandSizes(AudioAnalysisData32 *s
 
     self->triangleMagnitudeBands = calloc(self->triangleMagnitudeBandsCount, sizeof(Matrix32 *));
     self->triangleFluxMagnitudeBands = calloc(self->triangleMagnitudeBandsCount, sizeof(Matrix32 *));
+    self->triangleBandStorage = AudioAnalysisData32_newBands(self, self->triangleMagnitudeBands);
+    self->triangleFluxBandStorage = AudioAnalysisData32_newBands(self, self->triangleFluxMagnitudeBands);
+}
 
+void AudioAnalysisData32_normaliseTriangleBands(AudioAnalysisData32 *self)
+{
+    if (self->normalisedTriangleMagnitudeBands == NULL) {
+        
+        self->normalisedTriangleMagnitudeBands = calloc(self->triangleMagnitudeBandsCount, sizeof(Matrix32 *));
+        self->normalisedTriangleFluxMagnitudeBands = calloc(self->triangleMagnitudeBandsCount, sizeof(Matrix32 *));
+        
+        for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
+            
+            self->normalisedTriangleMagnitudeBands[i] = Matrix32_new(self->hopCount, self->triangleRowBlockSizes[i]);
+            self->normalisedTriangleFluxMagnitudeBands[i] = Matrix32_new(self->hopCount, self->triangleRowBlockSizes[i]);
+        }
+    }
+    
+    for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
+        
+        Matrix32_normaliseRows(self->triangleMagnitudeBands[i], self->normalisedTriangleMagnitudeBands[i]);
+        Matrix32_normaliseRows(self->triangleFluxMagnitudeBands[i], self->normalisedTriangleFluxMagnitudeBands[i]);
+    }
+}
+
+static void AudioAnalysisData32_calculateRowNorms(Matrix32 *band, Float32 *norms)
+{
+    for (size_t i = 0; i < band->rowCount; ++i) {
+        
+        vDSP_svesq(Matrix_getRow(band, i), 1, &norms[i], band->columnCount);
+        norms[i] = sqrtf(norms[i]);
+    }
+}
+
+void AudioAnalysisData32_calculateTriangleBandNorms(AudioAnalysisData32 *self)
+{
+    if (self->triangleBandNorms == NULL) {
+        
+        self->triangleBandNorms = calloc(self->triangleMagnitudeBandsCount, sizeof(Float32 *));
+        self->triangleFluxBandNorms = calloc(self->triangleMagnitudeBandsCount, sizeof(Float32 *));
+        
+        for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
+            
+            self->triangleBandNorms[i] = calloc(self->hopCount, sizeof(Float32));
+            self->triangleFluxBandNorms[i] = calloc(self->hopCount, sizeof(Float32));
+        }
+    }
+    
     for (size_t i = 0; i < self->triangleMagnitudeBandsCount; ++i) {
         
-        self->triangleMagnitudeBands[i] = Matrix32_new(self->hopCount, self->triangleRowBlockSizes[i]);
-        self->triangleFluxMagnitudeBands[i] = Matrix32_new(self->hopCount, self->triangleRowBlockSizes[i]);
+        AudioAnalysisData32_calculateRowNorms(self->triangleMagnitudeBands[i], self->triangleBandNorms[i]);
+        AudioAnalysisData32_calculateRowNorms(self->triangleFluxMagnitudeBands[i], self->triangleFluxBandNorms[i]);
     }
 }
 
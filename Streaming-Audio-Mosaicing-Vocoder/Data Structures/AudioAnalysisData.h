@@ -36,6 +36,18 @@ extern "C"
      The matrix containing the chromagram analysis data.
      @var beats
      The matrix containing the hopCount position of the start of a beat in row 0, and the length of the beat in hopCounts in row 1.
+     @var normalisedTriangleMagnitudeBands
+     Unit length row copies of triangleMagnitudeBands, NULL until <b>AudioAnalysisData32_normaliseTriangleBands</b> is called.
+     @var normalisedTriangleFluxMagnitudeBands
+     Unit length row copies of triangleFluxMagnitudeBands, NULL until <b>AudioAnalysisData32_normaliseTriangleBands</b> is called.
+     @var triangleBandNorms
+     The row norms of each of triangleMagnitudeBands, hopCount per band, NULL until <b>AudioAnalysisData32_calculateTriangleBandNorms</b> is called.
+     @var triangleFluxBandNorms
+     The row norms of each of triangleFluxMagnitudeBands, NULL until <b>AudioAnalysisData32_calculateTriangleBandNorms</b> is called.
+     @var triangleBandStorage
+     One page aligned block holding the data of every triangleMagnitudeBands matrix, each band starting on a page of its own, so an OpenCL device sharing host memory can search the palette in place.
+     @var triangleFluxBandStorage
+     The same block for triangleFluxMagnitudeBands.
      */
     typedef struct AudioAnalysisData32
     {
@@ -58,6 +70,12 @@ extern "C"
         size_t triangleMagnitudeBandsCount;
         Float32 *frameTimeInSeconds;
         size_t largestBeatSize;
+        Matrix32 **normalisedTriangleMagnitudeBands;
+        Matrix32 **normalisedTriangleFluxMagnitudeBands;
+        Float32 **triangleBandNorms;
+        Float32 **triangleFluxBandNorms;
+        Float32 *triangleBandStorage;
+        Float32 *triangleFluxBandStorage;
         
     } AudioAnalysisData32;
     
@@ -105,6 +123,20 @@ extern "C"
     
     
     void AudioAnalysisData32_calculateTriangleFilterBandSizes(AudioAnalysisData32 *self);
+    
+    /*!
+     Store unit length row copies of the triangle magnitude bands, so cosine distances against the palette reduce to 1 - dot. Call again if the bands change.
+     @param self
+     Pointer to self.
+     */
+    void AudioAnalysisData32_normaliseTriangleBands(AudioAnalysisData32 *self);
+    
+    /*!
+     Store the row norms of the triangle magnitude bands, so cosine distances against the palette only need the norms of the other side calculated. Call again if the bands change.
+     @param self
+     Pointer to self.
+     */
+    void AudioAnalysisData32_calculateTriangleBandNorms(AudioAnalysisData32 *self);
 
     
 #ifdef __cplusplus
@@ -0,0 +1,177 @@
+    //
+    //  MatchHeap.c
+    //  Streaming-Audio-Mosaicing-Vocoder
+    //
+
+#import "MatchHeap.h"
+#import <math.h>
+
+MatchHeap32 *MatchHeap32_new(size_t capacity)
+{
+    MatchHeap32 *self = calloc(1, sizeof(MatchHeap32));
+    
+    self->capacity = capacity > 0 ? capacity : 1;
+    self->indices = calloc(self->capacity, sizeof(size_t));
+    self->scores = calloc(self->capacity, sizeof(Float32));
+    
+    return self;
+}
+
+void MatchHeap32_delete(MatchHeap32 *self)
+{
+    free(self->indices);
+    free(self->scores);
+    free(self);
+    self = NULL;
+}
+
+void MatchHeap32_clear(MatchHeap32 *self)
+{
+    self->count = 0;
+}
+
+/*
+ Matches are ordered by score and then by index, a later index counting as the worse of a tie.
+ */
+static inline Boolean MatchHeap32_isWorse(MatchHeap32 *self,
+                                          size_t a,
+                                          size_t b)
+{
+    if (self->scores[a] != self->scores[b]) {
+        
+        return self->scores[a] > self->scores[b];
+    }
+    
+    return self->indices[a] > self->indices[b];
+}
+
+static inline void MatchHeap32_swap(MatchHeap32 *self,
+                                    size_t a,
+                                    size_t b)
+{
+    size_t index = self->indices[a];
+    Float32 score = self->scores[a];
+    
+    self->indices[a] = self->indices[b];
+    self->scores[a] = self->scores[b];
+    self->indices[b] = index;
+    self->scores[b] = score;
+}
+
+Boolean MatchHeap32_insert(MatchHeap32 *self,
+                           size_t index,
+                           Float32 score)
+{
+    if (score != score) {
+        
+        return false;
+    }
+    
+    if (self->count < self->capacity) {
+        
+        size_t child = self->count;
+        self->indices[child] = index;
+        self->scores[child] = score;
+        self->count++;
+        
+        while (child > 0 && MatchHeap32_isWorse(self, child, (child - 1) / 2)) {
+            
+            MatchHeap32_swap(self, child, (child - 1) / 2);
+            child = (child - 1) / 2;
+        }
+        
+        return true;
+    }
+    
+    if (score > self->scores[0] || (score == self->scores[0] && index > self->indices[0])) {
+        
+        return false;
+    }
+    
+    self->indices[0] = index;
+    self->scores[0] = score;
+    
+    size_t parent = 0;
+    
+    while (true) {
+        
+        size_t worst = parent;
+        size_t left = 2 * parent + 1;
+        size_t right = left + 1;
+        
+        if (left < self->count && MatchHeap32_isWorse(self, left, worst)) {
+            
+            worst = left;
+        }
+        
+        if (right < self->count && MatchHeap32_isWorse(self, right, worst)) {
+            
+            worst = right;
+        }
+        
+        if (worst == parent) {
+            
+            break;
+        }
+        
+        MatchHeap32_swap(self, parent, worst);
+        parent = worst;
+    }
+    
+    return true;
+}
+
+Float32 MatchHeap32_getThreshold(MatchHeap32 *self)
+{
+    return self->count < self->capacity ? INFINITY : self->scores[0];
+}
+
+size_t MatchHeap32_getBest(MatchHeap32 *self,
+                           Float32 *score)
+{
+    size_t best = 0;
+    
+    for (size_t i = 1; i < self->count; ++i) {
+        
+        if (MatchHeap32_isWorse(self, best, i)) {
+            
+            best = i;
+        }
+    }
+    
+    if (score != NULL) {
+        
+        *score = self->count > 0 ? self->scores[best] : INFINITY;
+    }
+    
+    return self->count > 0 ? self->indices[best] : 0;
+}
+
+/*
+ The matches are sorted in place from worst to best, which still satisfies the heap order, and copied out
+ in reverse.
+ */
+size_t MatchHeap32_getSorted(MatchHeap32 *self,
+                             size_t *indices,
+                             Float32 *scores)
+{
+    for (size_t i = 1; i < self->count; ++i) {
+        
+        for (size_t j = i; j > 0 && MatchHeap32_isWorse(self, j, j - 1); --j) {
+            
+            MatchHeap32_swap(self, j, j - 1);
+        }
+    }
+    
+    for (size_t i = 0; i < self->count; ++i) {
+        
+        indices[i] = self->indices[self->count - 1 - i];
+        
+        if (scores != NULL) {
+            
+            scores[i] = self->scores[self->count - 1 - i];
+        }
+    }
+    
+    return self->count;
+}
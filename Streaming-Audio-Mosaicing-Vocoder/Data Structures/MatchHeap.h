@@ -0,0 +1,88 @@
+    //
+    //  MatchHeap.h
+    //  Streaming-Audio-Mosaicing-Vocoder
+    //
+
+#import <MacTypes.h>
+#import <stdlib.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    
+    /*!
+     @class MatchHeap32
+     @abstract A pseudoclass keeping the capacity lowest scoring (index, score) pairs of a search in a bounded max heap, so the worst kept score is always at the root and is the threshold a new candidate has to beat.
+     @var capacity
+     The number of matches kept, K.
+     @var count
+     The number of matches currently kept.
+     @var indices
+     The candidate indices in heap order.
+     @var scores
+     The candidate scores in heap order, scores[0] is the worst kept.
+     */
+    typedef struct MatchHeap32
+    {
+        size_t capacity;
+        size_t count;
+        size_t *indices;
+        Float32 *scores;
+        
+    } MatchHeap32;
+    
+    /*!
+     @functiongroup Construct/Destruct
+     */
+    
+    MatchHeap32 *MatchHeap32_new(size_t capacity);
+    void MatchHeap32_delete(MatchHeap32 *self);
+    
+    /*!
+     @functiongroup Matches
+     */
+    
+    /*!
+     Remove every match, ready for the next search.
+     */
+    void MatchHeap32_clear(MatchHeap32 *self);
+    
+    /*!
+     Offer a candidate, it is kept if the heap is not full or it beats the worst kept match. Equal scores are ordered by index so with candidates offered in index order the earliest of a tie is kept. A NaN score is never kept, it would compare as neither better nor worse than any match and break the heap order.
+     @return
+     true if the candidate was kept.
+     */
+    Boolean MatchHeap32_insert(MatchHeap32 *self,
+                               size_t index,
+                               Float32 score);
+    
+    /*!
+     The score a candidate has to beat to be kept, the worst kept score once the heap is full and INFINITY before, suitable as an abandoning threshold.
+     */
+    Float32 MatchHeap32_getThreshold(MatchHeap32 *self);
+    
+    /*!
+     The index of the lowest scoring match, 0 if the heap is empty.
+     @param score
+     Output, the score of the match, may be NULL.
+     */
+    size_t MatchHeap32_getBest(MatchHeap32 *self,
+                               Float32 *score);
+    
+    /*!
+     Copy the matches out from best to worst.
+     @param indices
+     Output, count in length.
+     @param scores
+     Output, count in length, may be NULL.
+     @return
+     The number of matches copied.
+     */
+    size_t MatchHeap32_getSorted(MatchHeap32 *self,
+                                 size_t *indices,
+                                 Float32 *scores);
+    
+#ifdef __cplusplus
+}
+#endif
@@ -18,17 +18,42 @@ Matrix32 *Matrix32_new(size_t rowCount, size_t columnCount)
     self->rowCount = rowCount;
     self->columnCount = columnCount;
     self->elementCount = self->rowCount * self->columnCount;
-    self->capacity = nextPowerOfTwo(self->elementCount);
+    self->capacity = Matrix32_getCapacity(rowCount, columnCount);
     self->data = calloc(self->capacity, sizeof(Float32));
     self->tempData = calloc(self->capacity, sizeof(Float32));
     self->multiplierData = calloc(self->capacity, sizeof(Float32));
+    self->ownsData = true;
     
     return self;
 }
 
+Matrix32 *Matrix32_newWithData(size_t rowCount, size_t columnCount, Float32 *data)
+{
+    Matrix32 *self = calloc(1, sizeof(Matrix32));
+    self->rowCount = rowCount;
+    self->columnCount = columnCount;
+    self->elementCount = self->rowCount * self->columnCount;
+    self->capacity = Matrix32_getCapacity(rowCount, columnCount);
+    self->data = data;
+    self->tempData = calloc(self->capacity, sizeof(Float32));
+    self->multiplierData = calloc(self->capacity, sizeof(Float32));
+    self->ownsData = false;
+    
+    return self;
+}
+
+size_t Matrix32_getCapacity(size_t rowCount, size_t columnCount)
+{
+    return nextPowerOfTwo(rowCount * columnCount);
+}
+
 void Matrix32_delete(Matrix32 *self)
 {
-    free(self->data);
+    if (self->ownsData == true) {
+        
+        free(self->data);
+    }
+    
     free(self->tempData);
     free(self->multiplierData);
     free(self);
@@ -262,6 +287,33 @@ void Matrix32_fill(Matrix32 *input, Float32 scalar)
     vDSP_vfill(&scalar, input->data, 1, input->elementCount);
 }
 
+void Matrix32_normaliseRows(Matrix32 *input, Matrix32 *output)
+{
+    if (input->rowCount != output->rowCount
+        ||
+        input->columnCount != output->columnCount) {
+        
+        printf("Matrix32_normaliseRows, Matrices not compatible, exiting\n");
+        exit(-1);
+    }
+    
+    for (size_t i = 0; i < input->rowCount; ++i) {
+        
+        Float32 norm;
+        vDSP_svesq(Matrix_getRow(input, i), 1, &norm, input->columnCount);
+        norm = sqrtf(norm);
+        
+        if (norm > 0) {
+            
+            vDSP_vsdiv(Matrix_getRow(input, i), 1, &norm, Matrix_getRow(output, i), 1, input->columnCount);
+        }
+        else {
+            
+            vDSP_vclr(Matrix_getRow(output, i), 1, output->columnCount);
+        }
+    }
+}
+
 void Matrix32_elementWiseDivide(Matrix32 *inputA,
                                 Matrix32 *inputB,
                                 Matrix32 *result)
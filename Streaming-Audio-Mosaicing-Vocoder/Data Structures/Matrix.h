@@ -31,6 +31,8 @@ extern "C"
      A pointer to the data contained in the matrix.
      @var tempData;
      A pointer to temporary data used to do some in place arithmetic operations.
+     @var ownsData;
+     Whether data is freed with the matrix, false when it was handed in to Matrix32_newWithData.
      */
     typedef struct Matrix32
     {
@@ -41,6 +43,7 @@ extern "C"
         Float32 *data;
         Float32 *tempData;
         Float32 *multiplierData;
+        Boolean ownsData;
         
     } Matrix32;
     /*!
@@ -55,6 +58,16 @@ extern "C"
      The number of columns in the matrix.
      */
     Matrix32 *Matrix32_new(size_t rowCount, size_t columnCount);
+    /*!
+     Contruct a Matrix32 pseudoclass over storage owned by the caller, which must outlive the matrix.
+     @param data
+     At least Matrix32_getCapacity(rowCount, columnCount) floats.
+     */
+    Matrix32 *Matrix32_newWithData(size_t rowCount, size_t columnCount, Float32 *data);
+    /*!
+     The number of floats a matrix of rowCount * columnCount elements is stored in.
+     */
+    size_t Matrix32_getCapacity(size_t rowCount, size_t columnCount);
     /*!
      Destroy a Matrix32 pseudoclass
      @param self
@@ -85,6 +98,13 @@ extern "C"
     
     void Matrix32_fill(Matrix32 *input, Float32 scalar);
     
+    /*!
+     Scale every row of a matrix to unit euclidean length, rows of zeros are left as zeros.
+     @param output
+     A matrix with the same row and column count as input, may be input.
+     */
+    void Matrix32_normaliseRows(Matrix32 *input, Matrix32 *output);
+    
     void Matrix32_multiply(Matrix32 *inputA,
                            Boolean transposeA,
                            Matrix32 *inputB,
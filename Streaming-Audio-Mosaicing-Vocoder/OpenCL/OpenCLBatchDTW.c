@@ -0,0 +1,770 @@
+    //
+    //  OpenCLBatchDTW.c
+    //  Streaming-Audio-Mosaicing-Vocoder
+    //
+
+#import "OpenCLBatchDTW.h"
+#import <assert.h>
+#import <math.h>
+#import <stdio.h>
+#import <string.h>
+#import <sys/time.h>
+
+static cl_mem OpenCLBatchDTW_createBuffer(OpenCLBatchDTW *self,
+                                          size_t byteCount,
+                                          cl_mem_flags flags,
+                                          void *data)
+{
+    cl_int error;
+    cl_mem buffer = clCreateBuffer(self->runtime->context,
+                                   data != NULL && (flags & CL_MEM_USE_HOST_PTR) == 0 ? flags | CL_MEM_COPY_HOST_PTR : flags,
+                                   byteCount,
+                                   data,
+                                   &error);
+    assert(error == CL_SUCCESS);
+    
+    return buffer;
+}
+
+/*
+ The reduction size is the largest power of 2 the device runs the argmin kernel with, up to
+ OPENCLBATCHDTW_MAXIMUM_REDUCTION_SIZE.
+ */
+static size_t OpenCLBatchDTW_chooseReductionSize(OpenCLBatchDTW *self)
+{
+    size_t kernelWorkGroupSize = 1;
+    cl_int error = clGetKernelWorkGroupInfo(self->argminKernel,
+                                            self->runtime->device,
+                                            CL_KERNEL_WORK_GROUP_SIZE,
+                                            sizeof(size_t),
+                                            &kernelWorkGroupSize,
+                                            NULL);
+    assert(error == CL_SUCCESS);
+    
+    size_t reductionSize = 1;
+    
+    while (reductionSize * 2 <= OPENCLBATCHDTW_MAXIMUM_REDUCTION_SIZE && reductionSize * 2 <= kernelWorkGroupSize) {
+    
+        reductionSize *= 2;
+    }
+    
+    return reductionSize;
+}
+
+/*
+ The cooperative kernel keeps five palette length rows in local memory, and the query and candidate
+ as well when there is room, its work-groups are limited by the kernel and device.
+ */
+static void OpenCLBatchDTW_allocateLocalMemory(OpenCLBatchDTW *self)
+{
+    cl_ulong deviceByteCount = 0;
+    cl_ulong kernelByteCount = 0;
+    size_t kernelWorkGroupSize = 1;
+    
+    cl_int error;
+    error   = clGetDeviceInfo(self->runtime->device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &deviceByteCount, NULL);
+    error  |= clGetKernelWorkGroupInfo(self->cooperativeKernel, self->runtime->device, CL_KERNEL_LOCAL_MEM_SIZE, sizeof(cl_ulong), &kernelByteCount, NULL);
+    error  |= clGetKernelWorkGroupInfo(self->cooperativeKernel, self->runtime->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernelWorkGroupSize, NULL);
+    assert(error == CL_SUCCESS);
+    
+    size_t rowsByteCount = 5 * self->maximumPaletteRowCount * sizeof(Float32);
+    size_t inputsByteCount = (self->analysisRowCount + self->maximumPaletteRowCount) * self->maximumColumnCount * sizeof(Float32);
+    
+    if (kernelByteCount + rowsByteCount + sizeof(Float32) > deviceByteCount) {
+        
+        self->maximumWorkGroupSize = 0;
+        
+        return;
+    }
+    
+    self->maximumWorkGroupSize = kernelWorkGroupSize;
+    self->stageInputs = kernelByteCount + rowsByteCount + inputsByteCount <= deviceByteCount ? 1 : 0;
+    
+    error   = clSetKernelArg(self->cooperativeKernel, 10, sizeof(size_t), &self->maximumPaletteRowCount);
+    error  |= clSetKernelArg(self->cooperativeKernel, 11, rowsByteCount, NULL);
+    error  |= clSetKernelArg(self->cooperativeKernel, 12, self->stageInputs == 1 ? inputsByteCount : sizeof(Float32), NULL);
+    error  |= clSetKernelArg(self->cooperativeKernel, 13, sizeof(cl_int), &self->stageInputs);
+    assert(error == CL_SUCCESS);
+}
+
+/*
+ Sort the beats by length and split them into at most OPENCLBATCHDTW_MAXIMUM_BUCKET_COUNT buckets of
+ about the same number of beats, joining neighbours whose longest beats are the same length. Each
+ bucket's program has the segment and longest beat row counts compiled in.
+ */
+static void OpenCLBatchDTW_createBuckets(OpenCLBatchDTW *self,
+                                         Matrix32 *beats)
+{
+    size_t candidateCount = self->candidateCount;
+    cl_uint *candidateIndexes = calloc(candidateCount, sizeof(cl_uint));
+    Float32 *rowCounts = Matrix_getRow(beats, 1);
+    
+    for (size_t i = 0; i < candidateCount; ++i) {
+        
+        size_t j = i;
+        
+        while (j > 0 && rowCounts[candidateIndexes[j - 1]] > rowCounts[i]) {
+            
+            candidateIndexes[j] = candidateIndexes[j - 1];
+            j--;
+        }
+        
+        candidateIndexes[j] = (cl_uint)i;
+    }
+    
+    self->buckets = calloc(OPENCLBATCHDTW_MAXIMUM_BUCKET_COUNT, sizeof(OpenCLBatchDTW_Bucket));
+    self->bucketCount = 0;
+    
+    for (size_t i = 0; i < OPENCLBATCHDTW_MAXIMUM_BUCKET_COUNT; ++i) {
+        
+        size_t first = i * candidateCount / OPENCLBATCHDTW_MAXIMUM_BUCKET_COUNT;
+        size_t end = (i + 1) * candidateCount / OPENCLBATCHDTW_MAXIMUM_BUCKET_COUNT;
+        
+        if (end == first) {
+            
+            continue;
+        }
+        
+        size_t maximumRowCount = (size_t)rowCounts[candidateIndexes[end - 1]];
+        OpenCLBatchDTW_Bucket *previous = self->bucketCount > 0 ? &self->buckets[self->bucketCount - 1] : NULL;
+        
+        if (previous != NULL && previous->maximumRowCount == maximumRowCount) {
+            
+            previous->candidateCount += end - first;
+        }
+        else {
+            
+            OpenCLBatchDTW_Bucket *bucket = &self->buckets[self->bucketCount];
+            bucket->firstCandidate = first;
+            bucket->candidateCount = end - first;
+            bucket->maximumRowCount = maximumRowCount > 0 ? maximumRowCount : 1;
+            self->bucketCount++;
+        }
+    }
+    
+    self->candidateIndexesMemory = OpenCLBatchDTW_createBuffer(self, candidateCount * sizeof(cl_uint), CL_MEM_READ_ONLY, candidateIndexes);
+    free(candidateIndexes);
+    
+    cl_int beatsArgument = 1;
+    
+    for (size_t i = 0; i < self->bucketCount; ++i) {
+        
+        OpenCLBatchDTW_Bucket *bucket = &self->buckets[i];
+        char options[128];
+        snprintf(options,
+                 sizeof(options),
+                 "-D OPENCLDTW_ANALYSIS_ROW_COUNT=%zu -D OPENCLDTW_MAXIMUM_PALETTE_ROW_COUNT=%zu",
+                 self->analysisRowCount,
+                 bucket->maximumRowCount);
+        
+        bucket->program = OpenCLRuntime_buildProgram(self->runtime, options);
+        
+        cl_int error;
+        bucket->kernel = clCreateKernel(bucket->program, "OpenCLDTW_bucketScores", &error);
+        assert(error == CL_SUCCESS);
+        
+        error   = clSetKernelArg(bucket->kernel,  1, sizeof(size_t), &self->analysisRowCount);
+        error  |= clSetKernelArg(bucket->kernel,  2, sizeof(cl_mem), &self->paletteMemory);
+        error  |= clSetKernelArg(bucket->kernel,  3, sizeof(cl_mem), &self->bandLayoutMemory);
+        error  |= clSetKernelArg(bucket->kernel,  4, sizeof(cl_mem), &self->paletteRowCountsMemory);
+        error  |= clSetKernelArg(bucket->kernel,  5, sizeof(cl_mem), &self->paletteRowIndexesMemory);
+        error  |= clSetKernelArg(bucket->kernel,  6, sizeof(cl_int), &beatsArgument);
+        error  |= clSetKernelArg(bucket->kernel,  8, sizeof(cl_int), &self->constraint);
+        error  |= clSetKernelArg(bucket->kernel,  9, sizeof(Float32), &self->constraintParameter);
+        error  |= clSetKernelArg(bucket->kernel, 10, sizeof(cl_mem), &self->candidateIndexesMemory);
+        error  |= clSetKernelArg(bucket->kernel, 11, sizeof(size_t), &self->candidateCount);
+        assert(error == CL_SUCCESS);
+    }
+}
+
+static void OpenCLBatchDTW_enqueue(OpenCLBatchDTW *self,
+                                   Boolean readScores);
+
+static Boolean OpenCLBatchDTW_waitAndCollect(OpenCLBatchDTW *self,
+                                             size_t *bestIndexes,
+                                             Float32 *scores);
+
+/*
+ Seconds taken by OPENCLBATCHDTW_TUNING_RUNS searches of whatever the slots hold, after one untimed
+ search so the kernel is warm.
+ */
+static double OpenCLBatchDTW_timeSearches(OpenCLBatchDTW *self)
+{
+    OpenCLBatchDTW_enqueue(self, false);
+    OpenCLBatchDTW_waitAndCollect(self, NULL, NULL);
+    
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    
+    for (size_t i = 0; i < OPENCLBATCHDTW_TUNING_RUNS; ++i) {
+        
+        OpenCLBatchDTW_enqueue(self, false);
+        OpenCLBatchDTW_waitAndCollect(self, NULL, NULL);
+    }
+    
+    gettimeofday(&end, NULL);
+    
+    return (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_usec - start.tv_usec) * 1e-6;
+}
+
+/*
+ Time one work-item per candidate, unless its private arrays would be too large, and cooperative
+ work-groups from the preferred multiple up to the first size covering a candidate's rows, keeping
+ the fastest.
+ */
+static void OpenCLBatchDTW_tuneWorkGroupSize(OpenCLBatchDTW *self)
+{
+    size_t privateByteCount = 2 * self->analysisRowCount * self->maximumPaletteRowCount * sizeof(Float32);
+    double bestTime = INFINITY;
+    
+    if (privateByteCount <= OPENCLBATCHDTW_MAXIMUM_PRIVATE_BYTES || self->maximumWorkGroupSize == 0) {
+        
+        self->workGroupSize = 0;
+        bestTime = OpenCLBatchDTW_timeSearches(self);
+    }
+    
+    if (self->maximumWorkGroupSize == 0) {
+        
+        return;
+    }
+    
+    size_t preferredMultiple = 1;
+    cl_int error = clGetKernelWorkGroupInfo(self->cooperativeKernel,
+                                            self->runtime->device,
+                                            CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE,
+                                            sizeof(size_t),
+                                            &preferredMultiple,
+                                            NULL);
+    assert(error == CL_SUCCESS);
+    
+    size_t bestWorkGroupSize = self->workGroupSize;
+    
+    for (size_t size = preferredMultiple > 0 ? preferredMultiple : 1; size <= self->maximumWorkGroupSize; size *= 2) {
+        
+        self->workGroupSize = size;
+        double time = OpenCLBatchDTW_timeSearches(self);
+        
+        if (time < bestTime) {
+            
+            bestTime = time;
+            bestWorkGroupSize = size;
+        }
+        
+        if (size >= self->maximumPaletteRowCount) {
+            
+            break;
+        }
+    }
+    
+    self->workGroupSize = bestWorkGroupSize;
+}
+
+OpenCLBatchDTW *OpenCLBatchDTW_new(OpenCLDTW_Device device,
+                                   size_t analysisRowCount,
+                                   Matrix32 **paletteBands,
+                                   size_t bandCount,
+                                   Float32 *paletteStorage,
+                                   Matrix32 *beats,
+                                   Boolean useBeats)
+{
+    OpenCLBatchDTW *self = calloc(1, sizeof(OpenCLBatchDTW));
+    
+    self->runtime = OpenCLRuntime_retain(device);
+    self->bandCount = bandCount;
+    self->analysisRowCount = analysisRowCount;
+    self->useBeats = useBeats;
+    self->candidateCount = useBeats == true ? beats->columnCount : paletteBands[0]->rowCount / analysisRowCount;
+    self->maximumPaletteRowCount = analysisRowCount;
+    self->bandLayout = calloc(4 * bandCount, sizeof(cl_uint));
+    
+    size_t paletteElementCount = 0;
+    
+    for (size_t i = 0; i < bandCount; ++i) {
+    
+        self->bandLayout[4 * i] = (cl_uint)self->analysisElementCount;
+        self->bandLayout[4 * i + 1] = (cl_uint)paletteElementCount;
+        self->bandLayout[4 * i + 2] = (cl_uint)paletteBands[i]->columnCount;
+        self->bandLayout[4 * i + 3] = (cl_uint)paletteBands[i]->rowCount;
+    
+        self->analysisElementCount += analysisRowCount * paletteBands[i]->columnCount;
+        paletteElementCount += paletteBands[i]->rowCount * paletteBands[i]->columnCount;
+        
+        if (paletteBands[i]->columnCount > self->maximumColumnCount) {
+            
+            self->maximumColumnCount = paletteBands[i]->columnCount;
+        }
+    }
+    
+    if (useBeats == true) {
+        
+        self->maximumPaletteRowCount = 1;
+        
+        for (size_t i = 0; i < beats->columnCount; ++i) {
+            
+            if ((size_t)Matrix_getRow(beats, 1)[i] > self->maximumPaletteRowCount) {
+                
+                self->maximumPaletteRowCount = (size_t)Matrix_getRow(beats, 1)[i];
+            }
+        }
+    }
+    
+    self->usesHostPalette = OpenCLRuntime_canUseHostMemory(self->runtime, paletteStorage);
+    
+    if (self->usesHostPalette == true) {
+        
+        paletteElementCount = 0;
+        
+        for (size_t i = 0; i < bandCount; ++i) {
+            
+            size_t paletteOffset = paletteBands[i]->data - paletteStorage;
+            self->bandLayout[4 * i + 1] = (cl_uint)paletteOffset;
+            
+            if (paletteOffset + paletteBands[i]->elementCount > paletteElementCount) {
+                
+                paletteElementCount = paletteOffset + paletteBands[i]->elementCount;
+            }
+        }
+        
+        self->paletteMemory = OpenCLBatchDTW_createBuffer(self, paletteElementCount * sizeof(Float32), CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, paletteStorage);
+    }
+    else {
+        
+        Float32 *paletteData = calloc(paletteElementCount, sizeof(Float32));
+        
+        for (size_t i = 0; i < bandCount; ++i) {
+        
+            memcpy(&paletteData[self->bandLayout[4 * i + 1]],
+                   paletteBands[i]->data,
+                   paletteBands[i]->rowCount * paletteBands[i]->columnCount * sizeof(Float32));
+        }
+        
+        self->paletteMemory = OpenCLBatchDTW_createBuffer(self, paletteElementCount * sizeof(Float32), CL_MEM_READ_ONLY, paletteData);
+        free(paletteData);
+    }
+    
+    self->bandLayoutMemory = OpenCLBatchDTW_createBuffer(self, 4 * bandCount * sizeof(cl_uint), CL_MEM_READ_ONLY, self->bandLayout);
+    
+    if (useBeats == true) {
+    
+        self->paletteRowCountsMemory = OpenCLBatchDTW_createBuffer(self, beats->columnCount * sizeof(Float32), CL_MEM_READ_ONLY, Matrix_getRow(beats, 1));
+        self->paletteRowIndexesMemory = OpenCLBatchDTW_createBuffer(self, beats->columnCount * sizeof(Float32), CL_MEM_READ_ONLY, Matrix_getRow(beats, 0));
+    }
+    else {
+    
+        self->paletteRowCountsMemory = OpenCLBatchDTW_createBuffer(self, sizeof(Float32), CL_MEM_READ_ONLY, NULL);
+        self->paletteRowIndexesMemory = OpenCLBatchDTW_createBuffer(self, sizeof(Float32), CL_MEM_READ_ONLY, NULL);
+    }
+    
+    for (size_t i = 0; i < OPENCLBATCHDTW_SLOT_COUNT; ++i) {
+        
+        OpenCLBatchDTW_Slot *slot = &self->slots[i];
+        slot->analysisData = calloc(self->analysisElementCount, sizeof(Float32));
+        slot->matches = calloc(2 * bandCount, sizeof(cl_uint));
+        slot->scores = calloc(bandCount * self->candidateCount, sizeof(Float32));
+        slot->analysisMemory = OpenCLBatchDTW_createBuffer(self, self->analysisElementCount * sizeof(Float32), CL_MEM_READ_ONLY, NULL);
+        slot->scoresMemory = OpenCLBatchDTW_createBuffer(self, bandCount * self->candidateCount * sizeof(Float32), CL_MEM_READ_WRITE, NULL);
+        slot->matchesMemory = OpenCLBatchDTW_createBuffer(self, 2 * bandCount * sizeof(cl_uint), CL_MEM_WRITE_ONLY, NULL);
+    }
+    
+    cl_int error;
+    self->scoresKernel = clCreateKernel(self->runtime->program, "OpenCLDTW_batchScores", &error);
+    assert(error == CL_SUCCESS);
+    self->cooperativeKernel = clCreateKernel(self->runtime->program, "OpenCLDTW_batchScoresCooperative", &error);
+    assert(error == CL_SUCCESS);
+    self->argminKernel = clCreateKernel(self->runtime->program, "OpenCLDTW_batchArgmin", &error);
+    assert(error == CL_SUCCESS);
+    
+    self->reductionSize = OpenCLBatchDTW_chooseReductionSize(self);
+    
+    cl_int beatsArgument = useBeats == true ? 1 : 0;
+    
+    error = CL_SUCCESS;
+    
+    for (size_t i = 0; i < 2; ++i) {
+        
+        cl_kernel kernel = i == 0 ? self->scoresKernel : self->cooperativeKernel;
+        error  |= clSetKernelArg(kernel,  1, sizeof(size_t), &self->analysisRowCount);
+        error  |= clSetKernelArg(kernel,  2, sizeof(cl_mem), &self->paletteMemory);
+        error  |= clSetKernelArg(kernel,  3, sizeof(cl_mem), &self->bandLayoutMemory);
+        error  |= clSetKernelArg(kernel,  4, sizeof(cl_mem), &self->paletteRowCountsMemory);
+        error  |= clSetKernelArg(kernel,  5, sizeof(cl_mem), &self->paletteRowIndexesMemory);
+        error  |= clSetKernelArg(kernel,  6, sizeof(cl_int), &beatsArgument);
+        error  |= clSetKernelArg(kernel,  8, sizeof(cl_int), &self->constraint);
+        error  |= clSetKernelArg(kernel,  9, sizeof(Float32), &self->constraintParameter);
+    }
+    
+    error  |= clSetKernelArg(self->argminKernel,  1, sizeof(size_t), &self->candidateCount);
+    error  |= clSetKernelArg(self->argminKernel,  3, self->reductionSize * sizeof(Float32), NULL);
+    error  |= clSetKernelArg(self->argminKernel,  4, self->reductionSize * sizeof(cl_uint), NULL);
+    
+    assert(error == CL_SUCCESS);
+    
+    if (useBeats == true && self->candidateCount > 0) {
+        
+        OpenCLBatchDTW_createBuckets(self, beats);
+    }
+    
+    OpenCLBatchDTW_allocateLocalMemory(self);
+    OpenCLBatchDTW_tuneWorkGroupSize(self);
+    
+    return self;
+}
+
+void OpenCLBatchDTW_delete(OpenCLBatchDTW *self)
+{
+    for (size_t i = 0; i < self->pendingCount; ++i) {
+        
+        OpenCLBatchDTW_Slot *slot = &self->slots[(self->collectSlot + i) % OPENCLBATCHDTW_SLOT_COUNT];
+        clWaitForEvents(1, &slot->readEvent);
+        clReleaseEvent(slot->readEvent);
+    }
+    
+    for (size_t i = 0; i < OPENCLBATCHDTW_SLOT_COUNT; ++i) {
+        
+        OpenCLBatchDTW_Slot *slot = &self->slots[i];
+        clReleaseMemObject(slot->analysisMemory);
+        clReleaseMemObject(slot->scoresMemory);
+        clReleaseMemObject(slot->matchesMemory);
+        free(slot->analysisData);
+        free(slot->matches);
+        free(slot->scores);
+    }
+    
+    for (size_t i = 0; i < self->bucketCount; ++i) {
+        
+        clReleaseKernel(self->buckets[i].kernel);
+        clReleaseProgram(self->buckets[i].program);
+    }
+    
+    if (self->candidateIndexesMemory != NULL) {
+        
+        clReleaseMemObject(self->candidateIndexesMemory);
+    }
+    
+    clReleaseKernel(self->scoresKernel);
+    clReleaseKernel(self->cooperativeKernel);
+    clReleaseKernel(self->argminKernel);
+    clReleaseMemObject(self->paletteMemory);
+    clReleaseMemObject(self->bandLayoutMemory);
+    clReleaseMemObject(self->paletteRowCountsMemory);
+    clReleaseMemObject(self->paletteRowIndexesMemory);
+    OpenCLRuntime_release(self->runtime);
+    
+    free(self->bandLayout);
+    free(self->buckets);
+    free(self);
+    self = NULL;
+}
+
+void OpenCLBatchDTW_setConstraint(OpenCLBatchDTW *self,
+                                  DTWConstraint constraint,
+                                  Float32 constraintParameter)
+{
+    if (self->pendingCount != 0) {
+        
+        printf("OpenCLBatchDTW_setConstraint, submitted searches not collected, exiting\n");
+        exit(-1);
+    }
+    
+    self->constraint = constraint;
+    self->constraintParameter = constraintParameter;
+    
+    cl_int error;
+    error   = clSetKernelArg(self->scoresKernel, 8, sizeof(cl_int), &self->constraint);
+    error  |= clSetKernelArg(self->scoresKernel, 9, sizeof(Float32), &self->constraintParameter);
+    error  |= clSetKernelArg(self->cooperativeKernel, 8, sizeof(cl_int), &self->constraint);
+    error  |= clSetKernelArg(self->cooperativeKernel, 9, sizeof(Float32), &self->constraintParameter);
+    
+    for (size_t i = 0; i < self->bucketCount; ++i) {
+        
+        error  |= clSetKernelArg(self->buckets[i].kernel, 8, sizeof(cl_int), &self->constraint);
+        error  |= clSetKernelArg(self->buckets[i].kernel, 9, sizeof(Float32), &self->constraintParameter);
+    }
+    
+    assert(error == CL_SUCCESS);
+    
+    OpenCLBatchDTW_tuneWorkGroupSize(self);
+}
+
+void OpenCLBatchDTW_setWorkGroupSize(OpenCLBatchDTW *self,
+                                     size_t workGroupSize)
+{
+    if (workGroupSize > self->maximumWorkGroupSize) {
+        
+        printf("OpenCLBatchDTW_setWorkGroupSize, the device runs the cooperative kernel with at most %zu work-items, exiting\n", self->maximumWorkGroupSize);
+        exit(-1);
+    }
+    
+    self->workGroupSize = workGroupSize;
+}
+
+Boolean OpenCLBatchDTW_submit(OpenCLBatchDTW *self,
+                              Matrix32 **analysisBands,
+                              Boolean readScores)
+{
+    if (self->pendingCount == OPENCLBATCHDTW_SLOT_COUNT) {
+        
+        return false;
+    }
+    
+    OpenCLBatchDTW_Slot *slot = &self->slots[self->submitSlot];
+    
+    for (size_t i = 0; i < self->bandCount; ++i) {
+        
+        memcpy(&slot->analysisData[self->bandLayout[4 * i]],
+               analysisBands[i]->data,
+               self->analysisRowCount * self->bandLayout[4 * i + 2] * sizeof(Float32));
+    }
+    
+    OpenCLBatchDTW_enqueue(self, readScores);
+    
+    return true;
+}
+
+/*
+ Enqueue the search of the next slot's packed queries.
+ */
+static void OpenCLBatchDTW_enqueue(OpenCLBatchDTW *self,
+                                   Boolean readScores)
+{
+    OpenCLBatchDTW_Slot *slot = &self->slots[self->submitSlot];
+    slot->readsScores = readScores;
+    Boolean useBuckets = self->workGroupSize == 0 && self->bucketCount > 0;
+    cl_kernel scoresKernel = self->workGroupSize == 0 ? self->scoresKernel : self->cooperativeKernel;
+    
+    /*
+     The kernel arguments are captured when each launch is enqueued, so both slots share the kernels.
+     */
+    cl_int error;
+    error   = clSetKernelArg(scoresKernel, 0, sizeof(cl_mem), &slot->analysisMemory);
+    error  |= clSetKernelArg(scoresKernel, 7, sizeof(cl_mem), &slot->scoresMemory);
+    error  |= clSetKernelArg(self->argminKernel, 0, sizeof(cl_mem), &slot->scoresMemory);
+    error  |= clSetKernelArg(self->argminKernel, 2, sizeof(cl_mem), &slot->matchesMemory);
+    
+    for (size_t i = 0; useBuckets == true && i < self->bucketCount; ++i) {
+        
+        error  |= clSetKernelArg(self->buckets[i].kernel, 0, sizeof(cl_mem), &slot->analysisMemory);
+        error  |= clSetKernelArg(self->buckets[i].kernel, 7, sizeof(cl_mem), &slot->scoresMemory);
+    }
+    
+    assert(error == CL_SUCCESS);
+    
+    cl_event writeEvent;
+    cl_event scoresEvents[OPENCLBATCHDTW_MAXIMUM_BUCKET_COUNT];
+    cl_uint scoresEventCount = 0;
+    
+    error = clEnqueueWriteBuffer(self->runtime->commandQueue,
+                                 slot->analysisMemory,
+                                 CL_FALSE,
+                                 0,
+                                 self->analysisElementCount * sizeof(Float32),
+                                 slot->analysisData,
+                                 0,
+                                 NULL,
+                                 &writeEvent);
+    assert(error == CL_SUCCESS);
+    
+    if (useBuckets == true) {
+        
+        for (size_t i = 0; i < self->bucketCount; ++i) {
+            
+            size_t globalWorkOffset[2] = {self->buckets[i].firstCandidate, 0};
+            size_t globalWorkSize[2] = {self->buckets[i].candidateCount, self->bandCount};
+            
+            error = clEnqueueNDRangeKernel(self->runtime->commandQueue,
+                                           self->buckets[i].kernel,
+                                           2,
+                                           globalWorkOffset,
+                                           globalWorkSize,
+                                           NULL,
+                                           1,
+                                           &writeEvent,
+                                           &scoresEvents[scoresEventCount++]);
+            assert(error == CL_SUCCESS);
+        }
+    }
+    else {
+        
+        size_t globalWorkSize[2] = {self->candidateCount, self->bandCount};
+        size_t localWorkSize[2] = {self->workGroupSize, 1};
+        
+        if (self->workGroupSize != 0) {
+            
+            globalWorkSize[0] *= self->workGroupSize;
+        }
+        
+        error = clEnqueueNDRangeKernel(self->runtime->commandQueue,
+                                       scoresKernel,
+                                       2,
+                                       NULL,
+                                       globalWorkSize,
+                                       self->workGroupSize == 0 ? NULL : localWorkSize,
+                                       1,
+                                       &writeEvent,
+                                       &scoresEvents[scoresEventCount++]);
+        assert(error == CL_SUCCESS);
+    }
+    
+    clReleaseEvent(writeEvent);
+    
+    if (readScores == true) {
+        
+        error = clEnqueueReadBuffer(self->runtime->commandQueue,
+                                    slot->scoresMemory,
+                                    CL_FALSE,
+                                    0,
+                                    self->bandCount * self->candidateCount * sizeof(Float32),
+                                    slot->scores,
+                                    scoresEventCount,
+                                    scoresEvents,
+                                    &slot->readEvent);
+        assert(error == CL_SUCCESS);
+    }
+    else {
+        
+        cl_event argminEvent;
+        size_t reductionWorkSize = self->bandCount * self->reductionSize;
+        
+        error = clEnqueueNDRangeKernel(self->runtime->commandQueue,
+                                       self->argminKernel,
+                                       1,
+                                       NULL,
+                                       &reductionWorkSize,
+                                       &self->reductionSize,
+                                       scoresEventCount,
+                                       scoresEvents,
+                                       &argminEvent);
+        assert(error == CL_SUCCESS);
+        
+        error = clEnqueueReadBuffer(self->runtime->commandQueue,
+                                    slot->matchesMemory,
+                                    CL_FALSE,
+                                    0,
+                                    2 * self->bandCount * sizeof(cl_uint),
+                                    slot->matches,
+                                    1,
+                                    &argminEvent,
+                                    &slot->readEvent);
+        assert(error == CL_SUCCESS);
+        clReleaseEvent(argminEvent);
+    }
+    
+    for (cl_uint i = 0; i < scoresEventCount; ++i) {
+        
+        clReleaseEvent(scoresEvents[i]);
+    }
+    
+    error = clFlush(self->runtime->commandQueue);
+    assert(error == CL_SUCCESS);
+    
+    self->submitSlot = (self->submitSlot + 1) % OPENCLBATCHDTW_SLOT_COUNT;
+    self->pendingCount++;
+}
+
+Boolean OpenCLBatchDTW_collect(OpenCLBatchDTW *self,
+                               size_t *bestIndexes,
+                               Float32 *scores)
+{
+    if (self->pendingCount == 0) {
+        
+        return false;
+    }
+    
+    OpenCLBatchDTW_Slot *slot = &self->slots[self->collectSlot];
+    cl_int status;
+    cl_int error = clGetEventInfo(slot->readEvent,
+                                  CL_EVENT_COMMAND_EXECUTION_STATUS,
+                                  sizeof(cl_int),
+                                  &status,
+                                  NULL);
+    assert(error == CL_SUCCESS);
+    
+    if (status > CL_COMPLETE) {
+        
+        return false;
+    }
+    
+    clReleaseEvent(slot->readEvent);
+    slot->readEvent = NULL;
+    
+    if (status < CL_COMPLETE) {
+        
+        self->failedSearchCount++;
+        self->collectSlot = (self->collectSlot + 1) % OPENCLBATCHDTW_SLOT_COUNT;
+        self->pendingCount--;
+        
+        return false;
+    }
+    
+    if (slot->readsScores == true) {
+        
+        if (scores != NULL) {
+            
+            memcpy(scores, slot->scores, self->bandCount * self->candidateCount * sizeof(Float32));
+        }
+    }
+    else {
+        
+        for (size_t i = 0; i < self->bandCount; ++i) {
+            
+            if (bestIndexes != NULL) {
+                
+                bestIndexes[i] = slot->matches[2 * i];
+            }
+            
+            if (scores != NULL) {
+                
+                memcpy(&scores[i], &slot->matches[2 * i + 1], sizeof(Float32));
+            }
+        }
+    }
+    
+    self->collectSlot = (self->collectSlot + 1) % OPENCLBATCHDTW_SLOT_COUNT;
+    self->pendingCount--;
+    
+    return true;
+}
+
+static Boolean OpenCLBatchDTW_waitAndCollect(OpenCLBatchDTW *self,
+                                             size_t *bestIndexes,
+                                             Float32 *scores)
+{
+    cl_int error = clWaitForEvents(1, &self->slots[self->collectSlot].readEvent);
+    assert(error == CL_SUCCESS || error == CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST);
+    
+    return OpenCLBatchDTW_collect(self, bestIndexes, scores);
+}
+
+/*
+ Submit a search into an idle instance and wait for its read to complete.
+ */
+static Boolean OpenCLBatchDTW_search(OpenCLBatchDTW *self,
+                                     Matrix32 **analysisBands,
+                                     Boolean readScores,
+                                     size_t *bestIndexes,
+                                     Float32 *scores)
+{
+    if (self->pendingCount != 0) {
+        
+        printf("OpenCLBatchDTW_search, submitted searches not collected, exiting\n");
+        exit(-1);
+    }
+    
+    OpenCLBatchDTW_submit(self, analysisBands, readScores);
+    return OpenCLBatchDTW_waitAndCollect(self, bestIndexes, scores);
+}
+
+Boolean OpenCLBatchDTW_findBestMatches(OpenCLBatchDTW *self,
+                                       Matrix32 **analysisBands,
+                                       size_t *bestIndexes,
+                                       Float32 *bestScores)
+{
+    return OpenCLBatchDTW_search(self, analysisBands, false, bestIndexes, bestScores);
+}
+
+Boolean OpenCLBatchDTW_getScores(OpenCLBatchDTW *self,
+                                 Matrix32 **analysisBands,
+                                 Float32 *scores)
+{
+    return OpenCLBatchDTW_search(self, analysisBands, true, NULL, scores);
+}
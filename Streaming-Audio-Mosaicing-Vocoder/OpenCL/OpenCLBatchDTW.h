@@ -0,0 +1,274 @@
+    //
+    //  OpenCLBatchDTW.h
+    //  Streaming-Audio-Mosaicing-Vocoder
+    //
+
+#import <MacTypes.h>
+#import <stdlib.h>
+#import <OpenCL/OpenCL.h>
+#import "Matrix.h"
+#import "DTW.h"
+#import "OpenCLRuntime.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    
+    /*!
+     The most work-items reducing one band's scores to its best candidate.
+     */
+#define OPENCLBATCHDTW_MAXIMUM_REDUCTION_SIZE 64
+    
+    /*!
+     The number of searches that can be in flight at once.
+     */
+#define OPENCLBATCHDTW_SLOT_COUNT 2
+    
+    /*!
+     The most bytes of per work-item arrays OpenCLDTW_batchScores is tuned with, above it only the cooperative kernel is tried.
+     */
+#define OPENCLBATCHDTW_MAXIMUM_PRIVATE_BYTES 16384
+    
+    /*!
+     The number of timed searches per work-group size when tuning.
+     */
+#define OPENCLBATCHDTW_TUNING_RUNS 3
+    
+    /*!
+     The most length buckets the beats are split into.
+     */
+#define OPENCLBATCHDTW_MAXIMUM_BUCKET_COUNT 4
+    
+    /*!
+     @class OpenCLBatchDTW_Bucket
+     @abstract Beats of similar length scored by one launch of a program specialised for them.
+     @var firstCandidate
+     The position of the bucket's first beat in the length sorted candidate indexes.
+     @var candidateCount
+     The number of beats in the bucket.
+     @var maximumRowCount
+     The length of the bucket's longest beat, compiled into its program.
+     @var program
+     OpenCLDTW.cl built with the segment and bucket row counts defined.
+     @var kernel
+     The bucket's OpenCLDTW_bucketScores.
+     */
+    typedef struct OpenCLBatchDTW_Bucket
+    {
+        size_t firstCandidate;
+        size_t candidateCount;
+        size_t maximumRowCount;
+        cl_program program;
+        cl_kernel kernel;
+        
+    } OpenCLBatchDTW_Bucket;
+    
+    /*!
+     @class OpenCLBatchDTW_Slot
+     @abstract The buffers of one search in flight, so a search can be packed and enqueued while the previous one is still on the device.
+     @var analysisData
+     All bands' queries packed one after another for a single upload, left untouched until the upload completes.
+     @var matches
+     The best candidate index and score bits of each band, as read back.
+     @var scores
+     Every candidate's score band by band, as read back when readsScores is true.
+     @var analysisMemory
+     The device copy of analysisData.
+     @var scoresMemory
+     Every candidate's score band by band.
+     @var matchesMemory
+     The reduced (index, score) pair of each band.
+     @var readEvent
+     The event of the read ending the search, the search is complete when it is.
+     @var readsScores
+     Whether the search reads every score back instead of reducing on the device.
+     */
+    typedef struct OpenCLBatchDTW_Slot
+    {
+        Float32 *analysisData;
+        cl_uint *matches;
+        Float32 *scores;
+        cl_mem analysisMemory;
+        cl_mem scoresMemory;
+        cl_mem matchesMemory;
+        cl_event readEvent;
+        Boolean readsScores;
+        
+    } OpenCLBatchDTW_Slot;
+    
+    /*!
+     @class OpenCLBatchDTW
+     @abstract Scores every candidate of every band in one launch. The palettes of all bands live in one device buffer, a (candidate, band) kernel writes every score and a work-group per band reduces them to the best candidate, so a search is one upload, two kernels and one read of an (index, score) pair per band. The scores come from one work-item per candidate, with beats split into length buckets so the work-items of a launch finish together, or from a work-group per candidate sweeping the rows of the accumulated matrix through local memory, whichever is faster on the device. Searches are enqueued into OPENCLBATCHDTW_SLOT_COUNT ping-pong slots chained by events, <b>OpenCLBatchDTW_submit</b> and <b>OpenCLBatchDTW_collect</b> never wait on the device.
+     @var runtime
+     The shared context, program and queue.
+     @var bandCount
+     The number of bands searched together.
+     @var analysisRowCount
+     The number of rows in each band's query.
+     @var candidateCount
+     The number of candidates per band, palette windows or beats.
+     @var analysisElementCount
+     The number of floats in all bands' queries together.
+     @var useBeats
+     Whether candidates are beats rather than fixed windows.
+     @var constraint
+     The global path constraint.
+     @var constraintParameter
+     The Sakoe-Chiba radius in rows, or the Itakura slope.
+     @var bandLayout
+     For each band its query offset and palette offset in floats, its column count and its palette row count.
+     @var slots
+     The per search buffers, used in turn.
+     @var submitSlot
+     The slot the next search is enqueued into.
+     @var collectSlot
+     The oldest search in flight.
+     @var pendingCount
+     The number of searches submitted and not yet collected.
+     @var failedSearchCount
+     The number of searches the device failed, collected without results.
+     @var reductionSize
+     The work-group size of the reduction, a power of 2.
+     @var maximumPaletteRowCount
+     The most palette rows of any candidate, the length of each local row of the cooperative kernel.
+     @var maximumColumnCount
+     The most columns of any band.
+     @var stageInputs
+     Whether the cooperative kernel copies the query and candidate into local memory, when they fit alongside its rows.
+     @var maximumWorkGroupSize
+     The largest work-group the cooperative kernel runs with, 0 when its rows do not fit in local memory.
+     @var workGroupSize
+     The work-group size of the cooperative kernel, or 0 to score with one work-item per candidate, tuned when constructed and again when the constraint is set.
+     @var buckets
+     The length buckets of the beats, scored in place of one launch over every beat when workGroupSize is 0.
+     @var bucketCount
+     The number of buckets, 0 when candidates are fixed windows.
+     @var usesHostPalette
+     True when paletteMemory wraps the caller's palette storage in place instead of a packed copy, which then must outlive the batch unchanged.
+     */
+    typedef struct OpenCLBatchDTW
+    {
+        OpenCLRuntime *runtime;
+        size_t bandCount;
+        size_t analysisRowCount;
+        size_t candidateCount;
+        size_t analysisElementCount;
+        Boolean useBeats;
+        cl_int constraint;
+        Float32 constraintParameter;
+        cl_uint *bandLayout;
+        OpenCLBatchDTW_Slot slots[OPENCLBATCHDTW_SLOT_COUNT];
+        size_t submitSlot;
+        size_t collectSlot;
+        size_t pendingCount;
+        size_t failedSearchCount;
+        size_t reductionSize;
+        size_t maximumPaletteRowCount;
+        size_t maximumColumnCount;
+        cl_int stageInputs;
+        size_t maximumWorkGroupSize;
+        size_t workGroupSize;
+        OpenCLBatchDTW_Bucket *buckets;
+        size_t bucketCount;
+        Boolean usesHostPalette;
+    
+        cl_kernel scoresKernel;
+        cl_kernel cooperativeKernel;
+        cl_kernel argminKernel;
+        cl_mem paletteMemory;
+        cl_mem bandLayoutMemory;
+        cl_mem paletteRowCountsMemory;
+        cl_mem paletteRowIndexesMemory;
+        cl_mem candidateIndexesMemory;
+    
+    } OpenCLBatchDTW;
+    
+    /*!
+     Construct an OpenCLBatchDTW, upload or wrap the palettes and time the scoring kernels to choose <i>workGroupSize</i>.
+     @param analysisRowCount
+     The number of rows in each band's query.
+     @param paletteBands
+     The palette of each band, band i has as many columns as query band i.
+     @param paletteStorage
+     The block every palette band's data lies in, such as the triangleBandStorage of AudioAnalysisData32, searched in place when the device shares host memory, or NULL to always copy the palettes to the device.
+     @param beats
+     The palette beat starts and lengths, used when useBeats is true.
+     */
+    OpenCLBatchDTW *OpenCLBatchDTW_new(OpenCLDTW_Device device,
+                                       size_t analysisRowCount,
+                                       Matrix32 **paletteBands,
+                                       size_t bandCount,
+                                       Float32 *paletteStorage,
+                                       Matrix32 *beats,
+                                       Boolean useBeats);
+    
+    void OpenCLBatchDTW_delete(OpenCLBatchDTW *self);
+    
+    /*!
+     Apply a global path constraint to every kernel and tune the work-group size again, the constraint changes how many cells each candidate costs. This must not be called while submitted searches are waiting to be collected.
+     */
+    void OpenCLBatchDTW_setConstraint(OpenCLBatchDTW *self,
+                                      DTWConstraint constraint,
+                                      Float32 constraintParameter);
+    
+    /*!
+     Score with one work-item per candidate when workGroupSize is 0, otherwise with work-groups of workGroupSize cooperating on each candidate, overriding the size tuned when constructed or when the constraint was set.
+     */
+    void OpenCLBatchDTW_setWorkGroupSize(OpenCLBatchDTW *self,
+                                         size_t workGroupSize);
+    
+    /*!
+     Pack the queries and enqueue a search into the next free slot without waiting on the device, the upload, kernels and read are chained by events and flushed.
+     @param readScores
+     Read every candidate's score back instead of only each band's best.
+     @return
+     False, with nothing enqueued, when every slot still holds a search that has not been collected.
+     */
+    Boolean OpenCLBatchDTW_submit(OpenCLBatchDTW *self,
+                                  Matrix32 **analysisBands,
+                                  Boolean readScores);
+    
+    /*!
+     Collect the oldest search in flight if the device has finished it, without waiting. A search the device failed frees its slot, leaves the outputs untouched and is counted in <i>failedSearchCount</i>.
+     @param bestIndexes
+     Output, bandCount candidate indexes, left untouched when the search read every score, may be NULL.
+     @param scores
+     Output, bandCount best scores, or bandCount * candidateCount scores band by band when the search read every score, may be NULL.
+     @return
+     True when a search was collected with its results.
+     */
+    Boolean OpenCLBatchDTW_collect(OpenCLBatchDTW *self,
+                                   size_t *bestIndexes,
+                                   Float32 *scores);
+    
+    /*!
+     Find the best candidate of every band, ties going to the lower index, waiting for the result. This must not be called while submitted searches are waiting to be collected.
+     @param analysisBands
+     The query of each band, analysisRowCount rows.
+     @param bestIndexes
+     Output, bandCount candidate indexes.
+     @param bestScores
+     Output, bandCount scores, may be NULL.
+     @return
+     False, with the outputs untouched, when the device failed the search.
+     */
+    Boolean OpenCLBatchDTW_findBestMatches(OpenCLBatchDTW *self,
+                                           Matrix32 **analysisBands,
+                                           size_t *bestIndexes,
+                                           Float32 *bestScores);
+    
+    /*!
+     Score every candidate of every band with a single launch and read, waiting for the result. This must not be called while submitted searches are waiting to be collected.
+     @param scores
+     Output, bandCount * candidateCount scores, band by band.
+     @return
+     False, with the scores untouched, when the device failed the search.
+     */
+    Boolean OpenCLBatchDTW_getScores(OpenCLBatchDTW *self,
+                                     Matrix32 **analysisBands,
+                                     Float32 *scores);
+    
+#ifdef __cplusplus
+}
+#endif
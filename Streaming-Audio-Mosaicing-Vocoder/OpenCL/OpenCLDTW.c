@@ -42,64 +42,31 @@ OpenCLDTW *OpenCLDTW_new(OpenCLDTW_Device device,
     self->paletteBeatIndexes = Matrix_getRow(beats, 0);
     self->paletteBeatCounts = Matrix_getRow(beats, 1);
     self->beatsCount = beats->columnCount;
-    cl_int error;
+    self->runtime = OpenCLRuntime_retain(device);
+    
+    self->analysisMemory = OpenCLDTW_allocateFloatBuffer(self,
+                                                         self->maximumElementCount,
+                                                         CL_MEM_READ_ONLY);
     
-    if (device == OpenCLDTW_useCPU) {
+    
+    if (OpenCLRuntime_canUseHostMemory(self->runtime, self->paletteData) == true) {
         
-        error = clGetDeviceIDs(NULL, CL_DEVICE_TYPE_CPU, 1, &self->device, NULL);
+        cl_int error;
+        self->paletteMemory = clCreateBuffer(self->runtime->context,
+                                             CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+                                             sizeof(Float32) * self->paletteRowCount * self->maximumColumnCount,
+                                             self->paletteData,
+                                             &error);
         assert(error == CL_SUCCESS);
     }
     else {
         
-        error = clGetDeviceIDs(NULL, CL_DEVICE_TYPE_GPU, 1, &self->device, NULL);
-        assert(error == CL_SUCCESS);
-    }
-    
-    assert(self->device);
-    
-    self->context = clCreateContext(0, 1, &self->device, NULL, NULL, &error);
-    assert(error == CL_SUCCESS);
-    
-    self->commandQueue = clCreateCommandQueue(self->context, self->device, 0, NULL);
-    
-    const char *programFileName = "Streaming-Audio-Mosaicing-Vocoder/OpenCL/OpenCLDTW.cl";
-    char *programSource = OpenCLDTW_loadProgramSource(programFileName);
-    
-    self->program = clCreateProgramWithSource(self->context,
-                                              1,
-                                              (const char **)&programSource,
-                                              NULL,
-                                              &error);
-    assert(error == CL_SUCCESS);
-    
-    error = clBuildProgram(self->program, 0, NULL,  NULL, NULL, NULL);
-    
-    if (error == CL_BUILD_PROGRAM_FAILURE) {
-            // Determine the size of the log
-        size_t log_size;
-        clGetProgramBuildInfo(self->program, self->device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-        
-            // Allocate memory for the log
-        char *log = (char *) malloc(log_size);
-        
-            // Get the log
-        clGetProgramBuildInfo(self->program, self->device, CL_PROGRAM_BUILD_LOG, log_size, log, NULL);
+        self->paletteMemory = OpenCLDTW_allocateFloatBuffer(self,
+                                                            self->paletteRowCount * self->maximumColumnCount,
+                                                            CL_MEM_READ_ONLY);
         
-            // Print the log
-        printf("%s\n", log);
+        OpenCLDTW_writeFloatBuffer(self, self->paletteMemory, self->paletteData, self->paletteRowCount * self->maximumColumnCount);
     }
-    assert(error == CL_SUCCESS);
-    
-    self->analysisMemory = OpenCLDTW_allocateFloatBuffer(self,
-                                                         self->maximumElementCount,
-                                                         CL_MEM_READ_ONLY);
-    
-    
-    self->paletteMemory = OpenCLDTW_allocateFloatBuffer(self,
-                                                        self->paletteRowCount * self->maximumColumnCount,
-                                                        CL_MEM_READ_ONLY);
-    
-    OpenCLDTW_writeFloatBuffer(self, self->paletteMemory, self->paletteData, self->paletteRowCount * self->maximumColumnCount);
     
     self->resultMemory = OpenCLDTW_allocateFloatBuffer(self,
                                                        self->globalWorkSize,
@@ -129,6 +96,8 @@ void OpenCLDTW_delete(OpenCLDTW *self)
         clReleaseMemObject(self->paletteRowCountsMemory);
     }
     
+    clReleaseKernel(self->kernel);
+    OpenCLRuntime_release(self->runtime);
     free(self);
     self = NULL;
 }
@@ -136,7 +105,7 @@ void OpenCLDTW_delete(OpenCLDTW *self)
 void OpenCLDTW_configureNoBeats(OpenCLDTW *self)
 {
     cl_int error;
-    self->kernel = clCreateKernel(self->program, "OpenCLDTW_noBeats", &error);
+    self->kernel = clCreateKernel(self->runtime->program, "OpenCLDTW_noBeats", &error);
     assert(error == CL_SUCCESS);
     
     error   = clSetKernelArg(self->kernel,  0, sizeof(cl_mem), &self->analysisMemory);
@@ -145,6 +114,8 @@ void OpenCLDTW_configureNoBeats(OpenCLDTW *self)
     error  |= clSetKernelArg(self->kernel,  3, sizeof(size_t), &self->maximumRowCount);
     error  |= clSetKernelArg(self->kernel,  4, sizeof(size_t), &self->maximumColumnCount);
     error  |= clSetKernelArg(self->kernel,  5, sizeof(cl_mem), &self->resultMemory);
+    error  |= clSetKernelArg(self->kernel,  6, sizeof(cl_int), &self->constraint);
+    error  |= clSetKernelArg(self->kernel,  7, sizeof(Float32), &self->constraintParameter);
     
     
     assert(error == CL_SUCCESS);
@@ -153,7 +124,7 @@ void OpenCLDTW_configureNoBeats(OpenCLDTW *self)
 void OpenCLDTW_configureBeats(OpenCLDTW *self)
 {
     cl_int error;
-    self->kernel = clCreateKernel(self->program, "OpenCLDTW_beats", &error);
+    self->kernel = clCreateKernel(self->runtime->program, "OpenCLDTW_beats", &error);
     assert(error == CL_SUCCESS);
     
     self->paletteRowIndexesMemory = OpenCLDTW_allocateFloatBuffer(self,
@@ -180,7 +151,23 @@ void OpenCLDTW_configureBeats(OpenCLDTW *self)
     error  |= clSetKernelArg(self->kernel,  4, sizeof(cl_mem), &self->paletteRowIndexesMemory);
     error  |= clSetKernelArg(self->kernel,  5, sizeof(size_t), &self->maximumColumnCount);
     error  |= clSetKernelArg(self->kernel,  6, sizeof(cl_mem), &self->resultMemory);
+    error  |= clSetKernelArg(self->kernel,  7, sizeof(cl_int), &self->constraint);
+    error  |= clSetKernelArg(self->kernel,  8, sizeof(Float32), &self->constraintParameter);
+    error  |= clSetKernelArg(self->kernel,  9, sizeof(size_t), &self->paletteRowCount);
+    
+    assert(error == CL_SUCCESS);
+}
+
+void OpenCLDTW_setConstraint(OpenCLDTW *self, DTWConstraint constraint, Float32 constraintParameter)
+{
+    cl_uint firstArgument = self->useBeats == true ? 7 : 6;
     
+    self->constraint = constraint;
+    self->constraintParameter = constraintParameter;
+    
+    cl_int error;
+    error   = clSetKernelArg(self->kernel, firstArgument, sizeof(cl_int), &self->constraint);
+    error  |= clSetKernelArg(self->kernel, firstArgument + 1, sizeof(Float32), &self->constraintParameter);
     
     assert(error == CL_SUCCESS);
 }
@@ -190,7 +177,7 @@ cl_mem OpenCLDTW_allocateFloatBuffer(OpenCLDTW *self, size_t size, cl_mem_flags
 {
     cl_int error;
     size_t bufferSize = sizeof(Float32) * size;
-    cl_mem bufferHandle = clCreateBuffer(self->context,
+    cl_mem bufferHandle = clCreateBuffer(self->runtime->context,
                                          flag,
                                          bufferSize,
                                          NULL,
@@ -204,7 +191,7 @@ void OpenCLDTW_writeFloatBuffer(OpenCLDTW *self, cl_mem clBuffer, Float32 *data,
 {
     size_t bufferSize = sizeof(Float32) * size;
     
-    cl_int error = clEnqueueWriteBuffer(self->commandQueue,
+    cl_int error = clEnqueueWriteBuffer(self->runtime->commandQueue,
                                         clBuffer,
                                         CL_TRUE,
                                         0,
@@ -214,7 +201,7 @@ void OpenCLDTW_writeFloatBuffer(OpenCLDTW *self, cl_mem clBuffer, Float32 *data,
                                         NULL,
                                         NULL);
     
-    clFinish(self->commandQueue);
+    clFinish(self->runtime->commandQueue);
     
     assert(error == CL_SUCCESS);
 }
@@ -224,7 +211,7 @@ void OpenCLDTW_process(OpenCLDTW *self, Float32 *analysisData, Float32 *result)
     OpenCLDTW_writeFloatBuffer(self, self->analysisMemory, analysisData, self->maximumElementCount);
     
     
-    cl_int error = clEnqueueNDRangeKernel(self->commandQueue,
+    cl_int error = clEnqueueNDRangeKernel(self->runtime->commandQueue,
                                           self->kernel,
                                           1,
                                           NULL,
@@ -234,9 +221,9 @@ void OpenCLDTW_process(OpenCLDTW *self, Float32 *analysisData, Float32 *result)
                                           NULL,
                                           NULL);
     assert(error == CL_SUCCESS);
-    clFinish(self->commandQueue);
+    clFinish(self->runtime->commandQueue);
     
-    error = clEnqueueReadBuffer(self->commandQueue,
+    error = clEnqueueReadBuffer(self->runtime->commandQueue,
                                 self->resultMemory,
                                 CL_TRUE,
                                 0,
@@ -246,7 +233,7 @@ void OpenCLDTW_process(OpenCLDTW *self, Float32 *analysisData, Float32 *result)
                                 NULL,
                                 NULL);
     assert(error == CL_SUCCESS);
-    clFinish(self->commandQueue);
+    clFinish(self->runtime->commandQueue);
 }
 
 
@@ -16,88 +16,202 @@ float OpenCLDTW_euclidianDistance(global float *vectorA, global float *vectorB,
 }
 
 
-__kernel void OpenCLDTW_noBeats(__global float *analysisData,
-                                size_t analysisRowCount,
-                                __global float *paletteData,
-                                size_t paletteRowCount,
-                                size_t columnCount,
-                                __global float *resultData)
+#define OpenCLDTW_constraintNone 0
+#define OpenCLDTW_constraintSakoeChiba 1
+#define OpenCLDTW_constraintItakura 2
 
+/*
+ Palette rows inside the path constraint for one analysis column, before the columns are joined up
+ */
+void OpenCLDTW_constrainColumn(int constraint,
+                               float constraintParameter,
+                               size_t analysisRowCount,
+                               size_t paletteRowCount,
+                               size_t column,
+                               __private size_t *firstRow,
+                               __private size_t *lastRow)
 {
-    int globalID = get_global_id(0);
+    float lastPaletteRow = (float)(paletteRowCount - 1);
+    float first = 0, last = lastPaletteRow;
     
-    MatrixFloatGlobal analysisMatrix = MatrixFloatGlobal_new(analysisData, analysisRowCount, columnCount);
-    MatrixFloatGlobal paletteMatrix = MatrixFloatGlobal_new(&paletteData[globalID * columnCount], paletteRowCount, columnCount);
-    
-    size_t distanceRowCount = paletteRowCount;
-    size_t distanceColumnCount = analysisRowCount;
-    size_t globalDistanceRowCount = paletteRowCount + 1;
-    size_t globalDistanceColumnCount = analysisRowCount + 1;
-    float top, middle, bottom, cheapest;
+    if (analysisRowCount > 1) {
+        
+        float x = (float)column / (float)(analysisRowCount - 1);
+        
+        if (constraint == OpenCLDTW_constraintSakoeChiba) {
+            
+            first = x * lastPaletteRow - constraintParameter;
+            last = x * lastPaletteRow + constraintParameter;
+        }
+        else if (constraint == OpenCLDTW_constraintItakura) {
+            
+            first = fmax(x / constraintParameter, 1.f - (1.f - x) * constraintParameter) * lastPaletteRow;
+            last = fmin(x * constraintParameter, 1.f - (1.f - x) / constraintParameter) * lastPaletteRow;
+        }
+    }
     
-    float distanceData[distanceRowCount * distanceColumnCount];
-    MatrixFloatPrivate distanceMatrix = MatrixFloatPrivate_new(distanceData, distanceRowCount, distanceColumnCount);
+    first = floor(first);
+    last = ceil(last);
+    *firstRow = first > 0 ? (size_t)first : 0;
+    *lastRow = last < lastPaletteRow ? (size_t)last : paletteRowCount - 1;
+}
+
+/*
+ Palette rows inside the path constraint for every analysis column, matching DTW32_calculateBand
+ */
+size_t OpenCLDTW_calculateBand(int constraint,
+                               float constraintParameter,
+                               size_t analysisRowCount,
+                               size_t paletteRowCount,
+                               __private size_t *firstRows,
+                               __private size_t *lastRows)
+{
+    size_t bandWidth = 0;
     
-    float globalDistanceData[globalDistanceRowCount * globalDistanceColumnCount];
-    MatrixFloatPrivate globalDistanceMatrix = MatrixFloatPrivate_new(globalDistanceData, globalDistanceRowCount, globalDistanceColumnCount);
+    for (size_t i = 0; i < analysisRowCount; ++i) {
+        
+        OpenCLDTW_constrainColumn(constraint, constraintParameter, analysisRowCount, paletteRowCount, i, &firstRows[i], &lastRows[i]);
+    }
     
-    for (size_t i = 0; i < paletteRowCount; ++i) {
+    for (size_t i = 1; i < analysisRowCount; ++i) {
         
-        for (size_t j = 0; j < analysisRowCount; ++j) {
+        if (firstRows[i] > lastRows[i - 1] + 1) {
             
-            Matrix_getElement(distanceMatrix, i, j) = OpenCLDTW_euclidianDistance(Matrix_getRow(analysisMatrix, j), Matrix_getRow(paletteMatrix, i), columnCount);
+            lastRows[i - 1] = firstRows[i] - 1;
         }
     }
     
-    Matrix_getElement(globalDistanceMatrix, 0, 0) = Matrix_getElement(distanceMatrix, 0, 0);
-    Matrix_getElement(globalDistanceMatrix, 0, 1) = INFINITY;
-    
-    for (size_t i = 2; i < globalDistanceMatrix.columnCount; i++) {
+    for (size_t i = 0; i < analysisRowCount; ++i) {
         
-        Matrix_getElement(globalDistanceMatrix, 0, i) = INFINITY;
+        size_t width = lastRows[i] - firstRows[i] + 1;
+        bandWidth = width > bandWidth ? width : bandWidth;
     }
     
-    for (size_t i = 1; i < globalDistanceMatrix.rowCount; i++) {
+    return bandWidth;
+}
+
+/*
+ Read a banded element, each analysis column stores bandWidth palette rows starting at firstRows[column]
+ */
+float OpenCLDTW_getBandElement(__private float *data,
+                               __private size_t *firstRows,
+                               __private size_t *lastRows,
+                               size_t bandWidth,
+                               size_t row,
+                               size_t column)
+{
+    if (row < firstRows[column] || row > lastRows[column]) {
         
-        Matrix_getElement(globalDistanceMatrix, i, 0) = INFINITY;
+        return INFINITY;
     }
     
-    Matrix_getElement(globalDistanceMatrix, 1, 1) = Matrix_getElement(distanceMatrix, 0, 0) + Matrix_getElement(distanceMatrix, 1, 1);
+    return data[column * bandWidth + row - firstRows[column]];
+}
+
+/*
+ Built with OPENCLDTW_ANALYSIS_ROW_COUNT and OPENCLDTW_MAXIMUM_PALETTE_ROW_COUNT defined, as for a
+ bucket of beats, the per work-item arrays have a fixed size instead of one set at run time.
+ */
+#if defined(OPENCLDTW_ANALYSIS_ROW_COUNT) && defined(OPENCLDTW_MAXIMUM_PALETTE_ROW_COUNT)
+#define OpenCLDTW_columnStorage(analysisRowCount) OPENCLDTW_ANALYSIS_ROW_COUNT
+#define OpenCLDTW_bandStorage(analysisRowCount, bandWidth) (OPENCLDTW_ANALYSIS_ROW_COUNT * OPENCLDTW_MAXIMUM_PALETTE_ROW_COUNT)
+#else
+#define OpenCLDTW_columnStorage(analysisRowCount) (analysisRowCount)
+#define OpenCLDTW_bandStorage(analysisRowCount, bandWidth) ((analysisRowCount) * (bandWidth))
+#endif
+
+float OpenCLDTW_bandedDTW(MatrixFloatGlobal analysisMatrix,
+                          MatrixFloatGlobal paletteMatrix,
+                          size_t analysisRowCount,
+                          size_t paletteRowCount,
+                          size_t columnCount,
+                          int constraint,
+                          float constraintParameter)
+{
+    float top, middle, bottom, cheapest;
+    
+    size_t firstRows[OpenCLDTW_columnStorage(analysisRowCount)];
+    size_t lastRows[OpenCLDTW_columnStorage(analysisRowCount)];
+    size_t bandWidth = OpenCLDTW_calculateBand(constraint, constraintParameter, analysisRowCount, paletteRowCount, firstRows, lastRows);
     
+    float distanceData[OpenCLDTW_bandStorage(analysisRowCount, bandWidth)];
+    float globalDistanceData[OpenCLDTW_bandStorage(analysisRowCount, bandWidth)];
     
-    for (size_t i = 2; i < globalDistanceMatrix.rowCount; i++) {
+    for (size_t i = 0; i < analysisRowCount; ++i) {
         
-        Matrix_getElement(globalDistanceMatrix, i, 1) = INFINITY;
+        for (size_t j = firstRows[i]; j <= lastRows[i]; ++j) {
+            
+            distanceData[i * bandWidth + j - firstRows[i]] = OpenCLDTW_euclidianDistance(Matrix_getRow(analysisMatrix, i), Matrix_getRow(paletteMatrix, j), columnCount);
+        }
     }
     
-    for (size_t i = 2; i < analysisRowCount; i++) {
-        
-        Matrix_getElement(globalDistanceMatrix, 1, i) = Matrix_getElement(globalDistanceMatrix, 0, i - 1) + Matrix_getElement(distanceMatrix, 1, i);
+    for (size_t i = 0; i < analysisRowCount; i++) {
         
-        for (size_t j = 2; j < paletteRowCount; j++) {
+        for (size_t j = firstRows[i]; j <= lastRows[i]; j++) {
             
-            top = Matrix_getElement(globalDistanceMatrix, j - 1, i - 2) +  Matrix_getElement(distanceMatrix, j, i - 1) + Matrix_getElement(distanceMatrix, j, i);
-            middle = Matrix_getElement(globalDistanceMatrix, j - 1, i - 1) + Matrix_getElement(distanceMatrix, j, i);
-            bottom = Matrix_getElement(globalDistanceMatrix, j - 2, i - 1) + Matrix_getElement(distanceMatrix, j - 1, i) + Matrix_getElement(distanceMatrix, j, i);
+            float distance = distanceData[i * bandWidth + j - firstRows[i]];
             
-            if ((top < middle) && (top < bottom)){
+            if (i == 0 || j == 0) {
                 
-                cheapest = top;
+                cheapest = (i == 0 && j == 0) ? distance : INFINITY;
             }
-            else if (middle < bottom){
+            else if (i == 1) {
                 
-                cheapest = middle;
+                cheapest = (j == 1) ? OpenCLDTW_getBandElement(globalDistanceData, firstRows, lastRows, bandWidth, 0, 0) + distance : INFINITY;
+            }
+            else if (j == 1) {
+                
+                cheapest = OpenCLDTW_getBandElement(globalDistanceData, firstRows, lastRows, bandWidth, 0, i - 1) + distance;
             }
             else {
                 
-                cheapest = bottom;
+                top = OpenCLDTW_getBandElement(globalDistanceData, firstRows, lastRows, bandWidth, j - 1, i - 2) + OpenCLDTW_getBandElement(distanceData, firstRows, lastRows, bandWidth, j, i - 1) + distance;
+                middle = OpenCLDTW_getBandElement(globalDistanceData, firstRows, lastRows, bandWidth, j - 1, i - 1) + distance;
+                bottom = OpenCLDTW_getBandElement(globalDistanceData, firstRows, lastRows, bandWidth, j - 2, i - 1) + OpenCLDTW_getBandElement(distanceData, firstRows, lastRows, bandWidth, j - 1, i) + distance;
+                
+                if ((top < middle) && (top < bottom)){
+                    
+                    cheapest = top;
+                }
+                else if (middle < bottom){
+                    
+                    cheapest = middle;
+                }
+                else {
+                    
+                    cheapest = bottom;
+                }
             }
             
-            Matrix_getElement(globalDistanceMatrix, j, i) = cheapest;
+            globalDistanceData[i * bandWidth + j - firstRows[i]] = cheapest;
         }
     }
     
-    resultData[globalID] = Matrix_getElement(globalDistanceMatrix, paletteRowCount - 1, analysisRowCount - 1);
+    return OpenCLDTW_getBandElement(globalDistanceData, firstRows, lastRows, bandWidth, paletteRowCount - 1, analysisRowCount - 1);
+}
+
+__kernel void OpenCLDTW_noBeats(__global float *analysisData,
+                                size_t analysisRowCount,
+                                __global float *paletteData,
+                                size_t paletteRowCount,
+                                size_t columnCount,
+                                __global float *resultData,
+                                int constraint,
+                                float constraintParameter)
+
+{
+    int globalID = get_global_id(0);
+    
+    MatrixFloatGlobal analysisMatrix = MatrixFloatGlobal_new(analysisData, analysisRowCount, columnCount);
+    MatrixFloatGlobal paletteMatrix = MatrixFloatGlobal_new(&paletteData[globalID * columnCount], paletteRowCount, columnCount);
+    
+    resultData[globalID] = OpenCLDTW_bandedDTW(analysisMatrix,
+                                               paletteMatrix,
+                                               analysisRowCount,
+                                               paletteRowCount,
+                                               columnCount,
+                                               constraint,
+                                               constraintParameter);
 }
 
 __kernel void OpenCLDTW_beats(__global float *analysisData,
@@ -106,81 +220,392 @@ __kernel void OpenCLDTW_beats(__global float *analysisData,
                               __global float *paletteRowCounts,
                               __global float *paletteRowIndexes,
                               size_t columnCount,
-                              __global float *resultData)
+                              __global float *resultData,
+                              int constraint,
+                              float constraintParameter,
+                              size_t paletteRowCount)
 
 {
     int globalID = get_global_id(0);
+    size_t firstRow = (size_t)paletteRowIndexes[globalID];
     
-    MatrixFloatGlobal analysisMatrix = MatrixFloatGlobal_new(analysisData, analysisRowCount, columnCount);
-    MatrixFloatGlobal paletteMatrix = MatrixFloatGlobal_new(&paletteData[(int)paletteRowIndexes[globalID]], (int)paletteRowCounts[globalID], columnCount);
+    if (firstRow >= paletteRowCount || paletteRowCounts[globalID] < 1) {
+        
+        resultData[globalID] = INFINITY;
+        return;
+    }
     
-    size_t distanceRowCount = paletteRowCounts[globalID];
-    size_t distanceColumnCount = analysisRowCount;
-    size_t globalDistanceRowCount = paletteRowCounts[globalID] + 1;
-    size_t globalDistanceColumnCount = analysisRowCount + 1;
-    float top, middle, bottom, cheapest;
+    size_t beatRowCount = min((size_t)paletteRowCounts[globalID], paletteRowCount - firstRow);
     
-    float distanceData[distanceRowCount * distanceColumnCount];
-    MatrixFloatPrivate distanceMatrix = MatrixFloatPrivate_new(distanceData, distanceRowCount, distanceColumnCount);
+    MatrixFloatGlobal analysisMatrix = MatrixFloatGlobal_new(analysisData, analysisRowCount, columnCount);
+    MatrixFloatGlobal paletteMatrix = MatrixFloatGlobal_new(&paletteData[firstRow * columnCount], beatRowCount, columnCount);
     
-    float globalDistanceData[globalDistanceRowCount * globalDistanceColumnCount];
-    MatrixFloatPrivate globalDistanceMatrix = MatrixFloatPrivate_new(globalDistanceData, globalDistanceRowCount, globalDistanceColumnCount);
+    resultData[globalID] = OpenCLDTW_bandedDTW(analysisMatrix,
+                                               paletteMatrix,
+                                               analysisRowCount,
+                                               beatRowCount,
+                                               columnCount,
+                                               constraint,
+                                               constraintParameter);
+}
+
+/*
+ The queries and palettes of all bands are packed one after another and bandLayout holds each band's
+ query offset, palette offset, column count and palette row count. Without beats candidate n starts
+ at palette row n, with beats it starts at its beat's first row and is cut short at the end of the
+ band. Returns 0 when nothing of the candidate lies inside the band.
+ */
+int OpenCLDTW_locateCandidate(__global uint *bandLayout,
+                              __global float *paletteRowCounts,
+                              __global float *paletteRowIndexes,
+                              int useBeats,
+                              size_t candidate,
+                              size_t band,
+                              size_t analysisRowCount,
+                              size_t *paletteOffset,
+                              size_t *paletteRowCount)
+{
+    size_t firstRow = candidate;
+    size_t rowCount = analysisRowCount;
+    size_t bandRowCount = bandLayout[band * 4 + 3];
     
-    for (size_t i = 0; i < (int)paletteRowCounts[globalID]; ++i) {
+    if (useBeats != 0) {
         
-        for (size_t j = 0; j < analysisRowCount; ++j) {
-            
-            Matrix_getElement(distanceMatrix, i, j) = OpenCLDTW_euclidianDistance(Matrix_getRow(analysisMatrix, j), Matrix_getRow(paletteMatrix, i), columnCount);
-        }
+        firstRow = (size_t)paletteRowIndexes[candidate];
+        rowCount = (size_t)paletteRowCounts[candidate];
     }
     
-    Matrix_getElement(globalDistanceMatrix, 0, 0) = Matrix_getElement(distanceMatrix, 0, 0);
-    Matrix_getElement(globalDistanceMatrix, 0, 1) = INFINITY;
+    if (firstRow >= bandRowCount) {
+        
+        return 0;
+    }
     
-    for (size_t i = 2; i < globalDistanceMatrix.columnCount; i++) {
+    *paletteOffset = bandLayout[band * 4 + 1] + firstRow * bandLayout[band * 4 + 2];
+    *paletteRowCount = min(rowCount, bandRowCount - firstRow);
+    
+    return *paletteRowCount > 0;
+}
+
+float OpenCLDTW_scoreCandidate(__global float *analysisData,
+                               size_t analysisRowCount,
+                               __global float *paletteData,
+                               __global uint *bandLayout,
+                               __global float *paletteRowCounts,
+                               __global float *paletteRowIndexes,
+                               int useBeats,
+                               size_t candidate,
+                               size_t band,
+                               int constraint,
+                               float constraintParameter)
+{
+    size_t columnCount = bandLayout[band * 4 + 2];
+    size_t paletteOffset, paletteRowCount;
+    
+    if (OpenCLDTW_locateCandidate(bandLayout, paletteRowCounts, paletteRowIndexes, useBeats, candidate, band, analysisRowCount, &paletteOffset, &paletteRowCount) == 0) {
         
-        Matrix_getElement(globalDistanceMatrix, 0, i) = INFINITY;
+        return INFINITY;
     }
     
-    for (size_t i = 1; i < globalDistanceMatrix.rowCount; i++) {
+    MatrixFloatGlobal analysisMatrix = MatrixFloatGlobal_new(&analysisData[bandLayout[band * 4]], analysisRowCount, columnCount);
+    MatrixFloatGlobal paletteMatrix = MatrixFloatGlobal_new(&paletteData[paletteOffset], paletteRowCount, columnCount);
+    
+    return OpenCLDTW_bandedDTW(analysisMatrix,
+                               paletteMatrix,
+                               analysisRowCount,
+                               paletteRowCount,
+                               columnCount,
+                               constraint,
+                               constraintParameter);
+}
+
+/*
+ One work-item per (candidate, band)
+ */
+__kernel void OpenCLDTW_batchScores(__global float *analysisData,
+                                    size_t analysisRowCount,
+                                    __global float *paletteData,
+                                    __global uint *bandLayout,
+                                    __global float *paletteRowCounts,
+                                    __global float *paletteRowIndexes,
+                                    int useBeats,
+                                    __global float *scores,
+                                    int constraint,
+                                    float constraintParameter)
+{
+    size_t candidate = get_global_id(0);
+    size_t band = get_global_id(1);
+    size_t candidateCount = get_global_size(0);
+    
+    scores[band * candidateCount + candidate] = OpenCLDTW_scoreCandidate(analysisData,
+                                                                         analysisRowCount,
+                                                                         paletteData,
+                                                                         bandLayout,
+                                                                         paletteRowCounts,
+                                                                         paletteRowIndexes,
+                                                                         useBeats,
+                                                                         candidate,
+                                                                         band,
+                                                                         constraint,
+                                                                         constraintParameter);
+}
+
+/*
+ One work-item per (beat, band) for the beats of one length bucket. candidateIndexes lists every beat
+ sorted by length and the launch's global offset selects the bucket, so the work-items of a launch
+ take about as long as each other. The scores land at each beat's own index, ready for
+ OpenCLDTW_batchArgmin to reduce across the buckets.
+ */
+__kernel void OpenCLDTW_bucketScores(__global float *analysisData,
+                                     size_t analysisRowCount,
+                                     __global float *paletteData,
+                                     __global uint *bandLayout,
+                                     __global float *paletteRowCounts,
+                                     __global float *paletteRowIndexes,
+                                     int useBeats,
+                                     __global float *scores,
+                                     int constraint,
+                                     float constraintParameter,
+                                     __global uint *candidateIndexes,
+                                     size_t candidateCount)
+{
+    size_t candidate = candidateIndexes[get_global_id(0)];
+    size_t band = get_global_id(1);
+    
+    scores[band * candidateCount + candidate] = OpenCLDTW_scoreCandidate(analysisData,
+                                                                         analysisRowCount,
+                                                                         paletteData,
+                                                                         bandLayout,
+                                                                         paletteRowCounts,
+                                                                         paletteRowIndexes,
+                                                                         useBeats,
+                                                                         candidate,
+                                                                         band,
+                                                                         constraint,
+                                                                         constraintParameter);
+}
+
+float OpenCLDTW_euclidianDistanceLocal(__local float *vectorA, __local float *vectorB, size_t length)
+{
+    float sum = 0;
+    
+    for (size_t i = 0; i < length; ++i) {
+        
+        float temp = vectorA[i] - vectorB[i];
         
-        Matrix_getElement(globalDistanceMatrix, i, 0) = INFINITY;
+        temp *= temp;
+        sum += temp;
     }
     
-    Matrix_getElement(globalDistanceMatrix, 1, 1) = Matrix_getElement(distanceMatrix, 0, 0) + Matrix_getElement(distanceMatrix, 1, 1);
+    return sqrt(sum);
+}
+
+/*
+ One work-group per (candidate, band), the same scores as OpenCLDTW_batchScores without any per
+ work-item arrays. Every step of the path advances the analysis row, so the cells of a row only
+ depend on the two rows before it and the work-items split each row between them. The last three
+ accumulated rows and last two distance rows live in rows, maximumPaletteRowCount floats each, and
+ when stageInputs is set the query and the candidate's palette rows are first copied into inputs.
+ */
+__kernel void OpenCLDTW_batchScoresCooperative(__global float *analysisData,
+                                               size_t analysisRowCount,
+                                               __global float *paletteData,
+                                               __global uint *bandLayout,
+                                               __global float *paletteRowCounts,
+                                               __global float *paletteRowIndexes,
+                                               int useBeats,
+                                               __global float *scores,
+                                               int constraint,
+                                               float constraintParameter,
+                                               size_t maximumPaletteRowCount,
+                                               __local float *rows,
+                                               __local float *inputs,
+                                               int stageInputs)
+{
+    size_t candidate = get_group_id(0);
+    size_t band = get_group_id(1);
+    size_t candidateCount = get_num_groups(0);
+    size_t localID = get_local_id(0);
+    size_t localSize = get_local_size(0);
+    size_t columnCount = bandLayout[band * 4 + 2];
+    size_t paletteOffset, paletteRowCount;
     
+    if (OpenCLDTW_locateCandidate(bandLayout, paletteRowCounts, paletteRowIndexes, useBeats, candidate, band, analysisRowCount, &paletteOffset, &paletteRowCount) == 0) {
+        
+        if (localID == 0) {
+            
+            scores[band * candidateCount + candidate] = INFINITY;
+        }
+        
+        return;
+    }
+    
+    MatrixFloatGlobal analysisMatrix = MatrixFloatGlobal_new(&analysisData[bandLayout[band * 4]], analysisRowCount, columnCount);
+    MatrixFloatGlobal paletteMatrix = MatrixFloatGlobal_new(&paletteData[paletteOffset], paletteRowCount, columnCount);
+    MatrixFloatLocal localAnalysisMatrix = MatrixFloatLocal_new(inputs, analysisRowCount, columnCount);
+    MatrixFloatLocal localPaletteMatrix = MatrixFloatLocal_new(&inputs[analysisRowCount * columnCount], paletteRowCount, columnCount);
     
-    for (size_t i = 2; i < globalDistanceMatrix.rowCount; i++) {
+    if (stageInputs != 0) {
+        
+        for (size_t i = localID; i < analysisRowCount * columnCount; i += localSize) {
+            
+            localAnalysisMatrix.data[i] = analysisMatrix.data[i];
+        }
         
-        Matrix_getElement(globalDistanceMatrix, i, 1) = INFINITY;
+        for (size_t i = localID; i < paletteRowCount * columnCount; i += localSize) {
+            
+            localPaletteMatrix.data[i] = paletteMatrix.data[i];
+        }
+        
+        barrier(CLK_LOCAL_MEM_FENCE);
     }
     
-    for (size_t i = 2; i < analysisRowCount; i++) {
+    for (size_t i = 0; i < analysisRowCount; ++i) {
+        
+        size_t firstRow, lastRow, nextFirstRow, nextLastRow;
+        OpenCLDTW_constrainColumn(constraint, constraintParameter, analysisRowCount, paletteRowCount, i, &firstRow, &lastRow);
+        
+        if (i + 1 < analysisRowCount) {
+            
+            OpenCLDTW_constrainColumn(constraint, constraintParameter, analysisRowCount, paletteRowCount, i + 1, &nextFirstRow, &nextLastRow);
+            
+            if (nextFirstRow > lastRow + 1) {
+                
+                lastRow = nextFirstRow - 1;
+            }
+        }
+        
+        __local float *distances = &rows[(3 + i % 2) * maximumPaletteRowCount];
+        __local float *previousDistances = &rows[(3 + (i + 1) % 2) * maximumPaletteRowCount];
+        __local float *current = &rows[(i % 3) * maximumPaletteRowCount];
+        __local float *previous = &rows[((i + 2) % 3) * maximumPaletteRowCount];
+        __local float *beforePrevious = &rows[((i + 1) % 3) * maximumPaletteRowCount];
+        
+        for (size_t j = localID; j < paletteRowCount; j += localSize) {
+            
+            if (j < firstRow || j > lastRow) {
+                
+                distances[j] = INFINITY;
+            }
+            else if (stageInputs != 0) {
+                
+                distances[j] = OpenCLDTW_euclidianDistanceLocal(Matrix_getRow(localAnalysisMatrix, i), Matrix_getRow(localPaletteMatrix, j), columnCount);
+            }
+            else {
+                
+                distances[j] = OpenCLDTW_euclidianDistance(Matrix_getRow(analysisMatrix, i), Matrix_getRow(paletteMatrix, j), columnCount);
+            }
+        }
         
-        Matrix_getElement(globalDistanceMatrix, 1, i) = Matrix_getElement(globalDistanceMatrix, 0, i - 1) + Matrix_getElement(distanceMatrix, 1, i);
+        barrier(CLK_LOCAL_MEM_FENCE);
         
-        for (size_t j = 2; j < (int)paletteRowCounts[globalID]; j++) {
+        for (size_t j = localID; j < paletteRowCount; j += localSize) {
             
-            top = Matrix_getElement(globalDistanceMatrix, j - 1, i - 2) +  Matrix_getElement(distanceMatrix, j, i - 1) + Matrix_getElement(distanceMatrix, j, i);
-            middle = Matrix_getElement(globalDistanceMatrix, j - 1, i - 1) + Matrix_getElement(distanceMatrix, j, i);
-            bottom = Matrix_getElement(globalDistanceMatrix, j - 2, i - 1) + Matrix_getElement(distanceMatrix, j - 1, i) + Matrix_getElement(distanceMatrix, j, i);
+            float distance = distances[j];
+            float top, middle, bottom, cheapest;
             
-            if ((top < middle) && (top < bottom)){
+            if (j < firstRow || j > lastRow) {
+                
+                cheapest = INFINITY;
+            }
+            else if (i == 0 || j == 0) {
                 
-                cheapest = top;
+                cheapest = (i == 0 && j == 0) ? distance : INFINITY;
             }
-            else if (middle < bottom){
+            else if (i == 1) {
                 
-                cheapest = middle;
+                cheapest = (j == 1) ? previous[0] + distance : INFINITY;
+            }
+            else if (j == 1) {
+                
+                cheapest = previous[0] + distance;
             }
             else {
                 
-                cheapest = bottom;
+                top = beforePrevious[j - 1] + previousDistances[j] + distance;
+                middle = previous[j - 1] + distance;
+                bottom = previous[j - 2] + distances[j - 1] + distance;
+                
+                if ((top < middle) && (top < bottom)){
+                    
+                    cheapest = top;
+                }
+                else if (middle < bottom){
+                    
+                    cheapest = middle;
+                }
+                else {
+                    
+                    cheapest = bottom;
+                }
             }
             
-            Matrix_getElement(globalDistanceMatrix, j, i) = cheapest;
+            current[j] = cheapest;
         }
+        
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    
+    if (localID == 0) {
+        
+        scores[band * candidateCount + candidate] = rows[((analysisRowCount - 1) % 3) * maximumPaletteRowCount + paletteRowCount - 1];
     }
+}
+
+/*
+ One work-group per band, each work-item keeps the best of a strided share of the candidates and
+ the group halves them in local memory. Ties go to the lower index, as in MatchHeap32.
+ */
+__kernel void OpenCLDTW_batchArgmin(__global float *scores,
+                                    size_t candidateCount,
+                                    __global uint *matches,
+                                    __local float *localScores,
+                                    __local uint *localIndexes)
+{
+    size_t band = get_group_id(0);
+    size_t localID = get_local_id(0);
+    size_t localSize = get_local_size(0);
+    __global float *bandScores = &scores[band * candidateCount];
     
-    resultData[globalID] = Matrix_getElement(globalDistanceMatrix, (int)paletteRowCounts[globalID] - 1, analysisRowCount - 1);
-}
\ No newline at end of file
+    float bestScore = INFINITY;
+    uint bestIndex = UINT_MAX;
+    
+    for (size_t i = localID; i < candidateCount; i += localSize) {
+        
+        if (bandScores[i] < bestScore || bestIndex == UINT_MAX) {
+            
+            bestScore = bandScores[i];
+            bestIndex = (uint)i;
+        }
+    }
+    
+    localScores[localID] = bestScore;
+    localIndexes[localID] = bestIndex;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    
+    for (size_t stride = localSize / 2; stride > 0; stride /= 2) {
+        
+        if (localID < stride) {
+            
+            float otherScore = localScores[localID + stride];
+            uint otherIndex = localIndexes[localID + stride];
+            
+            if (otherIndex != UINT_MAX
+                &&
+                (localIndexes[localID] == UINT_MAX
+                 || otherScore < localScores[localID]
+                 || (otherScore == localScores[localID] && otherIndex < localIndexes[localID]))) {
+                
+                localScores[localID] = otherScore;
+                localIndexes[localID] = otherIndex;
+            }
+        }
+        
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    
+    if (localID == 0) {
+        
+        matches[band * 2] = localIndexes[0];
+        matches[band * 2 + 1] = as_uint(localScores[0]);
+    }
+}
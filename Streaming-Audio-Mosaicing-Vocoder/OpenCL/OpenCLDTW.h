@@ -12,19 +12,14 @@
 #import <stdlib.h>
 #import <OpenCL/OpenCL.h>
 #import "Matrix.h"
+#import "DTW.h"
+#import "OpenCLRuntime.h"
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
     
-    typedef enum OpenCLDTW_Device {
-        
-        OpenCLDTW_useCPU,
-        OpenCLDTW_useGPU
-        
-    } OpenCLDTW_Device;
-    
     typedef struct OpenCLDTW
     {
         size_t maximumRowCount;
@@ -33,22 +28,21 @@ extern "C"
         size_t paletteRowCount;
         size_t tempMemoryCount;
         size_t globalWorkSize;
-        cl_program program;
+        OpenCLRuntime *runtime;
         cl_kernel kernel;
         Float32 *paletteData;
         Float32 *paletteBeatIndexes;
         Float32 *paletteBeatCounts;
         size_t beatsCount;
         Boolean useBeats;
-        cl_command_queue commandQueue;
-        cl_context context;
         
         cl_mem analysisMemory;
         cl_mem paletteMemory;
         cl_mem resultMemory;
         cl_mem paletteRowCountsMemory;
         cl_mem paletteRowIndexesMemory;
-        cl_device_id device;
+        cl_int constraint;
+        Float32 constraintParameter;
         
     } OpenCLDTW;
     
@@ -63,6 +57,7 @@ extern "C"
     void OpenCLDTW_delete(OpenCLDTW *self);
     void OpenCLDTW_configureNoBeats(OpenCLDTW *self);
     void OpenCLDTW_configureBeats(OpenCLDTW *self);
+    void OpenCLDTW_setConstraint(OpenCLDTW *self, DTWConstraint constraint, Float32 constraintParameter);
 
     cl_mem OpenCLDTW_allocateFloatBuffer(OpenCLDTW *self, size_t size, cl_mem_flags flag);
     void OpenCLDTW_writeFloatBuffer(OpenCLDTW *self, cl_mem clBuffer, Float32 *data, size_t size);
@@ -0,0 +1,476 @@
+    //
+    //  OpenCLRuntime.c
+    //  Streaming-Audio-Mosaicing-Vocoder
+    //
+
+#import "OpenCLRuntime.h"
+#import "OpenCLDTW.h"
+#import <assert.h>
+#import <errno.h>
+#import <fcntl.h>
+#import <pthread.h>
+#import <pwd.h>
+#import <stdint.h>
+#import <stdio.h>
+#import <string.h>
+#import <sys/stat.h>
+#import <unistd.h>
+
+#define OPENCLRUNTIME_CACHE_MAGIC "OCLDTW01"
+#define OPENCLRUNTIME_CACHE_FOLDER "Library/Caches/Streaming-Audio-Mosaicing-Vocoder"
+
+static OpenCLRuntime *OpenCLRuntime_shared[2] = {NULL, NULL};
+static pthread_mutex_t OpenCLRuntime_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t OpenCLRuntime_cacheLock = PTHREAD_MUTEX_INITIALIZER;
+static const char *OpenCLRuntime_programFileName = "Streaming-Audio-Mosaicing-Vocoder/OpenCL/OpenCLDTW.cl";
+static const char *OpenCLRuntime_includeFileName = "Streaming-Audio-Mosaicing-Vocoder/OpenCL/OpenCLMatrix.cl";
+static const char *OpenCLRuntime_buildOptions = "";
+static char OpenCLRuntime_cacheDirectory[1024] = "";
+static Boolean OpenCLRuntime_cacheDisabled = false;
+
+void OpenCLRuntime_setBinaryCacheDirectory(const char *path)
+{
+    pthread_mutex_lock(&OpenCLRuntime_cacheLock);
+    
+    OpenCLRuntime_cacheDisabled = path == NULL;
+    snprintf(OpenCLRuntime_cacheDirectory, sizeof(OpenCLRuntime_cacheDirectory), "%s", path != NULL ? path : "");
+    
+    pthread_mutex_unlock(&OpenCLRuntime_cacheLock);
+}
+
+static UInt64 OpenCLRuntime_hash(UInt64 hash, const char *text)
+{
+    for (const UInt8 *byte = (const UInt8 *)text; *byte != 0; ++byte) {
+        
+        hash = (hash ^ *byte) * 1099511628211ULL;
+    }
+    
+    return (hash ^ 0xff) * 1099511628211ULL;
+}
+
+static void OpenCLRuntime_getDeviceString(cl_device_id device,
+                                          cl_device_info parameter,
+                                          char *value,
+                                          size_t size)
+{
+    value[0] = 0;
+    clGetDeviceInfo(device, parameter, size, value, NULL);
+    value[size - 1] = 0;
+}
+
+/*
+ The cache key names everything a binary depends on, the device, its driver, the build options and
+ the kernel source including OpenCLMatrix.cl. The key is stored in the entry and compared on load, the
+ file name only carries its hash.
+ */
+static char *OpenCLRuntime_createCacheKey(OpenCLRuntime *self,
+                                          const char *source,
+                                          const char *options)
+{
+    char vendor[256], name[256], deviceVersion[256], driverVersion[256];
+    OpenCLRuntime_getDeviceString(self->device, CL_DEVICE_VENDOR, vendor, sizeof(vendor));
+    OpenCLRuntime_getDeviceString(self->device, CL_DEVICE_NAME, name, sizeof(name));
+    OpenCLRuntime_getDeviceString(self->device, CL_DEVICE_VERSION, deviceVersion, sizeof(deviceVersion));
+    OpenCLRuntime_getDeviceString(self->device, CL_DRIVER_VERSION, driverVersion, sizeof(driverVersion));
+    
+    char *includeSource = OpenCLDTW_loadProgramSource(OpenCLRuntime_includeFileName);
+    UInt64 sourceHash = OpenCLRuntime_hash(14695981039346656037ULL, source);
+    sourceHash = OpenCLRuntime_hash(sourceHash, includeSource != NULL ? includeSource : "");
+    free(includeSource);
+    
+    size_t keySize = strlen(vendor) + strlen(name) + strlen(deviceVersion) + strlen(driverVersion) + strlen(options) + 64;
+    char *key = calloc(keySize, sizeof(char));
+    snprintf(key, keySize, "%s|%s|%s|%s|%s|%016llx", vendor, name, deviceVersion, driverVersion, options, (unsigned long long)sourceHash);
+    
+    return key;
+}
+
+/*
+ Binaries are native code on some platforms, so the cache directory and every entry loaded from it must
+ belong to the current user and be writable by nobody else.
+ */
+static Boolean OpenCLRuntime_isPrivate(const struct stat *status)
+{
+    return status->st_uid == geteuid() && (status->st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+/*
+ The default directory is per user, ~/Library/Caches/Streaming-Audio-Mosaicing-Vocoder, created
+ readable by its owner only.
+ */
+static Boolean OpenCLRuntime_getCachePath(const char *key,
+                                          char *path,
+                                          size_t size)
+{
+    pthread_mutex_lock(&OpenCLRuntime_cacheLock);
+    Boolean disabled = OpenCLRuntime_cacheDisabled;
+    char directory[sizeof(OpenCLRuntime_cacheDirectory)];
+    memcpy(directory, OpenCLRuntime_cacheDirectory, sizeof(directory));
+    pthread_mutex_unlock(&OpenCLRuntime_cacheLock);
+    
+    if (disabled == true) {
+        
+        return false;
+    }
+    
+    if (directory[0] == 0) {
+        
+        const char *home = getenv("HOME");
+        
+        if (home == NULL || home[0] == 0) {
+            
+            struct passwd *user = getpwuid(geteuid());
+            home = user != NULL ? user->pw_dir : NULL;
+        }
+        
+        if (home == NULL) {
+            
+            return false;
+        }
+        
+        snprintf(directory, sizeof(directory), "%s/%s", home, OPENCLRUNTIME_CACHE_FOLDER);
+        
+        if (mkdir(directory, 0700) != 0 && errno != EEXIST) {
+            
+            return false;
+        }
+    }
+    
+    struct stat status;
+    
+    if (lstat(directory, &status) != 0 || S_ISDIR(status.st_mode) == false || OpenCLRuntime_isPrivate(&status) == false) {
+        
+        return false;
+    }
+    
+    snprintf(path, size, "%s/OpenCLDTW-%016llx.clbin", directory, (unsigned long long)OpenCLRuntime_hash(14695981039346656037ULL, key));
+    
+    return true;
+}
+
+/*
+ Cache entries are the magic, the key length and key, then the binary length and binary. Anything
+ unreadable, written for another key, not a regular file or not private to the user is treated as a miss.
+ */
+static UInt8 *OpenCLRuntime_readCacheEntry(const char *path,
+                                           const char *key,
+                                           size_t *binarySize)
+{
+    *binarySize = 0;
+    
+    int descriptor = open(path, O_RDONLY | O_NOFOLLOW);
+    
+    if (descriptor < 0) {
+        
+        return NULL;
+    }
+    
+    struct stat status;
+    
+    if (fstat(descriptor, &status) != 0 || S_ISREG(status.st_mode) == false || OpenCLRuntime_isPrivate(&status) == false) {
+        
+        close(descriptor);
+        return NULL;
+    }
+    
+    FILE *file = fdopen(descriptor, "rb");
+    
+    if (file == NULL) {
+        
+        close(descriptor);
+        return NULL;
+    }
+    
+    char magic[8];
+    UInt64 keySize = 0, size = 0;
+    UInt8 *binary = NULL;
+    char *storedKey = NULL;
+    
+    if (fread(magic, sizeof(magic), 1, file) == 1
+        && memcmp(magic, OPENCLRUNTIME_CACHE_MAGIC, sizeof(magic)) == 0
+        && fread(&keySize, sizeof(keySize), 1, file) == 1
+        && keySize == strlen(key)) {
+        
+        storedKey = calloc(keySize + 1, sizeof(char));
+        
+        if (fread(storedKey, 1, keySize, file) == keySize
+            && memcmp(storedKey, key, keySize) == 0
+            && fread(&size, sizeof(size), 1, file) == 1
+            && size > 0) {
+            
+            binary = malloc(size);
+            
+            if (fread(binary, 1, size, file) != size) {
+                
+                free(binary);
+                binary = NULL;
+            }
+        }
+    }
+    
+    free(storedKey);
+    fclose(file);
+    *binarySize = binary != NULL ? (size_t)size : 0;
+    
+    return binary;
+}
+
+/*
+ Written to a new file created exclusively with mode 0600 under an unpredictable name by mkstemp, then
+ renamed over the entry, so instances starting together never read a partial binary and nothing planted
+ at a guessable name is written through.
+ */
+static void OpenCLRuntime_writeCacheEntry(const char *path,
+                                          const char *key,
+                                          cl_program program)
+{
+    size_t size = 0;
+    
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &size, NULL) != CL_SUCCESS || size == 0) {
+        
+        return;
+    }
+    
+    UInt8 *binary = malloc(size);
+    
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(UInt8 *), &binary, NULL) == CL_SUCCESS) {
+        
+        char temporaryPath[1100];
+        snprintf(temporaryPath, sizeof(temporaryPath), "%s.XXXXXX", path);
+        
+        int descriptor = mkstemp(temporaryPath);
+        FILE *file = descriptor >= 0 ? fdopen(descriptor, "wb") : NULL;
+        
+        if (file == NULL && descriptor >= 0) {
+            
+            close(descriptor);
+            unlink(temporaryPath);
+        }
+        
+        if (file != NULL) {
+            
+            UInt64 keySize = strlen(key), binarySize = size;
+            Boolean written = fwrite(OPENCLRUNTIME_CACHE_MAGIC, 8, 1, file) == 1
+            && fwrite(&keySize, sizeof(keySize), 1, file) == 1
+            && fwrite(key, 1, keySize, file) == keySize
+            && fwrite(&binarySize, sizeof(binarySize), 1, file) == 1
+            && fwrite(binary, 1, size, file) == size;
+            
+            written = fclose(file) == 0 && written;
+            
+            if (written == false || rename(temporaryPath, path) != 0) {
+                
+                unlink(temporaryPath);
+            }
+        }
+    }
+    
+    free(binary);
+}
+
+static cl_program OpenCLRuntime_buildProgramFromBinary(OpenCLRuntime *self,
+                                                       const UInt8 *binary,
+                                                       size_t binarySize,
+                                                       const char *options)
+{
+    cl_int error, binaryStatus;
+    cl_program program = clCreateProgramWithBinary(self->context,
+                                                   1,
+                                                   &self->device,
+                                                   &binarySize,
+                                                   &binary,
+                                                   &binaryStatus,
+                                                   &error);
+    
+    if (error != CL_SUCCESS || binaryStatus != CL_SUCCESS) {
+        
+        if (program != NULL) {
+            
+            clReleaseProgram(program);
+        }
+        
+        return NULL;
+    }
+    
+    if (clBuildProgram(program, 0, NULL, options, NULL, NULL) != CL_SUCCESS) {
+        
+        clReleaseProgram(program);
+        return NULL;
+    }
+    
+    return program;
+}
+
+static cl_program OpenCLRuntime_buildProgramFromSource(OpenCLRuntime *self,
+                                                       const char *source,
+                                                       const char *options)
+{
+    cl_int error;
+    cl_program program = clCreateProgramWithSource(self->context,
+                                                   1,
+                                                   &source,
+                                                   NULL,
+                                                   &error);
+    assert(error == CL_SUCCESS);
+    
+    error = clBuildProgram(program, 0, NULL, options, NULL, NULL);
+    
+    if (error == CL_BUILD_PROGRAM_FAILURE) {
+        
+        size_t logSize;
+        clGetProgramBuildInfo(program, self->device, CL_PROGRAM_BUILD_LOG, 0, NULL, &logSize);
+        
+        char *log = malloc(logSize);
+        clGetProgramBuildInfo(program, self->device, CL_PROGRAM_BUILD_LOG, logSize, log, NULL);
+        printf("%s\n", log);
+        free(log);
+    }
+    assert(error == CL_SUCCESS);
+    
+    return program;
+}
+
+/*
+ Build OpenCLDTW.cl with options, from the binary cache when it holds an entry for this device, driver,
+ source and options, otherwise from source, saving the result for the next start.
+ */
+static cl_program OpenCLRuntime_loadProgram(OpenCLRuntime *self,
+                                            const char *options,
+                                            Boolean *loadedFromBinaryCache)
+{
+    char *source = OpenCLDTW_loadProgramSource(OpenCLRuntime_programFileName);
+    
+    if (source == NULL) {
+        
+        printf("OpenCLRuntime_loadProgram, could not read %s, exiting\n", OpenCLRuntime_programFileName);
+        exit(-1);
+    }
+    
+    char *key = OpenCLRuntime_createCacheKey(self, source, options);
+    char path[1024];
+    Boolean useCache = OpenCLRuntime_getCachePath(key, path, sizeof(path));
+    cl_program program = NULL;
+    
+    if (useCache == true) {
+        
+        size_t binarySize;
+        UInt8 *binary = OpenCLRuntime_readCacheEntry(path, key, &binarySize);
+        
+        if (binary != NULL) {
+            
+            program = OpenCLRuntime_buildProgramFromBinary(self, binary, binarySize, options);
+            free(binary);
+        }
+    }
+    
+    if (loadedFromBinaryCache != NULL) {
+        
+        *loadedFromBinaryCache = program != NULL;
+    }
+    
+    if (program == NULL) {
+        
+        program = OpenCLRuntime_buildProgramFromSource(self, source, options);
+        
+        if (useCache == true) {
+            
+            OpenCLRuntime_writeCacheEntry(path, key, program);
+        }
+    }
+    
+    free(key);
+    free(source);
+    
+    return program;
+}
+
+cl_program OpenCLRuntime_buildProgram(OpenCLRuntime *self,
+                                      const char *options)
+{
+    return OpenCLRuntime_loadProgram(self, options, NULL);
+}
+
+static OpenCLRuntime *OpenCLRuntime_new(OpenCLDTW_Device device)
+{
+    OpenCLRuntime *self = calloc(1, sizeof(OpenCLRuntime));
+    
+    self->deviceType = device;
+    cl_int error;
+    
+    if (device == OpenCLDTW_useCPU) {
+    
+        error = clGetDeviceIDs(NULL, CL_DEVICE_TYPE_CPU, 1, &self->device, NULL);
+        assert(error == CL_SUCCESS);
+    }
+    else {
+    
+        error = clGetDeviceIDs(NULL, CL_DEVICE_TYPE_GPU, 1, &self->device, NULL);
+        assert(error == CL_SUCCESS);
+    }
+    
+    assert(self->device);
+    
+    cl_bool hostUnifiedMemory = CL_FALSE;
+    cl_uint baseAddressAlignment = 0;
+    clGetDeviceInfo(self->device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(cl_bool), &hostUnifiedMemory, NULL);
+    clGetDeviceInfo(self->device, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(cl_uint), &baseAddressAlignment, NULL);
+    self->hostUnifiedMemory = hostUnifiedMemory == CL_TRUE;
+    self->baseAddressAlignment = baseAddressAlignment > 8 ? baseAddressAlignment / 8 : 1;
+    
+    self->context = clCreateContext(0, 1, &self->device, NULL, NULL, &error);
+    assert(error == CL_SUCCESS);
+    
+    self->commandQueue = clCreateCommandQueue(self->context, self->device, 0, &error);
+    assert(error == CL_SUCCESS);
+    
+    self->program = OpenCLRuntime_loadProgram(self, OpenCLRuntime_buildOptions, &self->loadedFromBinaryCache);
+    
+    return self;
+}
+
+static void OpenCLRuntime_delete(OpenCLRuntime *self)
+{
+    clReleaseProgram(self->program);
+    clReleaseCommandQueue(self->commandQueue);
+    clReleaseContext(self->context);
+    free(self);
+    self = NULL;
+}
+
+OpenCLRuntime *OpenCLRuntime_retain(OpenCLDTW_Device device)
+{
+    pthread_mutex_lock(&OpenCLRuntime_lock);
+    
+    if (OpenCLRuntime_shared[device] == NULL) {
+    
+        OpenCLRuntime_shared[device] = OpenCLRuntime_new(device);
+    }
+    
+    OpenCLRuntime *runtime = OpenCLRuntime_shared[device];
+    runtime->referenceCount++;
+    
+    pthread_mutex_unlock(&OpenCLRuntime_lock);
+    
+    return runtime;
+}
+
+Boolean OpenCLRuntime_canUseHostMemory(OpenCLRuntime *self,
+                                       const void *data)
+{
+    return self->hostUnifiedMemory == true && data != NULL && (uintptr_t)data % self->baseAddressAlignment == 0;
+}
+
+void OpenCLRuntime_release(OpenCLRuntime *self)
+{
+    pthread_mutex_lock(&OpenCLRuntime_lock);
+    
+    self->referenceCount--;
+    
+    if (self->referenceCount == 0) {
+    
+        OpenCLRuntime_shared[self->deviceType] = NULL;
+        OpenCLRuntime_delete(self);
+    }
+    
+    pthread_mutex_unlock(&OpenCLRuntime_lock);
+}
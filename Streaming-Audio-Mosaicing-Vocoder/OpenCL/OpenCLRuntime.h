@@ -0,0 +1,87 @@
+    //
+    //  OpenCLRuntime.h
+    //  Streaming-Audio-Mosaicing-Vocoder
+    //
+
+#import <MacTypes.h>
+#import <stdlib.h>
+#import <OpenCL/OpenCL.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    
+    typedef enum OpenCLDTW_Device {
+    
+        OpenCLDTW_useCPU,
+        OpenCLDTW_useGPU
+    
+    } OpenCLDTW_Device;
+    
+    /*!
+     @class OpenCLRuntime
+     @abstract The OpenCL state shared by every OpenCLDTW on a device, one per device type for the whole process. The context is created, OpenCLDTW.cl compiled and the command queue made once, so per band instances only hold their buffers and kernel arguments.
+     @var deviceType
+     The device type the runtime was made for.
+     @var device
+     The first device of that type.
+     @var context
+     The context every OpenCLDTW buffer on the device is allocated in.
+     @var program
+     OpenCLDTW.cl built for the device.
+     @var commandQueue
+     The in order queue every OpenCLDTW on the device enqueues to.
+     @var referenceCount
+     The number of OpenCLRuntime_retain calls not yet balanced by OpenCLRuntime_release.
+     @var loadedFromBinaryCache
+     True when the program came from the on disk binary cache rather than a source build.
+     @var hostUnifiedMemory
+     True when the device shares memory with the host, as CPU devices do, so buffers over host storage need no copy.
+     @var baseAddressAlignment
+     The alignment in bytes the device wants of host storage used in place.
+     */
+    typedef struct OpenCLRuntime
+    {
+        OpenCLDTW_Device deviceType;
+        cl_device_id device;
+        cl_context context;
+        cl_program program;
+        cl_command_queue commandQueue;
+        size_t referenceCount;
+        Boolean loadedFromBinaryCache;
+        Boolean hostUnifiedMemory;
+        size_t baseAddressAlignment;
+    
+    } OpenCLRuntime;
+    
+    /*!
+     Set the directory built program binaries are cached in, keyed by device, driver version, build options and a hash of the kernel source. NULL turns the cache off, the default is ~/Library/Caches/Streaming-Audio-Mosaicing-Vocoder. The directory and every entry must belong to the current user and not be writable by anyone else, or they are ignored. Only runtimes created afterwards are affected.
+     */
+    void OpenCLRuntime_setBinaryCacheDirectory(const char *path);
+    
+    /*!
+     Return the runtime for a device type, creating it and building the program on the first call.
+     */
+    OpenCLRuntime *OpenCLRuntime_retain(OpenCLDTW_Device device);
+    
+    /*!
+     Build another copy of OpenCLDTW.cl for the runtime's device with extra compiler options such as -D specialisations, through the binary cache like the shared program. The caller releases it.
+     */
+    cl_program OpenCLRuntime_buildProgram(OpenCLRuntime *self,
+                                          const char *options);
+    
+    /*!
+     True when a CL_MEM_USE_HOST_PTR buffer over data would be used in place rather than copied, the device sharing host memory and data being aligned for it.
+     */
+    Boolean OpenCLRuntime_canUseHostMemory(OpenCLRuntime *self,
+                                           const void *data);
+    
+    /*!
+     Balance an OpenCLRuntime_retain, the runtime is destroyed when the last user releases it.
+     */
+    void OpenCLRuntime_release(OpenCLRuntime *self);
+    
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,10 @@
+//
+//  DTWEquivalenceTests.h
+//  Tests
+//
+
+#import <SenTestingKit/SenTestingKit.h>
+
+@interface DTWEquivalenceTests : SenTestCase
+
+@end
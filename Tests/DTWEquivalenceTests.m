@@ -0,0 +1,863 @@
+//
+//  DTWEquivalenceTests.m
+//  Tests
+//
+//  Every accumulation path of DTW32 against a plain row by row accumulation, the cooperative OpenCL
+//  kernel against one work-item per candidate, and the scorers built beside DTW32 against its score
+//  only path. The inputs are multiples of 1/4 over a few columns, so every dot product and squared
+//  norm is exact whichever order it is summed in and the paths can be compared bit for bit. The few
+//  distinct values also make many cells tie.
+//
+
+#import "DTWEquivalenceTests.h"
+#import <Accelerate/Accelerate.h>
+#import "DTW.h"
+#import "Matrix.h"
+#import "OpenCLBatchDTW.h"
+#import "IncrementalDTW.h"
+#import "DTWKernels.h"
+#import "FastDTW.h"
+
+static UInt32 DTWEquivalence_seed = 1;
+
+static Float32 DTWEquivalence_random(UInt32 levelCount)
+{
+    DTWEquivalence_seed = DTWEquivalence_seed * 1664525 + 1013904223;
+    
+    return (Float32)((DTWEquivalence_seed >> 16) % levelCount + 1) * 0.25f;
+}
+
+static void DTWEquivalence_fill(Float32 *data,
+                                size_t elementCount,
+                                UInt32 levelCount)
+{
+    for (size_t i = 0; i < elementCount; ++i) {
+        
+        data[i] = DTWEquivalence_random(levelCount);
+    }
+}
+
+/*
+ The accumulation DTW32 was written against, one cell at a time in row order. Distances are
+ 1 - dot / (|a||b|) with the dot products from one cblas_sgemm, and a predecessor only replaces the
+ diagonal when it is strictly less, up before left. Returns the score and fills choices with the
+ kDTWStep of each cell.
+ */
+static Float32 DTWEquivalence_referenceScore(Float32 *inputData,
+                                             size_t inputRowCount,
+                                             Float32 *comparisonData,
+                                             size_t comparisonDataRowCount,
+                                             size_t columnCount,
+                                             UInt8 *choices)
+{
+    const size_t m = comparisonDataRowCount;
+    Float32 *inputNorms = calloc(inputRowCount, sizeof(Float32));
+    Float32 *comparisonNorms = calloc(comparisonDataRowCount, sizeof(Float32));
+    Float32 *cells = calloc(inputRowCount * comparisonDataRowCount, sizeof(Float32));
+    
+    DTW32_calculateRowNorms(inputData, inputRowCount, columnCount, inputNorms);
+    DTW32_calculateRowNorms(comparisonData, comparisonDataRowCount, columnCount, comparisonNorms);
+    
+    cblas_sgemm(CblasRowMajor,
+                CblasNoTrans,
+                CblasTrans,
+                (SInt32)inputRowCount,
+                (SInt32)comparisonDataRowCount,
+                (SInt32)columnCount,
+                1.f,
+                inputData,
+                (SInt32)columnCount,
+                comparisonData,
+                (SInt32)columnCount,
+                0.f,
+                cells,
+                (SInt32)comparisonDataRowCount);
+    
+    for (size_t i = 0; i < inputRowCount; ++i) {
+        
+        for (size_t j = 0; j < comparisonDataRowCount; ++j) {
+            
+            Float32 best = 0;
+            UInt8 choice = kDTWStep_Diagonal;
+            
+            if (i == 0 && j > 0) {
+                
+                best = cells[j - 1];
+                choice = kDTWStep_Comparison;
+            }
+            else if (i > 0 && j == 0) {
+                
+                best = cells[(i - 1) * m];
+                choice = kDTWStep_Input;
+            }
+            else if (i > 0) {
+                
+                best = cells[(i - 1) * m + j - 1];
+                
+                if (cells[(i - 1) * m + j] < best) {
+                    
+                    best = cells[(i - 1) * m + j];
+                    choice = kDTWStep_Input;
+                }
+                
+                if (cells[i * m + j - 1] < best) {
+                    
+                    best = cells[i * m + j - 1];
+                    choice = kDTWStep_Comparison;
+                }
+            }
+            
+            cells[i * m + j] = 1.f - cells[i * m + j] / (inputNorms[i] * comparisonNorms[j]) + best;
+            choices[i * m + j] = choice;
+        }
+    }
+    
+    Float32 score = cells[inputRowCount * m - 1];
+    
+    free(inputNorms);
+    free(comparisonNorms);
+    free(cells);
+    
+    return score;
+}
+
+/*
+ Walk the choices back from the last cell until the first row or column, each input row takes the
+ earliest comparison row the path reaches it at, as DTW32_traceWarpPath does.
+ */
+static void DTWEquivalence_referenceWarpPath(const UInt8 *choices,
+                                             size_t inputRowCount,
+                                             size_t comparisonDataRowCount,
+                                             size_t *warpPath)
+{
+    size_t i = inputRowCount - 1;
+    size_t j = comparisonDataRowCount - 1;
+    
+    warpPath[i] = j + 1;
+    
+    while (i > 0 && j > 0) {
+        
+        UInt8 choice = choices[i * comparisonDataRowCount + j];
+        
+        i = choice == kDTWStep_Comparison ? i : i - 1;
+        j = choice == kDTWStep_Input ? j : j - 1;
+        warpPath[i] = j + 1;
+    }
+    
+    for (size_t k = 0; k < i; ++k) {
+        
+        warpPath[k] = j + 1;
+    }
+}
+
+/*
+ One full comparison of random inputs on dtw against the reference, the score and the traced path
+ must both be identical.
+ */
+static Boolean DTWEquivalence_matchesReference(DTW32 *dtw,
+                                               size_t inputRowCount,
+                                               size_t comparisonDataRowCount,
+                                               size_t columnCount,
+                                               UInt32 levelCount)
+{
+    Float32 *inputData = calloc(inputRowCount * columnCount, sizeof(Float32));
+    Float32 *comparisonData = calloc(comparisonDataRowCount * columnCount, sizeof(Float32));
+    UInt8 *choices = calloc(inputRowCount * comparisonDataRowCount, sizeof(UInt8));
+    size_t *warpPath = calloc(inputRowCount, sizeof(size_t));
+    size_t *referenceWarpPath = calloc(inputRowCount, sizeof(size_t));
+    
+    DTWEquivalence_fill(inputData, inputRowCount * columnCount, levelCount);
+    DTWEquivalence_fill(comparisonData, comparisonDataRowCount * columnCount, levelCount);
+    
+    Float32 score = DTW32_getSimilarityScore(dtw, inputData, inputRowCount, comparisonData, comparisonDataRowCount, columnCount);
+    DTW32_traceWarpPath(dtw, warpPath);
+    
+    Float32 referenceScore = DTWEquivalence_referenceScore(inputData, inputRowCount, comparisonData, comparisonDataRowCount, columnCount, choices);
+    DTWEquivalence_referenceWarpPath(choices, inputRowCount, comparisonDataRowCount, referenceWarpPath);
+    
+    Boolean matches = score == referenceScore && memcmp(warpPath, referenceWarpPath, inputRowCount * sizeof(size_t)) == 0;
+    
+    free(inputData);
+    free(comparisonData);
+    free(choices);
+    free(warpPath);
+    free(referenceWarpPath);
+    
+    return matches;
+}
+
+/*
+ Walk the run-length segments of the last traced path one step at a time, giving each input row the
+ first comparison row reaching it, the result must be the warp path traced alongside them.
+ */
+static Boolean DTWEquivalence_segmentsExpandToWarpPath(DTW32 *dtw,
+                                                       size_t inputRowCount,
+                                                       size_t comparisonDataRowCount,
+                                                       size_t columnCount,
+                                                       UInt32 levelCount)
+{
+    Float32 *inputData = calloc(inputRowCount * columnCount, sizeof(Float32));
+    Float32 *comparisonData = calloc(comparisonDataRowCount * columnCount, sizeof(Float32));
+    size_t *warpPath = calloc(inputRowCount, sizeof(size_t));
+    size_t *expandedWarpPath = calloc(inputRowCount, sizeof(size_t));
+    
+    DTWEquivalence_fill(inputData, inputRowCount * columnCount, levelCount);
+    DTWEquivalence_fill(comparisonData, comparisonDataRowCount * columnCount, levelCount);
+    
+    DTW32_getSimilarityScore(dtw, inputData, inputRowCount, comparisonData, comparisonDataRowCount, columnCount);
+    size_t segmentCount = DTW32_traceWarpPath(dtw, warpPath);
+    
+    Boolean matches = segmentCount == dtw->warpSegmentCount && segmentCount > 0;
+    size_t nextRow = 0;
+    size_t row = 0;
+    size_t column = 0;
+    
+    for (size_t i = 0; i < segmentCount && matches == true; ++i) {
+        
+        DTW32_WarpSegment segment = dtw->warpSegments[i];
+        
+        if (i > 0) {
+            
+            matches = segment.inputRow == row + (segment.step != kDTWStep_Comparison)
+                      &&
+                      segment.comparisonRow == column + (segment.step != kDTWStep_Input);
+        }
+        
+        row = segment.inputRow;
+        column = segment.comparisonRow;
+        
+        for (size_t j = 0; j < segment.length; ++j) {
+            
+            if (j > 0) {
+                
+                row += segment.step != kDTWStep_Comparison;
+                column += segment.step != kDTWStep_Input;
+            }
+            
+            while (nextRow <= row && nextRow < inputRowCount) {
+                
+                expandedWarpPath[nextRow] = column + 1;
+                nextRow++;
+            }
+        }
+    }
+    
+    matches = matches
+              &&
+              row == inputRowCount - 1
+              &&
+              column == comparisonDataRowCount - 1
+              &&
+              memcmp(warpPath, expandedWarpPath, inputRowCount * sizeof(size_t)) == 0;
+    
+    free(inputData);
+    free(comparisonData);
+    free(warpPath);
+    free(expandedWarpPath);
+    
+    return matches;
+}
+
+/*
+ The score only accumulation against a full comparison of the same inputs on the same dtw.
+ */
+static Boolean DTWEquivalence_scoreOnlyMatches(DTW32 *dtw,
+                                               size_t inputRowCount,
+                                               size_t comparisonDataRowCount,
+                                               size_t columnCount,
+                                               UInt32 levelCount)
+{
+    Float32 *inputData = calloc(inputRowCount * columnCount, sizeof(Float32));
+    Float32 *comparisonData = calloc(comparisonDataRowCount * columnCount, sizeof(Float32));
+    
+    DTWEquivalence_fill(inputData, inputRowCount * columnCount, levelCount);
+    DTWEquivalence_fill(comparisonData, comparisonDataRowCount * columnCount, levelCount);
+    
+    Float32 score = DTW32_getSimilarityScore(dtw, inputData, inputRowCount, comparisonData, comparisonDataRowCount, columnCount);
+    Float32 scoreOnly = DTW32_getSimilarityScoreOnly(dtw, inputData, inputRowCount, comparisonData, comparisonDataRowCount, columnCount, INFINITY);
+    Float32 abandoned = DTW32_getSimilarityScoreOnly(dtw, inputData, inputRowCount, comparisonData, comparisonDataRowCount, columnCount, score);
+    
+    free(inputData);
+    free(comparisonData);
+    
+    return scoreOnly == score && (abandoned == score || abandoned == INFINITY);
+}
+
+/*
+ OpenCLDTW_bandedDTW without a path constraint, one candidate on the host.
+ */
+static Float32 DTWEquivalence_referenceOpenCLScore(Float32 *analysisData,
+                                                   size_t analysisRowCount,
+                                                   Float32 *paletteData,
+                                                   size_t paletteRowCount,
+                                                   size_t columnCount)
+{
+    const size_t m = paletteRowCount;
+    Float32 *distances = calloc(analysisRowCount * paletteRowCount, sizeof(Float32));
+    Float32 *cells = calloc(analysisRowCount * paletteRowCount, sizeof(Float32));
+    
+    for (size_t i = 0; i < analysisRowCount; ++i) {
+        
+        for (size_t j = 0; j < paletteRowCount; ++j) {
+            
+            Float32 sum = 0;
+            
+            for (size_t k = 0; k < columnCount; ++k) {
+                
+                Float32 difference = analysisData[i * columnCount + k] - paletteData[j * columnCount + k];
+                sum += difference * difference;
+            }
+            
+            distances[i * m + j] = sqrtf(sum);
+        }
+    }
+    
+    for (size_t i = 0; i < analysisRowCount; ++i) {
+        
+        for (size_t j = 0; j < paletteRowCount; ++j) {
+            
+            Float32 distance = distances[i * m + j];
+            Float32 cheapest;
+            
+            if (i == 0 || j == 0) {
+                
+                cheapest = (i == 0 && j == 0) ? distance : INFINITY;
+            }
+            else if (i == 1) {
+                
+                cheapest = j == 1 ? cells[0] + distance : INFINITY;
+            }
+            else if (j == 1) {
+                
+                cheapest = cells[(i - 1) * m] + distance;
+            }
+            else {
+                
+                Float32 top = cells[(i - 2) * m + j - 1] + distances[(i - 1) * m + j] + distance;
+                Float32 middle = cells[(i - 1) * m + j - 1] + distance;
+                Float32 bottom = cells[(i - 1) * m + j - 2] + distances[i * m + j - 1] + distance;
+                
+                cheapest = (top < middle && top < bottom) ? top : (middle < bottom ? middle : bottom);
+            }
+            
+            cells[i * m + j] = cheapest;
+        }
+    }
+    
+    Float32 score = cells[analysisRowCount * m - 1];
+    
+    free(distances);
+    free(cells);
+    
+    return score;
+}
+
+/*
+ Each row divided by its euclidean norm, as AudioAnalysisData32 normalises the triangle bands.
+ */
+static void DTWEquivalence_normaliseRows(Float32 *data,
+                                         size_t rowCount,
+                                         size_t columnCount,
+                                         Float32 *normalisedData)
+{
+    for (size_t i = 0; i < rowCount; ++i) {
+        
+        Float32 norm = 0;
+        vDSP_svesq(&data[i * columnCount], 1, &norm, columnCount);
+        norm = sqrtf(norm);
+        vDSP_vsdiv(&data[i * columnCount], 1, &norm, &normalisedData[i * columnCount], 1, columnCount);
+    }
+}
+
+@implementation DTWEquivalenceTests
+
+- (void)testWavefrontMatchesReference
+{
+    const size_t sizes[][3] = {
+        {1, 1, 1}, {1, 9, 3}, {9, 1, 3}, {2, 2, 1}, {3, 5, 2}, {5, 3, 4},
+        {16, 16, 1}, {31, 33, 3}, {64, 64, 5}, {100, 37, 2}, {255, 256, 4}, {256, 256, 3}
+    };
+    
+    DTW32 *dtw = DTW32_new(256, 8);
+    
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        
+        for (UInt32 levelCount = 2; levelCount <= 8; levelCount *= 2) {
+            
+            STAssertTrue(DTWEquivalence_matchesReference(dtw, sizes[i][0], sizes[i][1], sizes[i][2], levelCount),
+                         @"Wavefront differs from the reference at %zu x %zu, %zu columns, %u levels",
+                         sizes[i][0], sizes[i][1], sizes[i][2], levelCount);
+        }
+    }
+    
+    DTW32_delete(dtw);
+}
+
+- (void)testWarpSegmentsExpandToWarpPath
+{
+    const size_t sizes[][3] = {
+        {1, 1, 1}, {1, 9, 3}, {9, 1, 3}, {2, 2, 1}, {5, 3, 4}, {31, 33, 3}, {64, 64, 2}, {100, 37, 2}
+    };
+    
+    DTW32 *dtw = DTW32_new(128, 8);
+    DTW32 *constrainedDTW = DTW32_newConstrained(128, 8, kDTWConstraint_SakoeChiba, 64);
+    
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        
+        STAssertTrue(DTWEquivalence_segmentsExpandToWarpPath(dtw, sizes[i][0], sizes[i][1], sizes[i][2], 2),
+                     @"Warp segments do not expand to the warp path at %zu x %zu, %zu columns",
+                     sizes[i][0], sizes[i][1], sizes[i][2]);
+        STAssertTrue(DTWEquivalence_segmentsExpandToWarpPath(constrainedDTW, sizes[i][0], sizes[i][1], sizes[i][2], 2),
+                     @"Constrained warp segments do not expand to the warp path at %zu x %zu, %zu columns",
+                     sizes[i][0], sizes[i][1], sizes[i][2]);
+    }
+    
+    DTW32_delete(dtw);
+    DTW32_delete(constrainedDTW);
+}
+
+- (void)testTiledMatchesReference
+{
+    const size_t sizes[][3] = {
+        {256, 257, 3}, {257, 256, 2}, {300, 300, 4}, {320, 320, 1},
+        {513, 130, 3}, {130, 513, 2}, {70, 1000, 4}, {1000, 70, 3}
+    };
+    
+    DTW32 *dtw = DTW32_new(1000, 8);
+    
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        
+        STAssertTrue(sizes[i][0] * sizes[i][1] > DTW32_TILED_CELL_THRESHOLD, @"Size %zu is not tiled", i);
+        STAssertTrue(DTWEquivalence_matchesReference(dtw, sizes[i][0], sizes[i][1], sizes[i][2], 2),
+                     @"Tiled accumulation differs from the reference at %zu x %zu, %zu columns",
+                     sizes[i][0], sizes[i][1], sizes[i][2]);
+    }
+    
+    DTW32_delete(dtw);
+}
+
+- (void)testParallelMatchesReference
+{
+    const size_t sizes[][3] = {
+        {1, 1, 1}, {1, 300, 2}, {300, 1, 2}, {64, 64, 3}, {65, 63, 4},
+        {300, 300, 2}, {513, 130, 3}, {130, 513, 1}
+    };
+    
+    DTW32 *dtw = DTW32_new(513, 8);
+    DTW32_setParallelAccumulation(dtw, 4, 0);
+    
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        
+        STAssertTrue(DTWEquivalence_matchesReference(dtw, sizes[i][0], sizes[i][1], sizes[i][2], 2),
+                     @"Parallel accumulation differs from the reference at %zu x %zu, %zu columns",
+                     sizes[i][0], sizes[i][1], sizes[i][2]);
+    }
+    
+    DTW32_delete(dtw);
+}
+
+- (void)testScoreOnlyMatchesFullComparison
+{
+    const size_t sizes[][3] = {
+        {1, 1, 1}, {1, 9, 3}, {9, 1, 3}, {4, 4, 2}, {24, 40, 4}, {40, 24, 2}, {64, 64, 1}, {64, 63, 5}
+    };
+    
+    DTW32 *dtws[] = {
+        DTW32_new(64, 8),
+        DTW32_newConstrained(64, 8, kDTWConstraint_SakoeChiba, 3),
+        DTW32_newConstrained(64, 8, kDTWConstraint_Itakura, 2)
+    };
+    
+    for (size_t d = 0; d < sizeof(dtws) / sizeof(dtws[0]); ++d) {
+        
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+            
+            STAssertTrue(DTWEquivalence_scoreOnlyMatches(dtws[d], sizes[i][0], sizes[i][1], sizes[i][2], 2),
+                         @"Score only differs from the full comparison at %zu x %zu, %zu columns, constraint %d",
+                         sizes[i][0], sizes[i][1], sizes[i][2], dtws[d]->constraint);
+        }
+        
+        DTW32_delete(dtws[d]);
+    }
+}
+
+- (void)testCooperativeKernelMatchesWorkItems
+{
+    const size_t analysisRowCount = 6;
+    const size_t paletteRowCount = 200;
+    const size_t bandCount = 3;
+    Matrix32 *paletteBands[bandCount];
+    Matrix32 *analysisBands[bandCount];
+    Matrix32 *beats = Matrix32_new(2, 12);
+    
+    for (size_t i = 0; i < bandCount; ++i) {
+        
+        paletteBands[i] = Matrix32_new(paletteRowCount, i + 1);
+        analysisBands[i] = Matrix32_new(analysisRowCount, i + 1);
+        DTWEquivalence_fill(paletteBands[i]->data, paletteRowCount * (i + 1), 4);
+        DTWEquivalence_fill(analysisBands[i]->data, analysisRowCount * (i + 1), 4);
+    }
+    
+    for (size_t i = 0; i < beats->columnCount; ++i) {
+        
+        beats->data[i] = (Float32)(i * 17);
+        beats->data[beats->columnCount + i] = (Float32)(analysisRowCount - 2 + i % 5);
+    }
+    
+    for (size_t beatMode = 0; beatMode < 2; ++beatMode) {
+        
+        Boolean useBeats = beatMode == 1;
+        OpenCLBatchDTW *batch = OpenCLBatchDTW_new(OpenCLDTW_useCPU, analysisRowCount, paletteBands, bandCount, NULL, beats, useBeats);
+        size_t scoreCount = bandCount * batch->candidateCount;
+        Float32 *workItemScores = calloc(scoreCount, sizeof(Float32));
+        Float32 *cooperativeScores = calloc(scoreCount, sizeof(Float32));
+        
+        for (DTWConstraint constraint = kDTWConstraint_None; constraint <= kDTWConstraint_Itakura; ++constraint) {
+            
+            OpenCLBatchDTW_setConstraint(batch, constraint, 2);
+            OpenCLBatchDTW_setWorkGroupSize(batch, 0);
+            OpenCLBatchDTW_getScores(batch, analysisBands, workItemScores);
+            
+            for (size_t workGroupSize = 1; workGroupSize <= batch->maximumWorkGroupSize; workGroupSize = workGroupSize * 2 + 1) {
+                
+                OpenCLBatchDTW_setWorkGroupSize(batch, workGroupSize);
+                OpenCLBatchDTW_getScores(batch, analysisBands, cooperativeScores);
+                
+                STAssertTrue(memcmp(workItemScores, cooperativeScores, scoreCount * sizeof(Float32)) == 0,
+                             @"Cooperative kernel differs from one work-item per candidate, beats %d, constraint %d, work-group size %zu",
+                             useBeats, constraint, workGroupSize);
+            }
+        }
+        
+        free(workItemScores);
+        free(cooperativeScores);
+        OpenCLBatchDTW_delete(batch);
+    }
+    
+    for (size_t i = 0; i < bandCount; ++i) {
+        
+        Matrix32_delete(paletteBands[i]);
+        Matrix32_delete(analysisBands[i]);
+    }
+    
+    Matrix32_delete(beats);
+}
+
+- (void)testOpenCLScoresMatchCPU
+{
+    const size_t analysisRowCount = 8;
+    const size_t paletteRowCount = 160;
+    const size_t bandCount = 2;
+    Matrix32 *paletteBands[bandCount];
+    Matrix32 *analysisBands[bandCount];
+    
+    for (size_t i = 0; i < bandCount; ++i) {
+        
+        paletteBands[i] = Matrix32_new(paletteRowCount, 2 * i + 3);
+        analysisBands[i] = Matrix32_new(analysisRowCount, 2 * i + 3);
+        DTWEquivalence_fill(paletteBands[i]->data, paletteRowCount * (2 * i + 3), 8);
+        DTWEquivalence_fill(analysisBands[i]->data, analysisRowCount * (2 * i + 3), 8);
+    }
+    
+    OpenCLBatchDTW *batch = OpenCLBatchDTW_new(OpenCLDTW_useCPU, analysisRowCount, paletteBands, bandCount, NULL, NULL, false);
+    Float32 *scores = calloc(bandCount * batch->candidateCount, sizeof(Float32));
+    
+    OpenCLBatchDTW_getScores(batch, analysisBands, scores);
+    
+    for (size_t band = 0; band < bandCount; ++band) {
+        
+        for (size_t candidate = 0; candidate < batch->candidateCount; ++candidate) {
+            
+            Float32 reference = DTWEquivalence_referenceOpenCLScore(analysisBands[band]->data,
+                                                                    analysisRowCount,
+                                                                    Matrix_getRow(paletteBands[band], candidate),
+                                                                    analysisRowCount,
+                                                                    paletteBands[band]->columnCount);
+            Float32 score = scores[band * batch->candidateCount + candidate];
+            
+            STAssertTrue(score == reference || fabsf(score - reference) <= 1e-4f * fabsf(reference),
+                         @"OpenCL score %f differs from the CPU score %f, band %zu candidate %zu",
+                         score, reference, band, candidate);
+        }
+    }
+    
+    free(scores);
+    OpenCLBatchDTW_delete(batch);
+    
+    for (size_t i = 0; i < bandCount; ++i) {
+        
+        Matrix32_delete(paletteBands[i]);
+        Matrix32_delete(analysisBands[i]);
+    }
+}
+
+
+- (void)testIncrementalMatchesScoreOnly
+{
+    const size_t rowCount = 6;
+    const size_t paletteRowCount = 97;
+    const size_t columnCount = 3;
+    Float32 *analysisData = calloc(rowCount * columnCount, sizeof(Float32));
+    Float32 *paletteData = calloc(paletteRowCount * columnCount, sizeof(Float32));
+    Matrix32 *beats = Matrix32_new(2, 14);
+    
+    DTWEquivalence_fill(paletteData, paletteRowCount * columnCount, 4);
+    
+    for (size_t i = 0; i < beats->columnCount; ++i) {
+        
+        beats->data[i] = (Float32)(i * 7);
+        beats->data[beats->columnCount + i] = (Float32)(1 + i % 9);
+    }
+    
+    DTW32 *dtw = DTW32_new(16, columnCount);
+    
+    for (size_t beatMode = 0; beatMode < 2; ++beatMode) {
+        
+        Boolean useBeats = beatMode == 1;
+        IncrementalDTW32 *incrementalDTW = IncrementalDTW32_new(rowCount, columnCount, paletteData, paletteRowCount, beats, useBeats);
+        
+        for (size_t segment = 0; segment < 3; ++segment) {
+            
+            DTWEquivalence_fill(analysisData, rowCount * columnCount, 4);
+            IncrementalDTW32_reset(incrementalDTW);
+            
+            for (size_t i = 0; i < rowCount; ++i) {
+                
+                IncrementalDTW32_advance(incrementalDTW, &analysisData[i * columnCount]);
+            }
+            
+            size_t bestCandidate = 0;
+            Float32 bestScore = INFINITY;
+            
+            for (size_t candidate = 0; candidate < incrementalDTW->candidateCount; ++candidate) {
+                
+                size_t length = incrementalDTW->candidateLengths[candidate];
+                Float32 score = incrementalDTW->frontier[incrementalDTW->frontierOffsets[candidate] + length - 1];
+                Float32 reference = DTW32_getSimilarityScoreOnly(dtw,
+                                                                 analysisData,
+                                                                 rowCount,
+                                                                 &paletteData[incrementalDTW->candidateStarts[candidate] * columnCount],
+                                                                 length,
+                                                                 columnCount,
+                                                                 INFINITY);
+                
+                STAssertTrue(score == reference || fabsf(score - reference) <= 1e-5f * (1.f + reference),
+                             @"Incremental score %f differs from the score only %f, beats %d, segment %zu, candidate %zu",
+                             score, reference, useBeats, segment, candidate);
+                
+                if (reference < bestScore) {
+                    
+                    bestScore = reference;
+                    bestCandidate = candidate;
+                }
+            }
+            
+            STAssertEquals(IncrementalDTW32_getBestCandidate(incrementalDTW, NULL), bestCandidate,
+                           @"Wrong best candidate, beats %d, segment %zu", useBeats, segment);
+        }
+        
+        IncrementalDTW32_delete(incrementalDTW);
+    }
+    
+    DTW32_delete(dtw);
+    Matrix32_delete(beats);
+    free(analysisData);
+    free(paletteData);
+}
+
+
+- (void)testLanesMatchScoreOnly
+{
+    const size_t rowCount = 7;
+    const size_t columnCount = 3;
+    const size_t candidateCount = 2 * DTW32_CANDIDATE_LANE_COUNT + 3;
+    const size_t paletteRowCount = (candidateCount + 1) * rowCount;
+    const size_t groupCount = DTW32_candidateLaneGroupCount(candidateCount);
+    const size_t groupSize = rowCount * columnCount * DTW32_CANDIDATE_LANE_COUNT;
+    Float32 *analysisData = calloc(rowCount * columnCount, sizeof(Float32));
+    Float32 *normalisedAnalysisData = calloc(rowCount * columnCount, sizeof(Float32));
+    Float32 *paletteData = calloc(paletteRowCount * columnCount, sizeof(Float32));
+    Float32 *normalisedPaletteData = calloc(paletteRowCount * columnCount, sizeof(Float32));
+    Float32 *candidateLanes = calloc(groupCount * groupSize, sizeof(Float32));
+    size_t candidateStarts[candidateCount];
+    Float32 scores[DTW32_CANDIDATE_LANE_COUNT];
+    
+    STAssertEquals(groupCount, (size_t)3, @"Wrong lane group count");
+    
+    DTWEquivalence_fill(analysisData, rowCount * columnCount, 4);
+    DTWEquivalence_fill(paletteData, paletteRowCount * columnCount, 4);
+    
+    DTWEquivalence_normaliseRows(analysisData, rowCount, columnCount, normalisedAnalysisData);
+    DTWEquivalence_normaliseRows(paletteData, paletteRowCount, columnCount, normalisedPaletteData);
+    
+    for (size_t i = 0; i < candidateCount; ++i) {
+        
+        candidateStarts[i] = i * rowCount + i % 3;
+    }
+    
+    DTW32_transposeCandidateLanes(normalisedPaletteData, columnCount, candidateStarts, candidateCount, rowCount, candidateLanes);
+    
+    DTW32 *dtws[] = {
+        DTW32_new(rowCount, columnCount),
+        DTW32_newConstrained(rowCount, columnCount, kDTWConstraint_SakoeChiba, 2),
+        DTW32_newConstrained(rowCount, columnCount, kDTWConstraint_Itakura, 2)
+    };
+    
+    for (size_t d = 0; d < sizeof(dtws) / sizeof(dtws[0]); ++d) {
+        
+        for (size_t group = 0; group < groupCount; ++group) {
+            
+            size_t laneCount = candidateCount - group * DTW32_CANDIDATE_LANE_COUNT;
+            laneCount = laneCount < DTW32_CANDIDATE_LANE_COUNT ? laneCount : DTW32_CANDIDATE_LANE_COUNT;
+            
+            DTW32_getSimilarityScoresLanes(dtws[d],
+                                           normalisedAnalysisData,
+                                           rowCount,
+                                           &candidateLanes[group * groupSize],
+                                           laneCount,
+                                           rowCount,
+                                           columnCount,
+                                           INFINITY,
+                                           scores);
+            
+            for (size_t lane = 0; lane < laneCount; ++lane) {
+                
+                size_t candidate = group * DTW32_CANDIDATE_LANE_COUNT + lane;
+                Float32 reference = DTW32_getSimilarityScoreOnly(dtws[d],
+                                                                 analysisData,
+                                                                 rowCount,
+                                                                 &paletteData[candidateStarts[candidate] * columnCount],
+                                                                 rowCount,
+                                                                 columnCount,
+                                                                 INFINITY);
+                
+                STAssertTrue(scores[lane] == reference || fabsf(scores[lane] - reference) <= 1e-5f * (1.f + reference),
+                             @"Lane score %f differs from the window score %f, constraint %d, candidate %zu",
+                             scores[lane], reference, dtws[d]->constraint, candidate);
+            }
+        }
+        
+        DTW32_delete(dtws[d]);
+    }
+    
+    free(analysisData);
+    free(normalisedAnalysisData);
+    free(paletteData);
+    free(normalisedPaletteData);
+    free(candidateLanes);
+}
+
+
+- (void)testScoreKernelsMatchFromDistances
+{
+    const size_t rowCounts[] = {2, 4, 8, 16, 32};
+    Float32 *inputData = calloc(32 * DTW32_SCORE_KERNEL_MAXIMUM_COLUMN_COUNT, sizeof(Float32));
+    Float32 *comparisonData = calloc(32 * DTW32_SCORE_KERNEL_MAXIMUM_COLUMN_COUNT, sizeof(Float32));
+    Float32 *normalisedInputData = calloc(32 * DTW32_SCORE_KERNEL_MAXIMUM_COLUMN_COUNT, sizeof(Float32));
+    Float32 *normalisedComparisonData = calloc(32 * DTW32_SCORE_KERNEL_MAXIMUM_COLUMN_COUNT, sizeof(Float32));
+    Float32 *distanceMatrix = calloc(32 * 32, sizeof(Float32));
+    
+    DTW32 *dtw = DTW32_new(32, DTW32_SCORE_KERNEL_MAXIMUM_COLUMN_COUNT);
+    
+    for (size_t i = 0; i < sizeof(rowCounts) / sizeof(rowCounts[0]); ++i) {
+        
+        const size_t rowCount = rowCounts[i];
+        
+        for (size_t columnCount = 1; columnCount <= DTW32_SCORE_KERNEL_MAXIMUM_COLUMN_COUNT; ++columnCount) {
+            
+            DTW32_ScoreKernel scoreKernel = DTW32_getScoreKernel(rowCount, columnCount);
+            
+            STAssertTrue(scoreKernel != NULL, @"No kernel for %zu rows, %zu columns", rowCount, columnCount);
+            
+            if (scoreKernel == NULL) {
+                
+                continue;
+            }
+            
+            DTWEquivalence_fill(inputData, rowCount * columnCount, 4);
+            DTWEquivalence_fill(comparisonData, rowCount * columnCount, 4);
+            DTWEquivalence_normaliseRows(inputData, rowCount, columnCount, normalisedInputData);
+            DTWEquivalence_normaliseRows(comparisonData, rowCount, columnCount, normalisedComparisonData);
+            DTW32_calculateNormalisedDistanceMatrix(normalisedInputData,
+                                                    rowCount,
+                                                    normalisedComparisonData,
+                                                    rowCount,
+                                                    columnCount,
+                                                    distanceMatrix);
+            
+            Float32 reference = DTW32_getSimilarityScoreFromDistances(dtw, distanceMatrix, rowCount, rowCount, rowCount, INFINITY);
+            Float32 score = scoreKernel(normalisedInputData, normalisedComparisonData, INFINITY);
+            Float32 abandoned = scoreKernel(normalisedInputData, normalisedComparisonData, reference * 0.5f);
+            Float32 referenceAbandoned = DTW32_getSimilarityScoreFromDistances(dtw, distanceMatrix, rowCount, rowCount, rowCount, reference * 0.5f);
+            
+            STAssertTrue(score == reference || fabsf(score - reference) <= 1e-5f * (1.f + reference),
+                         @"Kernel score %f differs from the distances score %f at %zu rows, %zu columns",
+                         score, reference, rowCount, columnCount);
+            STAssertTrue((abandoned == INFINITY) == (referenceAbandoned == INFINITY),
+                         @"Kernel abandons differently at %zu rows, %zu columns", rowCount, columnCount);
+        }
+    }
+    
+    STAssertTrue(DTW32_getScoreKernel(3, 2) == NULL, @"Kernel for an unspecialised row count");
+    STAssertTrue(DTW32_getScoreKernel(8, DTW32_SCORE_KERNEL_MAXIMUM_COLUMN_COUNT + 1) == NULL, @"Kernel for an unspecialised column count");
+    
+    DTW32_delete(dtw);
+    free(inputData);
+    free(comparisonData);
+    free(normalisedInputData);
+    free(normalisedComparisonData);
+    free(distanceMatrix);
+}
+
+
+- (void)testFastDTWExactAtFullRadius
+{
+    const size_t sizes[][3] = {
+        {1, 1, 1}, {1, 9, 3}, {9, 1, 3}, {2, 2, 1}, {5, 3, 4}, {16, 16, 2}, {31, 33, 3}, {64, 40, 2}
+    };
+    
+    DTW32 *dtw = DTW32_new(64, 4);
+    size_t warpPath[64];
+    size_t fastWarpPath[64];
+    
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        
+        const size_t inputRowCount = sizes[i][0];
+        const size_t comparisonDataRowCount = sizes[i][1];
+        const size_t columnCount = sizes[i][2];
+        const size_t radius = inputRowCount > comparisonDataRowCount ? inputRowCount : comparisonDataRowCount;
+        Float32 *inputData = calloc(inputRowCount * columnCount, sizeof(Float32));
+        Float32 *comparisonData = calloc(comparisonDataRowCount * columnCount, sizeof(Float32));
+        FastDTW32 *fastDTW = FastDTW32_new(64, 4, radius);
+        FastDTW32 *narrowFastDTW = FastDTW32_new(64, 4, 1);
+        
+        DTWEquivalence_fill(inputData, inputRowCount * columnCount, 4);
+        DTWEquivalence_fill(comparisonData, comparisonDataRowCount * columnCount, 4);
+        
+        Float32 score = DTW32_getSimilarityScore(dtw, inputData, inputRowCount, comparisonData, comparisonDataRowCount, columnCount);
+        Float32 fastScore = FastDTW32_getSimilarityScore(fastDTW, inputData, inputRowCount, comparisonData, comparisonDataRowCount, columnCount);
+        Float32 narrowScore = FastDTW32_getSimilarityScore(narrowFastDTW, inputData, inputRowCount, comparisonData, comparisonDataRowCount, columnCount);
+        
+        DTW32_traceWarpPath(dtw, warpPath);
+        FastDTW32_getWarpPath(fastDTW, fastWarpPath);
+        
+        STAssertTrue(fastScore == score || fabsf(fastScore - score) <= 1e-5f * (1.f + score),
+                     @"FastDTW score %f differs from the exact score %f at %zu x %zu, %zu columns",
+                     fastScore, score, inputRowCount, comparisonDataRowCount, columnCount);
+        STAssertTrue(memcmp(warpPath, fastWarpPath, inputRowCount * sizeof(size_t)) == 0,
+                     @"FastDTW warp path differs at %zu x %zu, %zu columns",
+                     inputRowCount, comparisonDataRowCount, columnCount);
+        STAssertTrue(narrowScore >= score - 1e-5f * (1.f + score),
+                     @"Radius 1 score %f is below the exact score %f at %zu x %zu, %zu columns",
+                     narrowScore, score, inputRowCount, comparisonDataRowCount, columnCount);
+        
+        FastDTW32_delete(fastDTW);
+        FastDTW32_delete(narrowFastDTW);
+        free(inputData);
+        free(comparisonData);
+    }
+    
+    DTW32_delete(dtw);
+}
+
+@end
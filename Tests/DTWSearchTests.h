@@ -0,0 +1,10 @@
+//
+//  DTWSearchTests.h
+//  Tests
+//
+
+#import <SenTestingKit/SenTestingKit.h>
+
+@interface DTWSearchTests : SenTestCase
+
+@end
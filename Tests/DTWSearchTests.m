@@ -0,0 +1,258 @@
+//
+//  DTWSearchTests.m
+//  Tests
+//
+//  The palette searches built on DTW32 against scoring every candidate or window with a full
+//  comparison. The inputs are positive multiples of 1/4, as the triangle band magnitudes are never
+//  negative.
+//
+
+#import "DTWSearchTests.h"
+#import <math.h>
+#import "DTW.h"
+
+static UInt32 DTWSearch_seed = 1;
+
+static void DTWSearch_fill(Float32 *data,
+                           size_t elementCount,
+                           UInt32 levelCount)
+{
+    for (size_t i = 0; i < elementCount; ++i) {
+        
+        DTWSearch_seed = DTWSearch_seed * 1664525 + 1013904223;
+        data[i] = (Float32)((DTWSearch_seed >> 16) % levelCount + 1) * 0.25f;
+    }
+}
+
+static Boolean DTWSearch_isClose(Float32 a,
+                                 Float32 b)
+{
+    return a == b || fabsf(a - b) <= 1e-5f * (1.f + fabsf(b));
+}
+
+/*
+ The candidate loop of AudioAnalyser32_findBestMatch over windows of inputRowCount palette rows,
+ pruning with LB_Kim, then LB_Keogh, then abandoning against the best score so far.
+ */
+static size_t DTWSearch_findBestMatchPruned(DTW32 *dtw,
+                                            Float32 *inputData,
+                                            size_t inputRowCount,
+                                            Float32 *paletteData,
+                                            Float32 *paletteEnvelope,
+                                            size_t paletteRowCount,
+                                            size_t columnCount,
+                                            Float32 *bestScore,
+                                            size_t *prunedCount)
+{
+    size_t bestMatch = 0;
+    *bestScore = INFINITY;
+    *prunedCount = 0;
+    
+    for (size_t i = 0; i < paletteRowCount - inputRowCount; i += inputRowCount) {
+        
+        Float32 *candidate = &paletteData[i * columnCount];
+        
+        if (DTW32_lowerBoundKim(inputData, inputRowCount, candidate, inputRowCount, columnCount) >= *bestScore
+            ||
+            DTW32_lowerBoundKeogh(inputData, inputRowCount, &paletteEnvelope[i * columnCount], columnCount, *bestScore) >= *bestScore) {
+            
+            (*prunedCount)++;
+            continue;
+        }
+        
+        Float32 score = DTW32_getSimilarityScoreOnly(dtw, inputData, inputRowCount, candidate, inputRowCount, columnCount, *bestScore);
+        
+        if (score == INFINITY) {
+            
+            (*prunedCount)++;
+            continue;
+        }
+        
+        if (score < *bestScore) {
+            
+            *bestScore = score;
+            bestMatch = i;
+        }
+    }
+    
+    return bestMatch;
+}
+
+@implementation DTWSearchTests
+
+- (void)testLowerBoundsDoNotExceedScore
+{
+    const size_t inputRowCount = 6;
+    const size_t paletteRowCount = 120;
+    const size_t columnCount = 3;
+    Float32 *inputData = calloc(inputRowCount * columnCount, sizeof(Float32));
+    Float32 *paletteData = calloc(paletteRowCount * columnCount, sizeof(Float32));
+    Float32 *paletteEnvelope = calloc(paletteRowCount * columnCount, sizeof(Float32));
+    
+    DTW32 *dtws[] = {
+        DTW32_new(inputRowCount, columnCount),
+        DTW32_newConstrained(inputRowCount, columnCount, kDTWConstraint_SakoeChiba, 2)
+    };
+    const size_t envelopeRadii[] = {inputRowCount - 1, 2};
+    
+    for (size_t d = 0; d < sizeof(dtws) / sizeof(dtws[0]); ++d) {
+        
+        DTWSearch_fill(inputData, inputRowCount * columnCount, 4);
+        DTWSearch_fill(paletteData, paletteRowCount * columnCount, 4);
+        DTW32_calculateUpperEnvelope(paletteData, paletteRowCount, columnCount, envelopeRadii[d], paletteEnvelope);
+        
+        for (size_t i = 0; i + inputRowCount <= paletteRowCount; ++i) {
+            
+            Float32 score = DTW32_getSimilarityScore(dtws[d], inputData, inputRowCount, &paletteData[i * columnCount], inputRowCount, columnCount);
+            Float32 kim = DTW32_lowerBoundKim(inputData, inputRowCount, &paletteData[i * columnCount], inputRowCount, columnCount);
+            Float32 keogh = DTW32_lowerBoundKeogh(inputData, inputRowCount, &paletteEnvelope[i * columnCount], columnCount, INFINITY);
+            
+            STAssertTrue(kim <= score + 1e-5f, @"LB_Kim %f exceeds the score %f at row %zu, constraint %d", kim, score, i, dtws[d]->constraint);
+            STAssertTrue(keogh <= score + 1e-5f, @"LB_Keogh %f exceeds the score %f at row %zu, constraint %d", keogh, score, i, dtws[d]->constraint);
+        }
+        
+        DTW32_delete(dtws[d]);
+    }
+    
+    free(inputData);
+    free(paletteData);
+    free(paletteEnvelope);
+}
+
+- (void)testPruningKeepsBestMatch
+{
+    const size_t inputRowCount = 6;
+    const size_t paletteRowCount = 600;
+    const size_t columnCount = 3;
+    Float32 *inputData = calloc(inputRowCount * columnCount, sizeof(Float32));
+    Float32 *paletteData = calloc(paletteRowCount * columnCount, sizeof(Float32));
+    Float32 *paletteEnvelope = calloc(paletteRowCount * columnCount, sizeof(Float32));
+    size_t totalPrunedCount = 0;
+    
+    DTW32 *dtw = DTW32_new(inputRowCount, columnCount);
+    
+    for (size_t trial = 0; trial < 8; ++trial) {
+        
+        DTWSearch_fill(inputData, inputRowCount * columnCount, 4);
+        DTWSearch_fill(paletteData, paletteRowCount * columnCount, 4);
+        DTW32_calculateUpperEnvelope(paletteData, paletteRowCount, columnCount, inputRowCount - 1, paletteEnvelope);
+        
+        size_t bestMatch = 0;
+        Float32 bestScore = INFINITY;
+        
+        for (size_t i = 0; i < paletteRowCount - inputRowCount; i += inputRowCount) {
+            
+            Float32 score = DTW32_getSimilarityScore(dtw, inputData, inputRowCount, &paletteData[i * columnCount], inputRowCount, columnCount);
+            
+            if (score < bestScore) {
+                
+                bestScore = score;
+                bestMatch = i;
+            }
+        }
+        
+        Float32 prunedScore;
+        size_t prunedCount;
+        size_t prunedMatch = DTWSearch_findBestMatchPruned(dtw,
+                                                           inputData,
+                                                           inputRowCount,
+                                                           paletteData,
+                                                           paletteEnvelope,
+                                                           paletteRowCount,
+                                                           columnCount,
+                                                           &prunedScore,
+                                                           &prunedCount);
+        
+        STAssertEquals(prunedMatch, bestMatch, @"Pruning changed the best match in trial %zu", trial);
+        STAssertTrue(DTWSearch_isClose(prunedScore, bestScore), @"Pruning changed the best score %f to %f in trial %zu", bestScore, prunedScore, trial);
+        
+        totalPrunedCount += prunedCount;
+    }
+    
+    STAssertTrue(totalPrunedCount > 0, @"No candidate was pruned");
+    
+    DTW32_delete(dtw);
+    free(inputData);
+    free(paletteData);
+    free(paletteEnvelope);
+}
+
+- (void)testSubsequenceMatchesBruteForce
+{
+    const size_t sizes[][3] = {
+        {1, 1, 1}, {1, 12, 2}, {3, 1, 2}, {4, 30, 3}, {8, 40, 2}, {12, 25, 4}
+    };
+    
+    DTW32 *dtw = DTW32_new(40, 4);
+    
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        
+        const size_t inputRowCount = sizes[i][0];
+        const size_t paletteRowCount = sizes[i][1];
+        const size_t columnCount = sizes[i][2];
+        Float32 *inputData = calloc(inputRowCount * columnCount, sizeof(Float32));
+        Float32 *paletteData = calloc(paletteRowCount * columnCount, sizeof(Float32));
+        
+        DTWSearch_fill(inputData, inputRowCount * columnCount, 4);
+        DTWSearch_fill(paletteData, paletteRowCount * columnCount, 4);
+        
+        Float32 bestScore = INFINITY;
+        
+        for (size_t start = 0; start < paletteRowCount; ++start) {
+            
+            for (size_t end = start; end < paletteRowCount; ++end) {
+                
+                Float32 score = DTW32_getSimilarityScore(dtw, inputData, inputRowCount, &paletteData[start * columnCount], end - start + 1, columnCount);
+                bestScore = score < bestScore ? score : bestScore;
+            }
+        }
+        
+        DTW32_SubsequenceMatch match = DTW32_findSubsequence(dtw, inputData, inputRowCount, paletteData, paletteRowCount, columnCount);
+        
+        STAssertTrue(match.start <= match.end && match.end < paletteRowCount,
+                     @"Span %zu to %zu is outside the palette at %zu x %zu", match.start, match.end, inputRowCount, paletteRowCount);
+        STAssertTrue(DTWSearch_isClose(match.score, bestScore),
+                     @"Subsequence score %f differs from the best window %f at %zu x %zu", match.score, bestScore, inputRowCount, paletteRowCount);
+        
+        Float32 spanScore = DTW32_getSimilarityScore(dtw, inputData, inputRowCount, &paletteData[match.start * columnCount], match.end - match.start + 1, columnCount);
+        
+        STAssertTrue(DTWSearch_isClose(spanScore, match.score),
+                     @"Span %zu to %zu scores %f, not %f, at %zu x %zu", match.start, match.end, spanScore, match.score, inputRowCount, paletteRowCount);
+        
+        free(inputData);
+        free(paletteData);
+    }
+    
+    DTW32_delete(dtw);
+}
+
+- (void)testSubsequenceFindsEmbeddedInput
+{
+    const size_t inputRowCount = 7;
+    const size_t paletteRowCount = 90;
+    const size_t columnCount = 4;
+    const size_t offset = 37;
+    Float32 *inputData = calloc(inputRowCount * columnCount, sizeof(Float32));
+    Float32 *paletteData = calloc(paletteRowCount * columnCount, sizeof(Float32));
+    
+    DTWSearch_fill(inputData, inputRowCount * columnCount, 8);
+    DTWSearch_fill(paletteData, paletteRowCount * columnCount, 8);
+    
+    for (size_t i = 0; i < inputRowCount * columnCount; ++i) {
+        
+        paletteData[offset * columnCount + i] = 2.f * inputData[i];
+    }
+    
+    DTW32 *dtw = DTW32_new(inputRowCount, columnCount);
+    DTW32_SubsequenceMatch match = DTW32_findSubsequence(dtw, inputData, inputRowCount, paletteData, paletteRowCount, columnCount);
+    
+    STAssertEquals(match.start, offset, @"Wrong span start");
+    STAssertEquals(match.end, offset + inputRowCount - 1, @"Wrong span end");
+    STAssertTrue(fabsf(match.score) <= 1e-5f, @"Embedded input scores %f", match.score);
+    
+    DTW32_delete(dtw);
+    free(inputData);
+    free(paletteData);
+}
+
+@end
@@ -0,0 +1,10 @@
+//
+//  MatchHeapTests.h
+//  Tests
+//
+
+#import <SenTestingKit/SenTestingKit.h>
+
+@interface MatchHeapTests : SenTestCase
+
+@end
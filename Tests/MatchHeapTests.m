@@ -0,0 +1,163 @@
+//
+//  MatchHeapTests.m
+//  Tests
+//
+//  MatchHeap32 against a sorted list of every candidate offered.
+//
+
+#import "MatchHeapTests.h"
+#import <math.h>
+#import "MatchHeap.h"
+
+@implementation MatchHeapTests
+
+- (void)testInsertKeepsLowestScores
+{
+    const Float32 scores[] = {5, 3, 9, 1, 7, 2, 8, 6, 4, 0};
+    const size_t candidateCount = sizeof(scores) / sizeof(scores[0]);
+    MatchHeap32 *heap = MatchHeap32_new(4);
+    
+    for (size_t i = 0; i < candidateCount; ++i) {
+        
+        STAssertTrue(i >= 4 || MatchHeap32_getThreshold(heap) == INFINITY, @"Threshold before the heap is full");
+        MatchHeap32_insert(heap, i, scores[i]);
+    }
+    
+    STAssertTrue(MatchHeap32_getThreshold(heap) == 3, @"Wrong threshold");
+    
+    size_t indices[4];
+    Float32 sortedScores[4];
+    Float32 bestScore;
+    
+    STAssertEquals(MatchHeap32_getSorted(heap, indices, sortedScores), (size_t)4, @"Wrong match count");
+    STAssertEquals(MatchHeap32_getBest(heap, &bestScore), (size_t)9, @"Wrong best match");
+    STAssertTrue(bestScore == 0, @"Wrong best score %f", bestScore);
+    
+    const size_t expectedIndices[] = {9, 3, 5, 1};
+    
+    for (size_t i = 0; i < 4; ++i) {
+        
+        STAssertEquals(indices[i], expectedIndices[i], @"Wrong index at rank %zu", i);
+        STAssertTrue(sortedScores[i] == scores[expectedIndices[i]], @"Wrong score at rank %zu", i);
+    }
+    
+    MatchHeap32_delete(heap);
+}
+
+- (void)testInsertEvictsWorst
+{
+    MatchHeap32 *heap = MatchHeap32_new(2);
+    
+    STAssertTrue(MatchHeap32_insert(heap, 0, 2), @"First candidate not kept");
+    STAssertTrue(MatchHeap32_insert(heap, 1, 4), @"Second candidate not kept");
+    STAssertFalse(MatchHeap32_insert(heap, 2, 5), @"Worse candidate kept");
+    STAssertTrue(MatchHeap32_getThreshold(heap) == 4, @"Wrong threshold");
+    STAssertTrue(MatchHeap32_insert(heap, 3, 1), @"Better candidate not kept");
+    STAssertTrue(MatchHeap32_getThreshold(heap) == 2, @"Worst match not evicted");
+    
+    size_t indices[2];
+    
+    MatchHeap32_getSorted(heap, indices, NULL);
+    STAssertEquals(indices[0], (size_t)3, @"Wrong best index");
+    STAssertEquals(indices[1], (size_t)0, @"Wrong second index");
+    
+    MatchHeap32_clear(heap);
+    STAssertEquals(heap->count, (size_t)0, @"Clear kept matches");
+    STAssertTrue(MatchHeap32_getThreshold(heap) == INFINITY, @"Cleared heap has a threshold");
+    
+    MatchHeap32_delete(heap);
+}
+
+- (void)testTiesKeepEarliestIndex
+{
+    MatchHeap32 *heap = MatchHeap32_new(3);
+    
+    for (size_t i = 4; i < 8; ++i) {
+        
+        MatchHeap32_insert(heap, i, 1);
+    }
+    
+    STAssertFalse(MatchHeap32_insert(heap, 8, 1), @"Later tie kept");
+    STAssertTrue(MatchHeap32_insert(heap, 0, 1), @"Earlier tie not kept");
+    
+    size_t indices[3];
+    
+    MatchHeap32_getSorted(heap, indices, NULL);
+    
+    STAssertEquals(indices[0], (size_t)0, @"Wrong index at rank 0");
+    STAssertEquals(indices[1], (size_t)4, @"Wrong index at rank 1");
+    STAssertEquals(indices[2], (size_t)5, @"Wrong index at rank 2");
+    STAssertEquals(MatchHeap32_getBest(heap, NULL), (size_t)0, @"Wrong best of a tie");
+    
+    MatchHeap32_delete(heap);
+}
+
+- (void)testNaNIsNotKept
+{
+    MatchHeap32 *heap = MatchHeap32_new(2);
+    
+    STAssertFalse(MatchHeap32_insert(heap, 0, NAN), @"NaN kept in an empty heap");
+    STAssertEquals(heap->count, (size_t)0, @"NaN counted");
+    
+    MatchHeap32_insert(heap, 1, 3);
+    MatchHeap32_insert(heap, 2, INFINITY);
+    
+    STAssertFalse(MatchHeap32_insert(heap, 3, NAN), @"NaN kept in a full heap");
+    STAssertTrue(MatchHeap32_insert(heap, 4, 2), @"Candidate not kept after a NaN");
+    
+    Float32 bestScore;
+    
+    STAssertEquals(MatchHeap32_getBest(heap, &bestScore), (size_t)4, @"Wrong best match");
+    STAssertTrue(bestScore == 2, @"Wrong best score %f", bestScore);
+    STAssertTrue(MatchHeap32_getThreshold(heap) == 3, @"Wrong threshold");
+    
+    MatchHeap32_delete(heap);
+}
+
+- (void)testGetSortedMatchesSortedCandidates
+{
+    const size_t candidateCount = 200;
+    const size_t capacity = 17;
+    Float32 scores[candidateCount];
+    UInt32 seed = 7;
+    MatchHeap32 *heap = MatchHeap32_new(capacity);
+    
+    for (size_t i = 0; i < candidateCount; ++i) {
+        
+        seed = seed * 1103515245 + 12345;
+        scores[i] = (Float32)((seed >> 16) % 32);
+        MatchHeap32_insert(heap, i, scores[i]);
+    }
+    
+    size_t order[candidateCount];
+    
+    for (size_t i = 0; i < candidateCount; ++i) {
+        
+        order[i] = i;
+        
+        for (size_t j = i; j > 0 && scores[order[j]] < scores[order[j - 1]]; --j) {
+            
+            size_t index = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = index;
+        }
+    }
+    
+    size_t indices[capacity];
+    Float32 sortedScores[capacity];
+    
+    STAssertEquals(MatchHeap32_getSorted(heap, indices, sortedScores), capacity, @"Wrong match count");
+    
+    for (size_t i = 0; i < capacity; ++i) {
+        
+        STAssertEquals(indices[i], order[i], @"Wrong index at rank %zu", i);
+        STAssertTrue(sortedScores[i] == scores[order[i]], @"Wrong score at rank %zu", i);
+    }
+    
+    STAssertEquals(MatchHeap32_getSorted(heap, indices, NULL), capacity, @"Sorting twice changed the count");
+    STAssertEquals(indices[0], order[0], @"Sorting twice changed the best match");
+    
+    MatchHeap32_delete(heap);
+}
+
+@end